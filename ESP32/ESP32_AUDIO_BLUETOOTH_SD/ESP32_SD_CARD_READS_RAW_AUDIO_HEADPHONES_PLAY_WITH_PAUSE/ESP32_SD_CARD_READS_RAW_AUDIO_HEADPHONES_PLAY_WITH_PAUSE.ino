@@ -1,5 +1,7 @@
 #include "BluetoothA2DPSource.h"
 #include "SD_MMC.h"
+#include "esp_heap_caps.h"
+#include "spsc_ring.h"
 
 BluetoothA2DPSource a2dp;
 File audioFile;
@@ -9,31 +11,61 @@ const char* HEADSET_NAME = "G435 Bluetooth Gaming Headset";
 volatile bool playEnabled = false;
 volatile bool playbackDone = false;
 
+// SD reads happen in readerTask, not in the A2DP callback: it fills a PSRAM
+// ring with large sequential reads and raw_cb only copies out of it.
+const size_t RING_SIZE = 32 * 1024;   // power of two
+const size_t READ_CHUNK = 4096;
+SpscRing ring;
+uint8_t* stage = nullptr;             // DMA-capable buffer for SD reads
+TaskHandle_t readerHandle = NULL;
+volatile bool fileEof = false;
+volatile uint32_t underruns = 0;
+volatile uint32_t underrunBytes = 0;
+
 int32_t raw_cb(uint8_t *data, int32_t len) {
-  if (!playEnabled || !audioFile) {
+  if (!playEnabled) {
     memset(data, 0, len);
     return len;
   }
 
-  int bytes_read = audioFile.read(data, len);
-  if (bytes_read <= 0) {
-    playbackDone = true;
-    playEnabled = false;
-    memset(data, 0, len);
-    return len;
+  size_t n = ring.read(data, len);
+  if (n < (size_t)len) {
+    if (fileEof && n == 0) {
+      playbackDone = true;
+      playEnabled = false;
+    } else if (!fileEof) {
+      underruns++;
+      underrunBytes += len - n;
+    }
+    memset(data + n, 0, len - n);
   }
+  if (ring.available() < RING_SIZE / 2) xTaskNotifyGive(readerHandle);
+  return len;
+}
 
-  if (bytes_read < len) {
-    memset(data + bytes_read, 0, len - bytes_read);
-    return len;
+void readerTask(void*) {
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(20));
+    while (playEnabled && !fileEof && ring.space() >= READ_CHUNK) {
+      int n = audioFile.read(stage, READ_CHUNK);
+      if (n <= 0) {
+        fileEof = true;
+        break;
+      }
+      ring.write(stage, n);
+    }
   }
-  return bytes_read;
 }
 
 void startAndPlayOnce() {
   audioFile.seek(0);
+  ring.discard();   // callback is not installed yet, safe to reset here
+  fileEof = false;
+  underruns = 0;
+  underrunBytes = 0;
   playbackDone = false;
   playEnabled = true;
+  xTaskNotifyGive(readerHandle);  // prefill before A2DP asks for data
 
   a2dp.set_local_name("ESP32-CAM Droid");
   a2dp.set_data_callback(raw_cb);
@@ -60,7 +92,8 @@ void runCycles(int cycles) {
     uint32_t t0 = millis();
     while (!playbackDone && millis() - t0 < 60000) delay(20);
 
-    Serial.printf("Cycle %d: STOP\n", i + 1);
+    Serial.printf("Cycle %d: STOP (underruns=%u, %u bytes)\n", i + 1,
+                  (unsigned)underruns, (unsigned)underrunBytes);
     stopA2dpSafe();
 
     delay(1500);
@@ -75,6 +108,11 @@ void setup() {
   audioFile = SD_MMC.open("/out2.raw", FILE_READ);
   if (!audioFile) while (true) delay(1000);
 
+  uint8_t* ringBuf = (uint8_t*)heap_caps_malloc(RING_SIZE, MALLOC_CAP_SPIRAM);
+  stage = (uint8_t*)heap_caps_malloc(READ_CHUNK, MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL);
+  if (!ringBuf || !stage || !ring.init(ringBuf, RING_SIZE)) while (true) delay(1000);
+  xTaskCreatePinnedToCore(readerTask, "sd_reader", 3072, NULL, 3, &readerHandle, 1);
+
   Serial.println("Press 'c' to run cycles.");
 }
 
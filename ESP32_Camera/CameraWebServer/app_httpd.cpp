@@ -20,6 +20,7 @@
 #include "sdkconfig.h"
 #include "camera_index.h"
 #include "board_config.h"
+#include "rate_control.h"
 
 #if defined(ARDUINO_ARCH_ESP32) && defined(CONFIG_ARDUHAL_ESP_LOG)
 #include "esp32-hal-log.h"
@@ -47,6 +48,12 @@ static const char *_STREAM_PART = "Content-Type: image/jpeg\r\nContent-Length: %
 httpd_handle_t stream_httpd = NULL;
 httpd_handle_t camera_httpd = NULL;
 
+// Adaptive streaming: JPEG quality, then frame size (sensor JPEG only), then
+// frame skipping to hold RATE_TARGET_FPS. Toggle with /control?var=adaptive.
+#define RATE_TARGET_FPS 15
+#define RATE_TARGET_KBPS 0  // 0 = no bitrate cap
+static bool rate_control_enabled = true;
+
 typedef struct {
   size_t size;   //number of values used for filtering
   size_t index;  //current value index
@@ -70,7 +77,6 @@ static ra_filter_t *ra_filter_init(ra_filter_t *filter, size_t sample_size) {
   return filter;
 }
 
-#if ARDUHAL_LOG_LEVEL >= ARDUHAL_LOG_LEVEL_INFO
 static int ra_filter_run(ra_filter_t *filter, int value) {
   if (!filter->values) {
     return value;
@@ -85,7 +91,6 @@ static int ra_filter_run(ra_filter_t *filter, int value) {
   }
   return filter->sum / filter->count;
 }
-#endif
 
 #if defined(LED_GPIO_NUM)
 void enable_led(bool en) {  // Turn LED On or Off
@@ -205,96 +210,301 @@ static esp_err_t capture_handler(httpd_req_t *req) {
   return res;
 }
 
-static esp_err_t stream_handler(httpd_req_t *req) {
-  camera_fb_t *fb = NULL;
-  struct timeval _timestamp;
-  esp_err_t res = ESP_OK;
-  size_t _jpg_buf_len = 0;
-  uint8_t *_jpg_buf = NULL;
-  char *part_buf[128];
+// ---- MJPEG broadcast ----
+//
+// One producer task captures, encodes and publishes each frame once;
+// every /stream connection runs in its own task and sends whatever frame is
+// newest when it is ready for the next one. Frames are reference counted,
+// so a slow viewer only skips frames and never holds up the producer or
+// other viewers. The producer runs while at least one viewer is connected.
 
-  static int64_t last_frame = 0;
-  if (!last_frame) {
-    last_frame = esp_timer_get_time();
+#define MAX_STREAM_VIEWERS 4
+#define STREAM_PRODUCER_STACK 8192
+#define STREAM_VIEWER_STACK 4096
+#define STREAM_TASK_PRIO 5
+
+typedef struct {
+  uint8_t *buf;
+  size_t len;
+  struct timeval timestamp;
+  uint32_t seq;
+  int refs;
+} stream_frame_t;
+
+static portMUX_TYPE stream_mux = portMUX_INITIALIZER_UNLOCKED;
+static stream_frame_t *stream_latest = NULL;
+static uint32_t stream_seq = 0;
+static TaskHandle_t stream_viewers[MAX_STREAM_VIEWERS];
+static int stream_viewer_count = 0;
+static bool stream_producer_running = false;
+static uint32_t stream_fastest_send_ms = 0;  // best viewer since the last frame
+
+static void stream_frame_release(stream_frame_t *f) {
+  if (!f) {
+    return;
   }
+  portENTER_CRITICAL(&stream_mux);
+  bool last = --f->refs == 0;
+  portEXIT_CRITICAL(&stream_mux);
+  if (last) {
+    free(f->buf);
+    free(f);
+  }
+}
 
-  res = httpd_resp_set_type(req, _STREAM_CONTENT_TYPE);
-  if (res != ESP_OK) {
-    return res;
+// Newest frame other than `after_seq`, with a reference held; waits for
+// the producer's notification up to `timeout`
+static stream_frame_t *stream_frame_acquire(uint32_t after_seq, TickType_t timeout) {
+  for (int tries = 0; tries < 2; tries++) {
+    portENTER_CRITICAL(&stream_mux);
+    stream_frame_t *f = stream_latest;
+    if (f && f->seq != after_seq) {
+      f->refs++;
+    } else {
+      f = NULL;
+    }
+    portEXIT_CRITICAL(&stream_mux);
+    if (f || !ulTaskNotifyTake(pdTRUE, timeout)) {
+      return f;
+    }
   }
+  return NULL;
+}
 
-  httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
-  httpd_resp_set_hdr(req, "X-Framerate", "60");
+static void stream_publish(stream_frame_t *f) {
+  portENTER_CRITICAL(&stream_mux);
+  f->seq = ++stream_seq;
+  f->refs = 1;  // held by stream_latest
+  stream_frame_t *old = stream_latest;
+  stream_latest = f;
+  // Notify under the lock: a viewer removes itself under stream_mux before
+  // deleting its task, so every handle here is still alive. The ISR variant
+  // never yields, which a critical section doesn't allow.
+  BaseType_t woken = pdFALSE;
+  for (int i = 0; i < stream_viewer_count; i++) {
+    vTaskNotifyGiveFromISR(stream_viewers[i], &woken);
+  }
+  portEXIT_CRITICAL(&stream_mux);
 
-#if defined(LED_GPIO_NUM)
-  isStreaming = true;
-  enable_led(true);
-#endif
+  if (woken) {
+    taskYIELD();
+  }
+  stream_frame_release(old);
+}
+
+static void stream_producer_task(void *arg) {
+  // The frame size the stream starts at is the ceiling; raw formats keep
+  // their size (their buffers are allocated for it)
+  sensor_t *s = esp_camera_sensor_get();
+  bool sensor_jpeg = s->pixformat == PIXFORMAT_JPEG;
+  framesize_t start_size = s->status.framesize;
+  RateControlConfig rc_cfg = {
+    RATE_TARGET_FPS, RATE_TARGET_KBPS, 10, 90, sensor_jpeg ? FRAMESIZE_QQVGA : start_size, start_size, false
+  };
+  RateController rate_ctl;
+  rate_ctl.begin(rc_cfg, start_size, sensor_jpeg ? RateController::qualityFromSensor(s->status.quality) : 80);
+  int64_t last_frame = esp_timer_get_time();
+  size_t last_len = 0;
 
   while (true) {
-    fb = esp_camera_fb_get();
+    portENTER_CRITICAL(&stream_mux);
+    bool stop = stream_viewer_count == 0;
+    stream_frame_t *old = NULL;
+    if (stop) {
+      stream_producer_running = false;
+      old = stream_latest;
+      stream_latest = NULL;
+    }
+    portEXIT_CRITICAL(&stream_mux);
+    if (stop) {
+      stream_frame_release(old);
+      vTaskDelete(NULL);
+      return;
+    }
+
+    camera_fb_t *fb = esp_camera_fb_get();
     if (!fb) {
       log_e("Camera capture failed");
-      res = ESP_FAIL;
-    } else {
-      _timestamp.tv_sec = fb->timestamp.tv_sec;
-      _timestamp.tv_usec = fb->timestamp.tv_usec;
+      vTaskDelay(pdMS_TO_TICKS(10));
+      continue;
+    }
+    if (rate_control_enabled && rate_ctl.shouldSkip(esp_timer_get_time())) {
+      esp_camera_fb_return(fb);
+      continue;
+    }
+
+    stream_frame_t *f = (stream_frame_t *)calloc(1, sizeof(stream_frame_t));
+    bool ok = f != NULL;
+    if (ok) {
+      f->timestamp.tv_sec = fb->timestamp.tv_sec;
+      f->timestamp.tv_usec = fb->timestamp.tv_usec;
       if (fb->format != PIXFORMAT_JPEG) {
-        bool jpeg_converted = frame2jpg(fb, 80, &_jpg_buf, &_jpg_buf_len);
-        esp_camera_fb_return(fb);
-        fb = NULL;
-        if (!jpeg_converted) {
-          log_e("JPEG compression failed");
-          res = ESP_FAIL;
-        }
+        int64_t enc_start = esp_timer_get_time();
+        ok = frame2jpg(fb, rate_control_enabled ? rate_ctl.quality() : 80, &f->buf, &f->len);
+        rate_ctl.noteEncode((esp_timer_get_time() - enc_start) / 1000);
       } else {
-        _jpg_buf_len = fb->len;
-        _jpg_buf = fb->buf;
+        // Copy out so the driver gets its buffer back right away
+        f->buf = (uint8_t *)(psramFound() ? ps_malloc(fb->len) : malloc(fb->len));
+        ok = f->buf != NULL;
+        if (ok) {
+          memcpy(f->buf, fb->buf, fb->len);
+          f->len = fb->len;
+        }
       }
     }
-    if (res == ESP_OK) {
-      res = httpd_resp_send_chunk(req, _STREAM_BOUNDARY, strlen(_STREAM_BOUNDARY));
-    }
-    if (res == ESP_OK) {
-      size_t hlen = snprintf((char *)part_buf, 128, _STREAM_PART, _jpg_buf_len, _timestamp.tv_sec, _timestamp.tv_usec);
-      res = httpd_resp_send_chunk(req, (const char *)part_buf, hlen);
-    }
-    if (res == ESP_OK) {
-      res = httpd_resp_send_chunk(req, (const char *)_jpg_buf, _jpg_buf_len);
-    }
-    if (fb) {
-      esp_camera_fb_return(fb);
-      fb = NULL;
-      _jpg_buf = NULL;
-    } else if (_jpg_buf) {
-      free(_jpg_buf);
-      _jpg_buf = NULL;
-    }
-    if (res != ESP_OK) {
-      log_e("Send frame failed");
-      break;
+    esp_camera_fb_return(fb);
+    if (!ok) {
+      log_e("JPEG compression failed");
+      if (f) {
+        free(f->buf);
+        free(f);
+      }
+      continue;
     }
-    int64_t fr_end = esp_timer_get_time();
 
-    int64_t frame_time = fr_end - last_frame;
-    last_frame = fr_end;
+    // Feedback is the fastest viewer's send time; slower ones skip frames
+    portENTER_CRITICAL(&stream_mux);
+    uint32_t send_ms = stream_fastest_send_ms;
+    stream_fastest_send_ms = 0;
+    portEXIT_CRITICAL(&stream_mux);
+    stream_publish(f);
 
-    frame_time /= 1000;
-#if ARDUHAL_LOG_LEVEL >= ARDUHAL_LOG_LEVEL_INFO
+    int64_t fr_end = esp_timer_get_time();
+    int64_t frame_time = (fr_end - last_frame) / 1000;
+    last_frame = fr_end;
     uint32_t avg_frame_time = ra_filter_run(&ra_filter, frame_time);
-#endif
     log_i(
-      "MJPG: %uB %ums (%.1ffps), AVG: %ums (%.1ffps)", (uint32_t)(_jpg_buf_len), (uint32_t)frame_time, 1000.0 / (uint32_t)frame_time, avg_frame_time,
+      "MJPG: %uB %ums (%.1ffps), AVG: %ums (%.1ffps)", (uint32_t)(f->len), (uint32_t)frame_time, 1000.0 / (uint32_t)frame_time, avg_frame_time,
       1000.0 / avg_frame_time
     );
+
+    if (rate_control_enabled && send_ms) {
+      rate_ctl.update(send_ms, last_len, avg_frame_time);
+      framesize_t size;
+      if (rate_ctl.takeSizeChange(&size)) {
+        s->set_framesize(s, size);
+      }
+      if (sensor_jpeg && s->status.quality != rate_ctl.sensorQuality()) {
+        s->set_quality(s, rate_ctl.sensorQuality());
+      }
+    }
+    last_len = f->len;  // still referenced by stream_latest or a viewer
   }
+}
+
+static void stream_remove_viewer(TaskHandle_t task) {
+  portENTER_CRITICAL(&stream_mux);
+  for (int i = 0; i < stream_viewer_count; i++) {
+    if (stream_viewers[i] == task) {
+      stream_viewers[i] = stream_viewers[--stream_viewer_count];
+      break;
+    }
+  }
+  portEXIT_CRITICAL(&stream_mux);
+}
+
+static bool stream_add_viewer(TaskHandle_t task) {
+  bool start = false;
+  bool added = false;
+  portENTER_CRITICAL(&stream_mux);
+  if (stream_viewer_count < MAX_STREAM_VIEWERS) {
+    stream_viewers[stream_viewer_count++] = task;
+    added = true;
+    start = !stream_producer_running;
+    stream_producer_running = true;
+  }
+  portEXIT_CRITICAL(&stream_mux);
+
+  if (start && xTaskCreate(stream_producer_task, "stream_prod", STREAM_PRODUCER_STACK, NULL, STREAM_TASK_PRIO, NULL) != pdPASS) {
+    log_e("Stream producer start failed");
+    portENTER_CRITICAL(&stream_mux);
+    stream_producer_running = false;
+    portEXIT_CRITICAL(&stream_mux);
+    stream_remove_viewer(task);
+    added = false;
+  }
+  return added;
+}
+
+// One per /stream connection, on a request detached from the httpd task
+static void stream_viewer_task(void *arg) {
+  httpd_req_t *req = (httpd_req_t *)arg;
+  TaskHandle_t self = xTaskGetCurrentTaskHandle();
+  esp_err_t res = ESP_OK;
+  char part_buf[128];
+  uint32_t last_seq = 0;
+
+  if (!stream_add_viewer(self)) {
+    httpd_resp_set_status(req, "503 Service Unavailable");
+    httpd_resp_sendstr(req, "Too many viewers");
+    httpd_req_async_handler_complete(req);
+    vTaskDelete(NULL);
+    return;
+  }
+
+  httpd_resp_set_type(req, _STREAM_CONTENT_TYPE);
+  httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+  httpd_resp_set_hdr(req, "X-Framerate", "60");
 
 #if defined(LED_GPIO_NUM)
-  isStreaming = false;
-  enable_led(false);
+  isStreaming = true;
+  enable_led(true);
 #endif
 
-  return res;
+  while (res == ESP_OK) {
+    stream_frame_t *f = stream_frame_acquire(last_seq, pdMS_TO_TICKS(1000));
+    if (!f) {
+      continue;  // camera slow or producer restarting
+    }
+    last_seq = f->seq;
+
+    int64_t send_start = esp_timer_get_time();
+    res = httpd_resp_send_chunk(req, _STREAM_BOUNDARY, strlen(_STREAM_BOUNDARY));
+    if (res == ESP_OK) {
+      size_t hlen = snprintf(part_buf, sizeof(part_buf), _STREAM_PART, f->len, f->timestamp.tv_sec, f->timestamp.tv_usec);
+      res = httpd_resp_send_chunk(req, part_buf, hlen);
+    }
+    if (res == ESP_OK) {
+      res = httpd_resp_send_chunk(req, (const char *)f->buf, f->len);
+    }
+    stream_frame_release(f);
+
+    uint32_t send_ms = (esp_timer_get_time() - send_start) / 1000;
+    portENTER_CRITICAL(&stream_mux);
+    if (res == ESP_OK && (!stream_fastest_send_ms || send_ms < stream_fastest_send_ms)) {
+      stream_fastest_send_ms = send_ms ? send_ms : 1;
+    }
+    portEXIT_CRITICAL(&stream_mux);
+  }
+  log_e("Send frame failed");
+
+  stream_remove_viewer(self);
+#if defined(LED_GPIO_NUM)
+  portENTER_CRITICAL(&stream_mux);
+  bool none_left = stream_viewer_count == 0;
+  portEXIT_CRITICAL(&stream_mux);
+  if (none_left) {
+    isStreaming = false;
+    enable_led(false);
+  }
+#endif
+
+  httpd_req_async_handler_complete(req);
+  vTaskDelete(NULL);
+}
+
+static esp_err_t stream_handler(httpd_req_t *req) {
+  // Hand the connection to its own task so the stream server stays free
+  // to accept more viewers
+  httpd_req_t *async_req = NULL;
+  if (httpd_req_async_handler_begin(req, &async_req) != ESP_OK) {
+    return ESP_FAIL;
+  }
+  if (xTaskCreate(stream_viewer_task, "stream_view", STREAM_VIEWER_STACK, async_req, STREAM_TASK_PRIO, NULL) != pdPASS) {
+    httpd_req_async_handler_complete(async_req);
+    return ESP_FAIL;
+  }
+  return ESP_OK;
 }
 
 static esp_err_t parse_get(httpd_req_t *req, char **obuf) {
@@ -342,6 +552,8 @@ static esp_err_t cmd_handler(httpd_req_t *req) {
     if (s->pixformat == PIXFORMAT_JPEG) {
       res = s->set_framesize(s, (framesize_t)val);
     }
+  } else if (!strcmp(variable, "adaptive")) {
+    rate_control_enabled = val;
   } else if (!strcmp(variable, "quality")) {
     res = s->set_quality(s, val);
   } else if (!strcmp(variable, "contrast")) {
@@ -454,6 +666,7 @@ static esp_err_t status_handler(httpd_req_t *req) {
   p += sprintf(p, "\"pixformat\":%u,", s->pixformat);
   p += sprintf(p, "\"framesize\":%u,", s->status.framesize);
   p += sprintf(p, "\"quality\":%u,", s->status.quality);
+  p += sprintf(p, "\"adaptive\":%u,", rate_control_enabled);
   p += sprintf(p, "\"brightness\":%d,", s->status.brightness);
   p += sprintf(p, "\"contrast\":%d,", s->status.contrast);
   p += sprintf(p, "\"saturation\":%d,", s->status.saturation);
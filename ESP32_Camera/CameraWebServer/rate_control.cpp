@@ -0,0 +1,140 @@
+#include "rate_control.h"
+#include <Arduino.h>
+#include "esp_timer.h"
+
+// Frame sizes the controller steps through, smallest first
+static const framesize_t LADDER[] = {
+  FRAMESIZE_QQVGA, FRAMESIZE_QVGA, FRAMESIZE_VGA, FRAMESIZE_SVGA,
+  FRAMESIZE_XGA, FRAMESIZE_SXGA, FRAMESIZE_UXGA,
+};
+static const int LADDER_LEN = sizeof(LADDER) / sizeof(LADDER[0]);
+
+static const int QUALITY_STEP = 5;
+static const float EWMA_ALPHA = 0.125f;
+static const float OVER_BUDGET = 1.1f;    // step down above 110% of the budget
+static const float UNDER_BUDGET = 0.6f;   // step up below 60%
+static const float UNDER_KBPS = 0.7f;
+static const uint32_t DOWN_SETTLE = 8;    // frames between changes
+static const uint32_t UP_SETTLE = 30;
+
+// Largest ladder entry not above `size`
+static int ladderIndex(framesize_t size) {
+  int idx = 0;
+  for (int i = 0; i < LADDER_LEN; i++) {
+    if (LADDER[i] <= size) idx = i;
+  }
+  return idx;
+}
+
+static float ewma(float avg, float sample) {
+  return avg <= 0 ? sample : avg + EWMA_ALPHA * (sample - avg);
+}
+
+RateController::RateController()
+  : quality_(30), size_(FRAMESIZE_VGA), sizeIdx_(0), minIdx_(0), maxIdx_(0), sizeChanged_(false),
+    encodeMs_(0), sendMs_(0), bytes_(0), frameMs_(0), kbps_(0), lastUpdateUs_(0), nextDueUs_(0),
+    framesSinceChange_(0), skipped_(0) {}
+
+void RateController::begin(const RateControlConfig& cfg, framesize_t size, int quality) {
+  cfg_ = cfg;
+  if (cfg_.targetFps <= 0) cfg_.targetFps = 10;
+  minIdx_ = ladderIndex(cfg.minSize);
+  maxIdx_ = ladderIndex(cfg.maxSize);
+  sizeIdx_ = ladderIndex(size);
+  size_ = size;
+  quality_ = constrain(quality, cfg.minQuality, cfg.maxQuality);
+  sizeChanged_ = false;
+  framesSinceChange_ = 0;
+}
+
+bool RateController::shouldSkip(int64_t nowUs) {
+  float intervalMs = 1000.0f / cfg_.targetFps;
+  if (cfg_.targetKbps && bytes_ > 0) {
+    float byteMs = bytes_ * 8 / cfg_.targetKbps;   // bits / (kbit/s) = ms
+    if (byteMs > intervalMs) intervalMs = byteMs;
+  }
+  int64_t interval = (int64_t)(intervalMs * 1000);
+
+  if (nowUs < nextDueUs_) {
+    skipped_++;
+    return true;
+  }
+  // Keep the average on target, but don't bank credit across a long stall
+  nextDueUs_ += interval;
+  if (nextDueUs_ < nowUs - interval) nextDueUs_ = nowUs + interval;
+  return false;
+}
+
+void RateController::noteEncode(uint32_t encodeMs) {
+  encodeMs_ = ewma(encodeMs_, encodeMs);
+}
+
+void RateController::update(uint32_t sendMs, size_t bytes, uint32_t avgFrameMs) {
+  int64_t now = esp_timer_get_time();
+  if (lastUpdateUs_) frameMs_ = ewma(frameMs_, (now - lastUpdateUs_) / 1000.0f);
+  lastUpdateUs_ = now;
+  sendMs_ = ewma(sendMs_, sendMs);
+  bytes_ = ewma(bytes_, bytes);
+
+  float periodMs = avgFrameMs ? avgFrameMs : frameMs_;
+  kbps_ = periodMs > 0 ? (uint32_t)(bytes_ * 8 / periodMs) : 0;
+
+  // Time the device needs per frame, independent of how fast the sensor is
+  float busyMs = cfg_.pipelined ? max(encodeMs_, sendMs_) : encodeMs_ + sendMs_;
+  float budgetMs = 1000.0f / cfg_.targetFps;
+  bool over = busyMs > budgetMs * OVER_BUDGET ||
+              (cfg_.targetKbps && kbps_ > cfg_.targetKbps * OVER_BUDGET);
+  bool under = busyMs < budgetMs * UNDER_BUDGET &&
+               (!cfg_.targetKbps || kbps_ < cfg_.targetKbps * UNDER_KBPS);
+
+  framesSinceChange_++;
+  if (over && framesSinceChange_ >= DOWN_SETTLE) {
+    stepDown();
+  } else if (under && framesSinceChange_ >= UP_SETTLE) {
+    stepUp();
+  }
+}
+
+void RateController::stepDown() {
+  if (quality_ - QUALITY_STEP >= cfg_.minQuality) {
+    quality_ = quality_ - QUALITY_STEP;
+  } else if (sizeIdx_ > minIdx_) {
+    sizeIdx_--;
+    size_ = LADDER[sizeIdx_];
+    quality_ = (cfg_.minQuality + cfg_.maxQuality) / 2;   // fewer pixels buy back quality
+    sizeChanged_ = true;
+  } else {
+    return;  // at the floor; pacing drops frames instead
+  }
+  framesSinceChange_ = 0;
+}
+
+void RateController::stepUp() {
+  if (quality_ + QUALITY_STEP <= cfg_.maxQuality) {
+    quality_ = quality_ + QUALITY_STEP;
+  } else if (sizeIdx_ < maxIdx_) {
+    sizeIdx_++;
+    size_ = LADDER[sizeIdx_];
+    quality_ = cfg_.minQuality + (cfg_.maxQuality - cfg_.minQuality) / 4;
+    sizeChanged_ = true;
+  } else {
+    return;
+  }
+  framesSinceChange_ = 0;
+}
+
+int RateController::sensorQuality() const {
+  // Sensor JPEG: 0..63, lower is better; below ~10 frames overflow the buffers
+  return 10 + (100 - quality_) * 53 / 100;
+}
+
+int RateController::qualityFromSensor(int sensorQuality) {
+  return constrain(100 - (sensorQuality - 10) * 100 / 53, 1, 100);
+}
+
+bool RateController::takeSizeChange(framesize_t* size) {
+  if (!sizeChanged_) return false;
+  sizeChanged_ = false;
+  *size = size_;
+  return true;
+}
@@ -4,6 +4,9 @@
 #include "img_converters.h"
 // Camera model pins etc.
 #include "board_config.h"
+#include "frame_pipeline.h"
+#include "rate_control.h"
+#include "esp_timer.h"
 
 // WiFi
 const char* ssid     = "DIGI-Gua4";
@@ -22,88 +25,123 @@ static const bool USE_HTTPS_INSECURE_FOR_NOW = true; // TODO: remove later
 static const int W = 640;
 static const int H = 480;
 
-
-bool sendFrameAsJpegFromGray(uint8_t* gray, size_t len) {
-  Serial.println("[send] enter");
-
-  if (WiFi.status() != WL_CONNECTED) {
-    Serial.println("[send] WiFi NOT connected");
-    return false;
+// 1 = sensor JPEG: the OV2640 compresses in hardware and fb->buf is sent as
+// is, so there is no software encode stage. 0 = grayscale + fmt2jpg.
+#define SENSOR_JPEG 1
+static const int SENSOR_JPEG_QUALITY = 12;   // 0(best)-63(worst), typical 10-15
+
+// Adaptive JPEG (rate_control.cpp): quality first, then frame size, to hold
+// TARGET_FPS. Raw framebuffers are allocated for the init size, so the
+// controller only goes below FRAMESIZE_VGA, never above it.
+static const float TARGET_FPS = 10.0f;
+static const uint32_t TARGET_KBPS = 0;   // 0 = no bitrate cap
+RateController rate;
+
+// Encode-stage pacing; also applies frame size (and, for sensor JPEG,
+// quality) changes from the controller
+bool skipForRate(camera_fb_t* fb) {
+  sensor_t* s = esp_camera_sensor_get();
+  framesize_t size;
+  if (rate.takeSizeChange(&size)) {
+    s->set_framesize(s, size);
+    Serial.printf("[rate] framesize -> %d\n", (int)size);
+  }
+#if SENSOR_JPEG
+  static int sensorQuality = SENSOR_JPEG_QUALITY;
+  if (rate.sensorQuality() != sensorQuality) {
+    sensorQuality = rate.sensorQuality();
+    s->set_quality(s, sensorQuality);
   }
+#endif
+  return rate.shouldSkip(esp_timer_get_time());
+}
 
-  Serial.printf("[send] raw ptr=%p len=%u (expected %u)\n",
-                gray, (unsigned)len, (unsigned)(W * H));
+void logRateControl(uint32_t periodMs = 5000) {
+  static uint32_t lastMs = 0;
+  if (millis() - lastMs < periodMs) return;
+  lastMs = millis();
+  Serial.printf("[rate] quality=%d framesize=%d kbps=%u skipped=%u\n",
+                rate.quality(), (int)rate.frameSize(), (unsigned)rate.kbps(), (unsigned)rate.skipped());
+}
 
-  if (!gray) {
-    Serial.println("[send] gray == NULL");
-    return false;
-  }
 
-  if (len != (size_t)(W * H)) {
-    Serial.println("[send] raw size mismatch");
+// Encode stage: grayscale framebuffer -> JPEG. The framebuffer goes back
+// to the sensor as soon as the JPEG exists.
+bool encodeGrayToJpeg(camera_fb_t* fb, PipelineFrame* out) {
+  // Size follows the rate controller, so take it from the framebuffer
+  if (!fb->buf || fb->len != (size_t)fb->width * fb->height) {
+    Serial.printf("[encode] raw size mismatch len=%u (%ux%u)\n",
+                  (unsigned)fb->len, fb->width, fb->height);
     return false;
   }
 
-  Serial.printf("[send] free heap before jpeg: %u\n", ESP.getFreeHeap());
-
   uint8_t* jpg_buf = nullptr;
   size_t   jpg_len = 0;
 
-  const int quality = 30;
-
-  Serial.println("[send] calling fmt2jpg()");
+  const int quality = rate.quality();
 
+  uint32_t t0 = millis();
   bool okConv = fmt2jpg(
-      gray, len,
-      W, H,
+      fb->buf, fb->len,
+      fb->width, fb->height,
       PIXFORMAT_GRAYSCALE,
       quality,
       &jpg_buf, &jpg_len
   );
 
-  Serial.printf("[send] fmt2jpg ok=%d jpg_buf=%p jpg_len=%u\n",
-                okConv, jpg_buf, (unsigned)jpg_len);
+  rate.noteEncode(millis() - t0);
+  esp_camera_fb_return(fb);
+  out->fb = nullptr;
 
   if (!okConv || !jpg_buf || jpg_len == 0) {
-    Serial.println("[send] JPEG conversion FAILED");
+    Serial.println("[encode] JPEG conversion FAILED");
     if (jpg_buf) free(jpg_buf);
     return false;
   }
 
-  Serial.printf("[send] free heap after jpeg: %u\n", ESP.getFreeHeap());
+  out->data = jpg_buf;
+  out->len = jpg_len;
+  out->ownsData = true;
+  return true;
+}
+
+// Network stage: one HTTP POST per JPEG. The FrameTimingHeader goes in
+// X-Frame-Timing as hex, the same 40 bytes the WebSocket sketches send.
+bool postJpeg(const PipelineFrame& frame) {
+  if (WiFi.status() != WL_CONNECTED) {
+    Serial.println("[send] WiFi NOT connected");
+    return false;
+  }
+
+  FrameTimingHeader timing;
+  fillFrameTiming(frame, &timing);
+  char timingHex[2 * sizeof(timing) + 1];
+  const uint8_t* tb = (const uint8_t*)&timing;
+  for (size_t i = 0; i < sizeof(timing); i++) {
+    snprintf(timingHex + 2 * i, 3, "%02x", tb[i]);
+  }
 
   HTTPClient http;
   http.setTimeout(5000);
 
-  Serial.println("[send] http.begin()");
-
   if (!http.begin(uploadUrl)) {
     Serial.println("[send] http.begin FAILED");
-    free(jpg_buf);
     http.end();
     return false;
   }
 
-  Serial.println("[send] adding headers");
-
   http.addHeader("Content-Type", "image/jpeg");
   http.addHeader("X-Token", uploadToken);
   http.addHeader("Connection", "close");
+  http.addHeader("X-Frame-Timing", timingHex);
 
-  Serial.printf("[send] POSTing %u bytes\n", (unsigned)jpg_len);
-
-  int code = http.POST(jpg_buf, jpg_len);
-
-  Serial.printf("[send] HTTP response code: %d\n", code);
-
+  uint32_t t0 = millis();
+  int code = http.POST(frame.data, frame.len);
   http.end();
-  free(jpg_buf);
-
-  Serial.printf("[send] free heap after POST: %u\n", ESP.getFreeHeap());
+  rate.update(millis() - t0, frame.len);
 
   bool ok = (code >= 200 && code < 300);
-  Serial.printf("[send] DONE ok=%d\n", ok);
-
+  if (!ok) Serial.printf("[send] HTTP response code: %d\n", code);
   return ok;
 }
 
@@ -149,13 +187,21 @@ void initCamera() {
 
   config.xclk_freq_hz = 20000000;
 
-  // For pushing frames, use JPEG directly
+#if SENSOR_JPEG
+  config.pixel_format = PIXFORMAT_JPEG;
+#else
   config.pixel_format = PIXFORMAT_GRAYSCALE;
+#endif
 
   // Pick a sane default; you can raise later.
   config.frame_size   = FRAMESIZE_VGA;   // 640x480
-  config.jpeg_quality = 12;              // 0(best)-63(worst), typical 10-15
-  config.fb_count     = psramFound() ? 2 : 1;
+  config.jpeg_quality = SENSOR_JPEG_QUALITY;
+#if SENSOR_JPEG
+  // One extra buffer: sensor JPEGs stay out of the driver until they are sent
+  config.fb_count     = psramFound() ? PIPELINE_FB_COUNT + 1 : 1;
+#else
+  config.fb_count     = psramFound() ? PIPELINE_FB_COUNT : 1;
+#endif
 
   config.grab_mode    = psramFound() ? CAMERA_GRAB_LATEST : CAMERA_GRAB_WHEN_EMPTY;
   config.fb_location  = psramFound() ? CAMERA_FB_IN_PSRAM : CAMERA_FB_IN_DRAM;
@@ -170,6 +216,9 @@ void initCamera() {
   sensor_t* s = esp_camera_sensor_get();
   Serial.printf("PID: 0x%04x\n", s->id.PID);
   s->set_framesize(s, config.frame_size);
+#if SENSOR_JPEG
+  s->set_special_effect(s, 2);  // grayscale, like the raw path; drop for color
+#endif
   // s->set_vflip(s, 1);
   // s->set_hmirror(s, 1);
   // s->set_brightness(s, 1);
@@ -184,22 +233,28 @@ void setup() {
 
   Serial.print("WiFi OK, IP: ");
   Serial.println(WiFi.localIP());
+
+  // Capture, JPEG encode (grayscale mode only) and upload run as separate tasks
+#if SENSOR_JPEG
+  // Quality goes to the sensor's JPEG engine; frames pass straight through
+  RateControlConfig rc = {TARGET_FPS, TARGET_KBPS, 10, 90, FRAMESIZE_QQVGA, FRAMESIZE_VGA, true};
+  rate.begin(rc, FRAMESIZE_VGA, RateController::qualityFromSensor(SENSOR_JPEG_QUALITY));
+  FrameEncodeFn encode = nullptr;
+#else
+  RateControlConfig rc = {TARGET_FPS, TARGET_KBPS, 10, 60, FRAMESIZE_QQVGA, FRAMESIZE_VGA, true};
+  rate.begin(rc, FRAMESIZE_VGA, 30);
+  FrameEncodeFn encode = encodeGrayToJpeg;
+#endif
+
+  FramePipelineConfig pipeline = {encode, postJpeg, nullptr, skipForRate};
+  if (!startFramePipeline(pipeline)) {
+    Serial.println("Pipeline start FAILED");
+    ESP.restart();
+  }
 }
 
 void loop() {
-  camera_fb_t* fb = esp_camera_fb_get();
-  if (!fb) { delay(10); return; }
-
-  // fb->buf is raw grayscale bytes
-  bool ok = sendFrameAsJpegFromGray(fb->buf, fb->len);
-
-  esp_camera_fb_return(fb);
-
-  if (!ok) {
-    Serial.printf("Failed sending");
-    delay(200);
-    }
-    Serial.printf("Sent");
-  delay(1);
+  logFramePipelineStats();
+  logRateControl();
+  delay(100);
 }
-
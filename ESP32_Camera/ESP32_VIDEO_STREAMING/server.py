@@ -1,6 +1,10 @@
 import asyncio
 import time
 from typing import Optional
+import io
+import json
+import struct
+from PIL import Image
 
 from fastapi import FastAPI, Request, Response, HTTPException
 from fastapi.responses import StreamingResponse
@@ -13,12 +17,77 @@ UPLOAD_TOKEN = "change-me"  # put this in env later
 # ---- in-memory latest frame ----
 latest_jpeg: Optional[bytes] = None
 latest_ts: float = 0.0
+latest_meta: Optional[dict] = None  # device timings, if the upload had them
 
 # For streaming: event notifies viewers a new frame arrived
 frame_event = asyncio.Event()
 frame_lock = asyncio.Lock()
 
 
+# Per-frame device timings (FrameTimingHeader in frame_pipeline.h)
+TIMING_MAGIC = b"FTS1"
+TIMING_HEADER = struct.Struct("<4sIQIIIIII")
+
+
+class LatencyTracker:
+    """Turns the device's frame timings into per-stage latencies.
+
+    The ESP32 only knows time since boot, so its clock is mapped onto ours
+    using the fastest upload seen so far. net_ms is how much longer a frame
+    took than that one, and capture_ts is a lower bound (off by the
+    best-case network delay).
+    """
+
+    def __init__(self):
+        self.offset_us: Optional[int] = None
+        self.last_seq: Optional[int] = None
+        self.missing = 0
+
+    def frame_meta(self, header: bytes, recv: float) -> dict:
+        (_, seq, capture_us, grab, encode_start, encode, send_start,
+         last_send, last_send_seq) = TIMING_HEADER.unpack_from(header)
+        if self.last_seq is None or seq <= self.last_seq:
+            self.offset_us = None  # first frame, or the device restarted
+        elif seq > self.last_seq + 1:
+            self.missing += seq - self.last_seq - 1
+        self.last_seq = seq
+
+        transit_us = int(recv * 1e6) - (capture_us + send_start)
+        if self.offset_us is None or transit_us < self.offset_us:
+            self.offset_us = transit_us
+
+        def ms(us):
+            return round(us / 1000.0, 2)
+
+        return {
+            "seq": seq,
+            "capture_ts": (capture_us + self.offset_us) / 1e6,
+            "capture_ms": ms(grab),
+            "encode_queue_ms": ms(encode_start - grab),
+            "encode_ms": ms(encode),
+            "send_queue_ms": ms(send_start - encode_start - encode),
+            "send_ms": ms(last_send),  # previous frame (last_send_seq)
+            "send_seq": last_send_seq,
+            "net_ms": ms(transit_us - self.offset_us),
+            "device_missing": self.missing,
+        }
+
+
+def frame_headers(ts: float, meta: Optional[dict]) -> dict:
+    """X-Frame-* response headers: capture time when the device sent timings."""
+    if meta is None:
+        return {"Cache-Control": "no-store", "X-Frame-Timestamp": str(ts)}
+    return {
+        "Cache-Control": "no-store",
+        "X-Frame-Timestamp": str(meta["capture_ts"]),
+        "X-Frame-Seq": str(meta["seq"]),
+        "X-Frame-Timing": json.dumps(meta, separators=(",", ":")),
+    }
+
+
+latency = LatencyTracker()
+
+
 @app.get("/health")
 def health():
     return {"ok": True, "has_frame": latest_jpeg is not None, "ts": latest_ts}
@@ -38,10 +107,23 @@ async def upload(request: Request):
     if not body or len(body) < 100:
         raise HTTPException(status_code=400, detail="empty/too small")
 
-    global latest_jpeg, latest_ts
+    # X-Frame-Timing: the device's FrameTimingHeader, hex encoded
+    now = time.time()
+    meta = None
+    try:
+        header = bytes.fromhex(request.headers.get("x-frame-timing", ""))
+    except ValueError:
+        header = b""
+    if header[:4] == TIMING_MAGIC and len(header) == TIMING_HEADER.size:
+        meta = latency.frame_meta(header, now)
+        meta["published"] = time.time()
+        meta["relay_ms"] = round((meta["published"] - now) * 1000, 2)
+
+    global latest_jpeg, latest_ts, latest_meta
     async with frame_lock:
         latest_jpeg = body
-        latest_ts = time.time()
+        latest_ts = now
+        latest_meta = meta
         frame_event.set()
         frame_event.clear()
 
@@ -55,18 +137,56 @@ async def latest():
             raise HTTPException(status_code=404, detail="no frame yet")
         data = latest_jpeg
         ts = latest_ts
+        meta = latest_meta
 
     return Response(
         content=data,
         media_type="image/jpeg",
         headers={
+            **frame_headers(ts, meta),
             "Cache-Control": "no-store, no-cache, must-revalidate, max-age=0",
             "Pragma": "no-cache",
-            "X-Frame-Timestamp": str(ts),
         },
     )
 
 
+# Grayscale for clients that want pixels: decoded here from the latest JPEG
+# on request, instead of the ESP32 encoding or sending raw frames
+gray_cache: Optional[bytes] = None
+gray_cache_ts: float = 0.0
+
+
+def jpeg_to_pgm(jpg: bytes) -> bytes:
+    img = Image.open(io.BytesIO(jpg))
+    img.draft("L", img.size)  # lets libjpeg skip the chroma planes
+    img = img.convert("L")
+    return b"P5\n%d %d\n255\n" % img.size + img.tobytes()
+
+
+@app.get("/latest.pgm")
+async def latest_gray():
+    global gray_cache, gray_cache_ts
+    async with frame_lock:
+        if latest_jpeg is None:
+            raise HTTPException(status_code=404, detail="no frame yet")
+        data = latest_jpeg
+        ts = latest_ts
+        meta = latest_meta
+
+    if ts == gray_cache_ts and gray_cache is not None:
+        pgm = gray_cache
+    else:
+        pgm = await asyncio.to_thread(jpeg_to_pgm, data)
+        if ts > gray_cache_ts:
+            gray_cache, gray_cache_ts = pgm, ts
+
+    return Response(
+        content=pgm,
+        media_type="image/x-portable-graymap",
+        headers=frame_headers(ts, meta),
+    )
+
+
 @app.get("/stream.mjpeg")
 async def stream():
     boundary = "frame"
@@ -86,16 +206,20 @@ async def stream():
                     continue
                 ts = latest_ts
                 jpg = latest_jpeg
+                meta = latest_meta
 
             # avoid spamming duplicate frames if no new ones arrived
             if ts == last_sent:
                 continue
             last_sent = ts
 
+            # Same X-Timestamp part header as CameraWebServer's /stream
+            timing = f"X-Timestamp: {meta['capture_ts']:.6f}\r\nX-Frame-Seq: {meta['seq']}\r\n" if meta else ""
             chunk = (
                 f"--{boundary}\r\n"
                 "Content-Type: image/jpeg\r\n"
                 f"Content-Length: {len(jpg)}\r\n"
+                f"{timing}"
                 "\r\n"
             ).encode("utf-8") + jpg + b"\r\n"
 
@@ -0,0 +1,118 @@
+"""Latency benchmark: watches /ws/view?meta=1 and reports per-stage latency
+percentiles and dropped frames.
+
+    python bench.py ws://128.140.71.111/ws/view?meta=1 --seconds 30
+
+Device stages come from the timing header the ESP32 puts in front of every
+upload (FrameTimingHeader in frame_pipeline.h); server.py adds net_ms and
+relay_ms. viewer_ms and total_ms compare this machine's clock with the
+relay's, so run it on the relay host or keep both NTP-synced.
+
+Needs the `websockets` package (installed with uvicorn[standard]).
+"""
+import argparse
+import asyncio
+import json
+import time
+
+import websockets
+
+STAGES = [
+    ("capture_ms", "sensor -> fb_get"),
+    ("encode_queue_ms", "wait for encoder"),
+    ("encode_ms", "encode"),
+    ("send_queue_ms", "wait for network"),
+    ("send_ms", "device send"),
+    ("net_ms", "network (over best)"),
+    ("relay_ms", "relay"),
+    ("viewer_ms", "relay -> viewer"),
+    ("total_ms", "capture -> viewer"),
+]
+
+
+def percentile(values, p):
+    values = sorted(values)
+    return values[min(len(values) - 1, int(round(p / 100.0 * (len(values) - 1))))]
+
+
+async def collect(url: str, seconds: float):
+    samples = {key: [] for key, _ in STAGES}
+    frames = 0
+    gaps = 0
+    restarts = 0
+    first = last = None
+    meta = None
+    end = time.time() + seconds
+
+    async with websockets.connect(url, max_size=None) as ws:
+        while True:
+            remaining = end - time.time()
+            if remaining <= 0:
+                break
+            try:
+                msg = await asyncio.wait_for(ws.recv(), timeout=remaining)
+            except asyncio.TimeoutError:
+                break
+            now = time.time()
+
+            if isinstance(msg, str):
+                meta = json.loads(msg)  # timings for the next binary frame
+                continue
+            if meta is None:
+                continue  # upload without a timing header
+
+            meta["viewer_ms"] = (now - meta["published"]) * 1000
+            meta["total_ms"] = (now - meta["capture_ts"]) * 1000
+            for key, _ in STAGES:
+                samples[key].append(meta[key])
+
+            if last is not None and meta["seq"] < last["seq"]:
+                # Device restarted: its counters start over, so drop
+                # statistics only cover the segment since the restart
+                first = None
+                gaps = 0
+                restarts += 1
+            elif last is not None:
+                gaps += meta["seq"] - last["seq"] - 1
+            if first is None:
+                first = meta
+            last = meta
+            frames += 1
+            meta = None
+
+    return samples, frames, gaps, restarts, first, last
+
+
+def report(samples, frames, gaps, restarts, first, last, seconds):
+    if not frames:
+        print("no frames with timing metadata (is the device sending FTS1 headers?)")
+        return
+
+    print(f"{frames} frames in {seconds:.0f} s ({frames / seconds:.1f} fps)\n")
+    print(f"{'stage':<22}{'p50':>9}{'p90':>9}{'p99':>9}{'max':>9}   ms")
+    for key, label in STAGES:
+        values = samples[key]
+        print(f"{label:<22}" + "".join(f"{percentile(values, p):9.1f}" for p in (50, 90, 99)) + f"{max(values):9.1f}")
+
+    lost_device = last["device_missing"] - first["device_missing"]
+    lost_relay = last["relay_dropped"] - first["relay_dropped"]
+    print(f"\ndropped frames: {gaps} of {last['seq'] - first['seq'] + 1}")
+    if restarts:
+        print(f"  (device restarted {restarts}x; counting since the last restart)")
+    print(f"  before the relay (device queues, failed sends): {lost_device}")
+    print(f"  relay -> this viewer (slow viewer skipped):     {lost_relay}")
+    print(f"  not republished (e.g. unchanged tile frames):   {max(0, gaps - lost_device - lost_relay)}")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("url", help="e.g. ws://host/ws/view?meta=1")
+    parser.add_argument("--seconds", type=float, default=30.0)
+    args = parser.parse_args()
+
+    url = args.url if "meta=1" in args.url else args.url + ("&" if "?" in args.url else "?") + "meta=1"
+    report(*asyncio.run(collect(url, args.seconds)), args.seconds)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,78 @@
+#ifndef RATE_CONTROL_H
+#define RATE_CONTROL_H
+
+//
+// Closed-loop JPEG rate control for streaming.
+//
+// Fed with the measured encode time, send time, encoded size and frame
+// period of every frame, it steps JPEG quality first and frame size second
+// to hit a target FPS (and optionally a bitrate cap): down quickly when the
+// link can't keep up, back up slowly when there is headroom. Frames arriving
+// faster than the target are skipped rather than sent.
+//
+// Quality uses the fmt2jpg()/frame2jpg() scale (1..100, higher is better);
+// sensorQuality() maps it to the sensor's JPEG scale for PIXFORMAT_JPEG.
+//
+// Copied into several sketches; keep the copies identical with
+// ../check_shared.py.
+//
+
+#include "esp_camera.h"
+
+struct RateControlConfig {
+  float targetFps;
+  uint32_t targetKbps;     // 0 = no bitrate cap
+  int minQuality;
+  int maxQuality;
+  framesize_t minSize;     // sizes step along QQVGA..UXGA (see .cpp)
+  framesize_t maxSize;     // raw formats: no larger than the init size
+  bool pipelined;          // encode and send overlap (frame_pipeline)
+};
+
+class RateController {
+public:
+  RateController();
+
+  void begin(const RateControlConfig& cfg, framesize_t size, int quality);
+
+  // Frame pacing: true if a frame captured at `nowUs` should be dropped
+  bool shouldSkip(int64_t nowUs);
+
+  void noteEncode(uint32_t encodeMs);
+  // One frame went out. avgFrameMs = averaged frame period (e.g. ra_filter),
+  // or 0 to use the controller's own measurement.
+  void update(uint32_t sendMs, size_t bytes, uint32_t avgFrameMs = 0);
+
+  int quality() const { return quality_; }
+  int sensorQuality() const;
+  static int qualityFromSensor(int sensorQuality);
+  framesize_t frameSize() const { return size_; }
+  // True once after a frame size change; the caller applies it to the sensor
+  bool takeSizeChange(framesize_t* size);
+
+  uint32_t kbps() const { return kbps_; }
+  uint32_t skipped() const { return skipped_; }
+
+private:
+  void stepDown();
+  void stepUp();
+
+  RateControlConfig cfg_;
+  volatile int quality_;
+  volatile framesize_t size_;
+  int sizeIdx_;
+  int minIdx_;
+  int maxIdx_;
+  volatile bool sizeChanged_;
+  float encodeMs_;         // moving averages
+  float sendMs_;
+  float bytes_;
+  float frameMs_;
+  uint32_t kbps_;
+  int64_t lastUpdateUs_;
+  int64_t nextDueUs_;
+  uint32_t framesSinceChange_;
+  uint32_t skipped_;
+};
+
+#endif  // RATE_CONTROL_H
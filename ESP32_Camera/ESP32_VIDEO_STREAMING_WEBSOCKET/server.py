@@ -1,6 +1,10 @@
 import asyncio
 import time
 from typing import Optional, Set
+import io
+import json
+import struct
+from PIL import Image
 
 from fastapi import FastAPI, WebSocket, WebSocketDisconnect, HTTPException
 from fastapi.responses import Response, StreamingResponse
@@ -9,34 +13,163 @@ app = FastAPI()
 
 UPLOAD_TOKEN = "change-me"
 
+# Only ever replaced as a whole (no await in between), so readers on the
+# event loop never see a torn pair and every consumer shares the same bytes
 latest_jpeg: Optional[bytes] = None
 latest_ts: float = 0.0
-
-frame_lock = asyncio.Lock()
-frame_event = asyncio.Event()
-
-# Optional: WS viewers that want frames too
-viewers: Set[WebSocket] = set()
-viewers_lock = asyncio.Lock()
+latest_meta: Optional[dict] = None
+
+
+class FrameMailbox:
+    """Latest-frame slot for one viewer (/stream.mjpeg or /ws/view).
+
+    Publishing never waits on a viewer: a new frame replaces one the viewer
+    hasn't taken yet, so a slow viewer skips frames instead of stalling
+    ingest or the other viewers.
+    """
+
+    def __init__(self):
+        self.frame: Optional[tuple] = None  # (jpeg, timing metadata or None)
+        self.ready = asyncio.Event()
+        self.dropped = 0
+
+    def put(self, jpg: bytes, meta: Optional[dict] = None):
+        if self.frame is not None:
+            self.dropped += 1
+        self.frame = (jpg, meta)
+        self.ready.set()
+
+    async def get(self) -> tuple:
+        await self.ready.wait()
+        self.ready.clear()
+        frame, self.frame = self.frame, None
+        return frame
+
+
+mailboxes: Set[FrameMailbox] = set()
+
+
+def publish_frame(jpg: bytes, ts: float, meta: Optional[dict] = None):
+    """`ts` is when the upload arrived."""
+    global latest_jpeg, latest_ts, latest_meta
+    if meta is not None:
+        meta["published"] = time.time()
+        meta["relay_ms"] = round((meta["published"] - ts) * 1000, 2)
+    latest_jpeg, latest_ts, latest_meta = jpg, ts, meta
+    for box in mailboxes:
+        box.put(jpg, meta)
+
+
+# Per-frame device timings (FrameTimingHeader in frame_pipeline.h)
+TIMING_MAGIC = b"FTS1"
+TIMING_HEADER = struct.Struct("<4sIQIIIIII")
+
+
+class LatencyTracker:
+    """Turns the device's frame timings into per-stage latencies.
+
+    The ESP32 only knows time since boot, so its clock is mapped onto ours
+    using the fastest upload seen so far. net_ms is how much longer a frame
+    took than that one, and capture_ts is a lower bound (off by the
+    best-case network delay).
+    """
+
+    def __init__(self):
+        self.offset_us: Optional[int] = None
+        self.last_seq: Optional[int] = None
+        self.missing = 0
+
+    def frame_meta(self, header: bytes, recv: float) -> dict:
+        (_, seq, capture_us, grab, encode_start, encode, send_start,
+         last_send, last_send_seq) = TIMING_HEADER.unpack_from(header)
+        if self.last_seq is None or seq <= self.last_seq:
+            self.offset_us = None  # first frame, or the device restarted
+        elif seq > self.last_seq + 1:
+            self.missing += seq - self.last_seq - 1
+        self.last_seq = seq
+
+        transit_us = int(recv * 1e6) - (capture_us + send_start)
+        if self.offset_us is None or transit_us < self.offset_us:
+            self.offset_us = transit_us
+
+        def ms(us):
+            return round(us / 1000.0, 2)
+
+        return {
+            "seq": seq,
+            "capture_ts": (capture_us + self.offset_us) / 1e6,
+            "capture_ms": ms(grab),
+            "encode_queue_ms": ms(encode_start - grab),
+            "encode_ms": ms(encode),
+            "send_queue_ms": ms(send_start - encode_start - encode),
+            "send_ms": ms(last_send),  # previous frame (last_send_seq)
+            "send_seq": last_send_seq,
+            "net_ms": ms(transit_us - self.offset_us),
+            "device_missing": self.missing,
+        }
+
+
+def frame_headers(ts: float, meta: Optional[dict]) -> dict:
+    """X-Frame-* response headers: capture time when the device sent timings."""
+    if meta is None:
+        return {"Cache-Control": "no-store", "X-Frame-Timestamp": str(ts)}
+    return {
+        "Cache-Control": "no-store",
+        "X-Frame-Timestamp": str(meta["capture_ts"]),
+        "X-Frame-Seq": str(meta["seq"]),
+        "X-Frame-Timing": json.dumps(meta, separators=(",", ":")),
+    }
 
 
 @app.get("/health")
 def health():
-    return {"ok": True, "has_frame": latest_jpeg is not None, "ts": latest_ts}
+    return {"ok": True, "has_frame": latest_jpeg is not None, "ts": latest_ts, "viewers": len(mailboxes)}
 
 
 @app.get("/latest.jpg")
 async def latest():
-    async with frame_lock:
-        if latest_jpeg is None:
-            raise HTTPException(status_code=404, detail="no frame yet")
-        data = latest_jpeg
-        ts = latest_ts
+    if latest_jpeg is None:
+        raise HTTPException(status_code=404, detail="no frame yet")
+    data, ts, meta = latest_jpeg, latest_ts, latest_meta
 
     return Response(
         content=data,
         media_type="image/jpeg",
-        headers={"Cache-Control": "no-store", "X-Frame-Timestamp": str(ts)},
+        headers=frame_headers(ts, meta),
+    )
+
+
+# Grayscale for clients that want pixels: decoded here from the latest JPEG
+# on request, instead of the ESP32 encoding or sending raw frames
+gray_cache: Optional[bytes] = None
+gray_cache_ts: float = 0.0
+
+
+def jpeg_to_pgm(jpg: bytes) -> bytes:
+    img = Image.open(io.BytesIO(jpg))
+    img.draft("L", img.size)  # lets libjpeg skip the chroma planes
+    img = img.convert("L")
+    return b"P5\n%d %d\n255\n" % img.size + img.tobytes()
+
+
+@app.get("/latest.pgm")
+async def latest_gray():
+    global gray_cache, gray_cache_ts
+    if latest_jpeg is None:
+        raise HTTPException(status_code=404, detail="no frame yet")
+    data, ts, meta = latest_jpeg, latest_ts, latest_meta
+
+    if ts == gray_cache_ts and gray_cache is not None:
+        pgm = gray_cache
+    else:
+        pgm = await asyncio.to_thread(jpeg_to_pgm, data)
+        if ts > gray_cache_ts:
+            gray_cache, gray_cache_ts = pgm, ts
+
+    return Response(
+        content=pgm,
+        media_type="image/x-portable-graymap",
+        headers=frame_headers(ts, meta),
     )
 
 
@@ -45,29 +178,28 @@ async def stream():
     boundary = "frame"
 
     async def gen():
-        last_sent = 0.0
-        while True:
-            try:
-                await asyncio.wait_for(frame_event.wait(), timeout=10.0)
-            except asyncio.TimeoutError:
-                continue
-
-            async with frame_lock:
-                if latest_jpeg is None:
-                    continue
-                ts = latest_ts
-                jpg = latest_jpeg
-
-            if ts == last_sent:
-                continue
-            last_sent = ts
-
-            yield (
-                f"--{boundary}\r\n"
-                "Content-Type: image/jpeg\r\n"
-                f"Content-Length: {len(jpg)}\r\n"
-                "\r\n"
-            ).encode("utf-8") + jpg + b"\r\n"
+        box = FrameMailbox()
+        if latest_jpeg is not None:
+            box.put(latest_jpeg, latest_meta)
+        mailboxes.add(box)
+        try:
+            while True:
+                jpg, meta = await box.get()
+                # Same X-Timestamp part header as CameraWebServer's /stream
+                timing = f"X-Timestamp: {meta['capture_ts']:.6f}\r\nX-Frame-Seq: {meta['seq']}\r\n" if meta else ""
+                # Header and frame go out as separate chunks so the JPEG
+                # isn't copied per viewer
+                yield (
+                    f"--{boundary}\r\n"
+                    "Content-Type: image/jpeg\r\n"
+                    f"Content-Length: {len(jpg)}\r\n"
+                    f"{timing}"
+                    "\r\n"
+                ).encode("utf-8")
+                yield jpg
+                yield b"\r\n"
+        finally:
+            mailboxes.discard(box)
 
     return StreamingResponse(
         gen(),
@@ -89,6 +221,7 @@ async def ws_upload(ws: WebSocket):
 
     last_log = 0.0
     frames = 0
+    timing = LatencyTracker()
 
     try:
         while True:
@@ -98,23 +231,14 @@ async def ws_upload(ws: WebSocket):
                 jpg = msg["bytes"]
                 now = time.time()
 
-                async with frame_lock:
-                    global latest_jpeg, latest_ts
-                    latest_jpeg = jpg
-                    latest_ts = now
-                    frame_event.set()
-                    frame_event.clear()
-
-                # Optional: broadcast to WS viewers (if any)
-                async with viewers_lock:
-                    dead = []
-                    for v in viewers:
-                        try:
-                            await v.send_bytes(jpg)
-                        except Exception:
-                            dead.append(v)
-                    for v in dead:
-                        viewers.discard(v)
+                meta = None
+                if jpg[:4] == TIMING_MAGIC and len(jpg) >= TIMING_HEADER.size:
+                    meta = timing.frame_meta(jpg, now)
+                    jpg = jpg[TIMING_HEADER.size:]
+
+                # /stream.mjpeg and WS viewers each take it from their own
+                # mailbox, so ingest never waits on a viewer
+                publish_frame(jpg, now, meta)
 
                 # lightweight FPS log once per second
                 frames += 1
@@ -137,11 +261,26 @@ async def ws_upload(ws: WebSocket):
             pass
 
 
+async def send_frames(ws: WebSocket, box: FrameMailbox, with_meta: bool):
+    try:
+        while True:
+            jpg, meta = await box.get()
+            if with_meta and meta is not None:
+                # Timings for the binary frame that follows (bench.py)
+                await ws.send_text(json.dumps({**meta, "relay_dropped": box.dropped}))
+            await ws.send_bytes(jpg)
+    except Exception:
+        pass  # the receive loop sees the disconnect
+
+
 @app.websocket("/ws/view")
 async def ws_view(ws: WebSocket):
     await ws.accept()
-    async with viewers_lock:
-        viewers.add(ws)
+    box = FrameMailbox()
+    mailboxes.add(box)
+    # /ws/view?meta=1: a JSON text message with the frame's timings before each frame
+    with_meta = ws.query_params.get("meta") == "1"
+    sender = asyncio.create_task(send_frames(ws, box, with_meta))
     print("[WS-VIEW] connected")
 
     try:
@@ -151,6 +290,6 @@ async def ws_view(ws: WebSocket):
     except Exception:
         pass
     finally:
-        async with viewers_lock:
-            viewers.discard(ws)
-        print("[WS-VIEW] disconnected")
+        mailboxes.discard(box)
+        sender.cancel()
+        print(f"[WS-VIEW] disconnected, skipped {box.dropped} frames")
@@ -4,6 +4,10 @@
 #include "img_converters.h"
 // Camera model pins etc.
 #include "board_config.h"
+#include "frame_pipeline.h"
+#include "tile_delta.h"
+#include "preprocess.h"
+#include "motion_detect.h"
 
 // WiFi
 const char* ssid     = "DIGI-Gua4";
@@ -22,10 +26,57 @@ static const bool USE_HTTPS_INSECURE_FOR_NOW = true; // TODO: remove later
 static const int W = 640;
 static const int H = 480;
 
+// 1 = sensor JPEG: the OV2640 compresses in hardware, fb->buf goes out as one
+// binary message and server.py keeps it without re-encoding (grayscale is
+// decoded server-side). Tile deltas and preprocessing are raw-mode (0) only.
+#define SENSOR_JPEG 0
+
+// Motion gating (raw mode): frames only go out while something moves, and
+// for MOTION_HOLD_MS after. While idle, a "motion idle ..." text event is
+// sent every MOTION_EVENT_MS instead, plus a frame every IDLE_FRAME_MS if
+// set. The first frame after every (re)connect always goes out, so a new
+// viewer never starts on a blank stream. "motion gate=0|1 threshold=N" from
+// the server changes it at runtime.
+#define MOTION_GATE 1
+static const uint16_t MOTION_THRESHOLD_PERMILLE = 5;
+static const uint32_t MOTION_HOLD_MS = 2000;
+static const uint32_t MOTION_EVENT_MS = 1000;
+static const uint32_t IDLE_FRAME_MS = 0;   // 0 = no frames while idle
+
 
 #include <WebSocketsClient.h>
 
-WebSocketsClient ws;
+// sendBIN() only sends whole messages. Exposing the library's frame writer
+// lets a keyframe go out as fragments of one message: the header first,
+// then continuation frames read straight from the camera framebuffer.
+// Large payloads are written to the socket as-is (zero mask key), so
+// nothing is copied or modified.
+class FragmentWebSocketsClient : public WebSocketsClient {
+public:
+  bool sendFragment(WSopcode_t opcode, const uint8_t* data, size_t len, bool fin) {
+    return sendFrame(&_client, opcode, (uint8_t*)data, len, fin, false);
+  }
+};
+
+FragmentWebSocketsClient ws;
+TileDeltaEncoder tileEncoder;
+MotionDetector motion;
+
+// Written by the encode task (skip hook), read by the network task
+static portMUX_TYPE motionMux = portMUX_INITIALIZER_UNLOCKED;
+static MotionResult motionLast = {false, 0, 0};
+static bool motionActive = true;
+static volatile bool motionGate = MOTION_GATE;
+
+// Set from the network task (connect, control messages), read by the
+// encode task. The detector itself is only touched by the encode task.
+static volatile uint16_t motionThreshold = MOTION_THRESHOLD_PERMILLE;
+static volatile bool motionSendNext = true;  // a new session always gets a frame
+static PreprocessConfig preprocessCfg = defaultPreprocess();
+static portMUX_TYPE preprocessMux = portMUX_INITIALIZER_UNLOCKED;
+
+// Bytes of fb->buf per continuation frame
+static const size_t WS_FRAGMENT_BYTES = 32 * 1024;
 
 const char* ws_host = "128.140.71.111";  // or domain
 const uint16_t ws_port = 80;
@@ -33,16 +84,55 @@ const char* ws_path = "/ws/upload?token=change-me";
 
 static bool wsConnected = false;
 
+// "motion gate=0|1 threshold=N" (per mille of sampled words)
+static void parseMotionCommand(const char* text, size_t len) {
+  char buf[64];
+  if (len >= sizeof(buf)) return;
+  memcpy(buf, text, len);
+  buf[len] = 0;
+  for (char* tok = strtok(buf + 7, " "); tok; tok = strtok(nullptr, " ")) {
+    unsigned v;
+    if (sscanf(tok, "gate=%u", &v) == 1) {
+      motionGate = v != 0;
+    } else if (sscanf(tok, "threshold=%u", &v) == 1) {
+      motionThreshold = v > 1000 ? 1000 : v;
+    }
+  }
+  Serial.printf("[WS] motion gate=%d\n", (int)motionGate);
+}
+
 void wsEvent(WStype_t type, uint8_t * payload, size_t length) {
   switch(type) {
     case WStype_CONNECTED:
       wsConnected = true;
+      tileEncoder.forceKeyframe();  // new server session has no reference frame
+      motionSendNext = true;        // ...and viewers need a picture even if idle
       Serial.println("[WS] connected");
       break;
     case WStype_DISCONNECTED:
       wsConnected = false;
       Serial.println("[WS] disconnected");
       break;
+    case WStype_TEXT: {
+      // Server lost track of the tiles (e.g. it restarted the decoder)
+      if (length == 8 && memcmp(payload, "keyframe", 8) == 0) {
+        tileEncoder.forceKeyframe();
+        break;
+      }
+      if (length > 7 && memcmp(payload, "motion ", 7) == 0) {
+        parseMotionCommand((const char*)payload, length);
+        break;
+      }
+      PreprocessConfig cfg;
+      if (parsePreprocessCommand((const char*)payload, length, &cfg)) {
+        portENTER_CRITICAL(&preprocessMux);
+        preprocessCfg = cfg;
+        portEXIT_CRITICAL(&preprocessMux);
+        Serial.printf("[WS] preprocess scale=%u roi=%u,%u,%u,%u stretch=%d\n", cfg.scale,
+                      cfg.roiX, cfg.roiY, cfg.roiW, cfg.roiH, cfg.stretch);
+      }
+      break;
+    }
     case WStype_ERROR:
       Serial.println("[WS] error");
       break;
@@ -60,57 +150,170 @@ void setupWebSocket() {
 
 #include "img_converters.h"
 
-bool sendFrameWS(uint8_t* gray, size_t len) {
-  Serial.println("[WS] enter");
+// Sends `head` then `len` bytes of `data` as one fragmented binary message
+static bool sendFragmented(const uint8_t* head, size_t headLen, const uint8_t* data, size_t len) {
+  bool sent = ws.sendFragment(WSop_binary, head, headLen, len == 0);
+  size_t off = 0;
+  while (sent && off < len) {
+    size_t n = len - off;
+    if (n > WS_FRAGMENT_BYTES) n = WS_FRAGMENT_BYTES;
+    sent = ws.sendFragment(WSop_continuation, data + off, n, off + n == len);
+    off += n;
+  }
+  return sent;
+}
 
+// Every message starts with the frame's FrameTimingHeader; server.py strips
+// it before looking at the tile header or JPEG
+bool sendFrameWS(const FrameTimingHeader& timing, uint8_t* gray, size_t len, uint16_t width, uint16_t height) {
   if (!wsConnected) {
-    Serial.println("[WS] not connected");
     return false;
   }
 
-  Serial.printf("[WS] gray=%p len=%u expected=%u\n",
-                gray, (unsigned)len, (unsigned)(W * H));
-
-  if (!gray) {
-    Serial.println("[WS] gray NULL");
+  if (!gray || len != (size_t)width * height || !tileEncoder.setFrameSize(width, height)) {
+    Serial.printf("[WS] bad frame len=%u (%ux%u)\n", (unsigned)len, width, height);
     return false;
   }
 
-  if (len != (size_t)(W * H)) {
-    Serial.println("[WS] size mismatch");
-    return false;
+  const uint8_t* delta = nullptr;
+  size_t deltaLen = 0;
+  bool sent;
+  if (tileEncoder.encodeDelta(gray, &delta, &deltaLen)) {
+    // Changed tiles only, already packed into the encoder's buffer
+    sent = sendFragmented((const uint8_t*)&timing, sizeof(timing), delta, deltaLen);
+  } else {
+    // Keyframe: header fragment, then the pixels in place
+    uint8_t head[sizeof(FrameTimingHeader) + sizeof(TileDeltaHeader)];
+    TileDeltaHeader header = tileEncoder.keyframeHeader();
+    memcpy(head, &timing, sizeof(timing));
+    memcpy(head + sizeof(timing), &header, sizeof(header));
+    sent = sendFragmented(head, sizeof(head), gray, len);
+    if (sent) tileEncoder.keyframeSent(gray);
   }
 
-  const size_t header_len = 8;
-  const size_t total_len = header_len + len;
-
-  uint8_t* buf = (uint8_t*)malloc(total_len);
-  if (!buf) {
-    Serial.println("[WS] malloc FAIL");
-    return false;
+  if (!sent) {
+    // A half-sent message can't be resumed; start over on a fresh socket,
+    // and the server's copy of the frame is stale until the next keyframe
+    tileEncoder.forceKeyframe();
+    ws.disconnect();
   }
 
-  Serial.printf("[WS] heap before send=%u\n", ESP.getFreeHeap());
-
-  uint32_t w = W;
-  uint32_t h = H;
-
-  memcpy(buf + 0, &w, 4);
-  memcpy(buf + 4, &h, 4);
-  memcpy(buf + 8, gray, len);
+  return sent;
+}
 
-  Serial.printf("[WS] sending RAW %u bytes\n", (unsigned)total_len);
+// Network stage: raw frames pass straight from the capture stage (no
+// encoder), so the framebuffer is held until it has been sent. Tile deltas
+// are computed here rather than in the encode stage because the reference
+// must only advance for frames that actually reach the server (the encode
+// -> send queue may drop frames).
+bool sendRawFrame(const PipelineFrame& frame) {
+  FrameTimingHeader timing;
+  fillFrameTiming(frame, &timing);
+  return sendFrameWS(timing, frame.data, frame.len, frame.width, frame.height);
+}
 
-  bool sent = ws.sendBIN(buf, total_len);
+// Network stage in SENSOR_JPEG mode: the sensor's JPEG, straight from fb->buf
+bool sendJpegFrame(const PipelineFrame& frame) {
+  if (!wsConnected) {
+    return false;
+  }
+  FrameTimingHeader timing;
+  fillFrameTiming(frame, &timing);
+  bool sent = sendFragmented((const uint8_t*)&timing, sizeof(timing), frame.data, frame.len);
+  if (!sent) ws.disconnect();
+  return sent;
+}
 
-  Serial.printf("[WS] sendBIN=%d\n", sent);
+// Encode stage: crop/downscale/stretch as requested by the server. The
+// default full frame passes through untouched (no copy); otherwise the
+// smaller image is built in PSRAM and the framebuffer goes straight back.
+bool preprocessGray(camera_fb_t* fb, PipelineFrame* out) {
+  portENTER_CRITICAL(&preprocessMux);
+  PreprocessConfig cfg = preprocessCfg;
+  portEXIT_CRITICAL(&preprocessMux);
+  if (isPassthrough(cfg, fb->width, fb->height)) return true;
+
+  uint16_t outW, outH;
+  resolvePreprocess(&cfg, fb->width, fb->height, &outW, &outH);
+  size_t n = (size_t)outW * outH;
+  uint8_t* buf = (uint8_t*)(psramFound() ? ps_malloc(n) : malloc(n));
+  if (!buf) return false;
+
+  preprocessFrame(fb->buf, fb->width, cfg, buf, outW, outH);
+  esp_camera_fb_return(fb);
+  out->fb = nullptr;
+  out->data = buf;
+  out->len = n;
+  out->ownsData = true;
+  out->width = outW;
+  out->height = outH;
+  return true;
+}
 
-  free(buf);
+// Encode-stage skip hook: runs the motion detector on every raw frame and
+// drops frames while nothing moves
+bool skipWithoutMotion(camera_fb_t* fb) {
+  if (fb->format != PIXFORMAT_GRAYSCALE) return false;
+
+  static uint32_t lastMotionMs = 0;
+  static uint32_t lastIdleFrameMs = 0;
+  uint32_t now = millis();
+  motion.setThreshold(motionThreshold);
+  MotionResult r = motion.update(fb->buf, fb->width, fb->height);
+  if (r.motion) lastMotionMs = now;
+
+  portENTER_CRITICAL(&motionMux);
+  bool active = r.motion || (motionActive && now - lastMotionMs < MOTION_HOLD_MS);
+  motionActive = active;
+  motionLast = r;
+  portEXIT_CRITICAL(&motionMux);
+
+  if (active || !motionGate) return false;
+  if (motionSendNext) {
+    motionSendNext = false;
+    lastIdleFrameMs = now;
+    return false;
+  }
+  if (IDLE_FRAME_MS && now - lastIdleFrameMs >= IDLE_FRAME_MS) {
+    lastIdleFrameMs = now;
+    return false;
+  }
+  return true;
+}
 
-  Serial.printf("[WS] heap after free=%u\n", ESP.getFreeHeap());
-  Serial.println("[WS] exit");
+// "motion start|stop" on every change, "motion idle" every MOTION_EVENT_MS
+// while no frames are going out
+static void sendMotionEvents() {
+  static bool wasActive = true;
+  static uint32_t lastEventMs = 0;
+  if (!wsConnected) return;
+
+  portENTER_CRITICAL(&motionMux);
+  bool active = motionActive;
+  MotionResult r = motionLast;
+  portEXIT_CRITICAL(&motionMux);
+
+  uint32_t now = millis();
+  const char* state;
+  if (active != wasActive) {
+    state = active ? "start" : "stop";
+  } else if (!active && now - lastEventMs >= MOTION_EVENT_MS) {
+    state = "idle";
+  } else {
+    return;
+  }
+  char msg[64];
+  snprintf(msg, sizeof(msg), "motion %s changed=%u diff=%u", state, r.changedPermille, r.meanDiff);
+  if (ws.sendTXT(msg)) {
+    wasActive = active;
+    lastEventMs = now;
+  }
+}
 
-  return sent;
+// The WebSocket client is only ever touched from the network task
+void pollWebSocket() {
+  ws.loop();
+  sendMotionEvents();
 }
 
 
@@ -244,12 +447,17 @@ void initCamera() {
   config.xclk_freq_hz = 20000000;
 
   // For pushing frames, use JPEG directly
+#if SENSOR_JPEG
+  config.pixel_format = PIXFORMAT_JPEG;
+#else
   config.pixel_format = PIXFORMAT_GRAYSCALE;
+#endif
 
   // Pick a sane default; you can raise later.
   config.frame_size   = FRAMESIZE_VGA;   // 640x480
   config.jpeg_quality = 12;              // 0(best)-63(worst), typical 10-15
-  config.fb_count     = psramFound() ? 2 : 1;
+  // One extra buffer: frames stay out of the driver until they are sent
+  config.fb_count     = psramFound() ? PIPELINE_FB_COUNT + 1 : 1;
 
   config.grab_mode    = psramFound() ? CAMERA_GRAB_LATEST : CAMERA_GRAB_WHEN_EMPTY;
   config.fb_location  = psramFound() ? CAMERA_FB_IN_PSRAM : CAMERA_FB_IN_DRAM;
@@ -264,6 +472,9 @@ void initCamera() {
   sensor_t* s = esp_camera_sensor_get();
   Serial.printf("PID: 0x%04x\n", s->id.PID);
   s->set_framesize(s, config.frame_size);
+#if SENSOR_JPEG
+  s->set_special_effect(s, 2);  // grayscale, like the raw path; drop for color
+#endif
   // s->set_vflip(s, 1);
   // s->set_hmirror(s, 1);
   // s->set_brightness(s, 1);
@@ -277,42 +488,29 @@ void setup() {
   connectWiFi();
   setupWebSocket();
 
+#if !SENSOR_JPEG
+  if (!tileEncoder.begin(W, H) || !motion.begin(W, H, MOTION_THRESHOLD_PERMILLE)) {
+    Serial.println("Tile encoder / motion detector alloc FAILED");
+    ESP.restart();
+  }
+#endif
+
   Serial.print("WiFi OK, IP: ");
   Serial.println(WiFi.localIP());
-}
-
-// void loop() {
-//   camera_fb_t* fb = esp_camera_fb_get();
-//   if (!fb) { delay(10); return; }
 
-//   // fb->buf is raw grayscale bytes
-//   bool ok = sendFrameAsJpegFromGray(fb->buf, fb->len);
-
-//   esp_camera_fb_return(fb);
+  // Capture, preprocessing and WebSocket send run as separate tasks
+#if SENSOR_JPEG
+  FramePipelineConfig pipeline = {nullptr, sendJpegFrame, pollWebSocket, nullptr};
+#else
+  FramePipelineConfig pipeline = {preprocessGray, sendRawFrame, pollWebSocket, skipWithoutMotion};
+#endif
+  if (!startFramePipeline(pipeline)) {
+    Serial.println("Pipeline start FAILED");
+    ESP.restart();
+  }
+}
 
-//   if (!ok) {
-//     Serial.printf("Failed sending");
-//     delay(200);
-//     }
-//     Serial.printf("Sent");
-//   delay(1);
-// }
 void loop() {
-  ws.loop();
-  if (!wsConnected) { delay(10); return; }
-  camera_fb_t* fb = esp_camera_fb_get();
-  if (!fb) { delay(10); return; }
-
-  // fb->buf is raw grayscale bytes
-  bool ok = sendFrameWS(fb->buf, fb->len);
-
-  esp_camera_fb_return(fb);
-
-  if (!ok) {
-    Serial.printf("Failed sending");
-    delay(200);
-    }
-    Serial.printf("Sent");
-  delay(1);
+  logFramePipelineStats();
+  delay(100);
 }
-
@@ -0,0 +1,164 @@
+#include "frame_pipeline.h"
+#include <Arduino.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+#include <string.h>
+
+// The camera driver and WiFi stack live on core 0, so capture and network
+// share it; the CPU-heavy encoder gets core 1 (next to the idle Arduino loop).
+static const BaseType_t CAPTURE_CORE = 0;
+static const BaseType_t ENCODE_CORE  = 1;
+static const BaseType_t NETWORK_CORE = 0;
+static const UBaseType_t CAPTURE_PRIO = 3;
+static const UBaseType_t ENCODE_PRIO  = 2;
+static const UBaseType_t NETWORK_PRIO = 2;
+static const uint32_t CAPTURE_STACK = 4096;
+static const uint32_t ENCODE_STACK  = 8192;
+static const uint32_t NETWORK_STACK = 8192;
+
+static const TickType_t NETWORK_POLL_TICKS = pdMS_TO_TICKS(10);
+static const TickType_t SEND_FAIL_BACKOFF  = pdMS_TO_TICKS(200);
+
+static FramePipelineConfig cfg;
+static QueueHandle_t captureQueue = nullptr; // capture -> encode
+static QueueHandle_t sendQueue    = nullptr; // encode -> network
+
+static volatile uint32_t statCaptured = 0;
+static volatile uint32_t statEncoded  = 0;
+static volatile uint32_t statSent     = 0;
+static volatile uint32_t statDropped  = 0;
+static volatile uint32_t statFailed   = 0;
+static volatile uint32_t statSkipped  = 0;
+
+// Encode task only
+static uint32_t nextSeq = 0;
+// Network task only
+static uint32_t lastSendUs = 0;
+static uint32_t lastSendSeq = 0;
+
+static void releaseFrame(PipelineFrame& f) {
+  if (f.fb) esp_camera_fb_return(f.fb);
+  if (f.ownsData && f.data) free(f.data);
+  f.fb = nullptr;
+  f.data = nullptr;
+  f.ownsData = false;
+}
+
+// Latest-wins enqueue: if the slot is taken, the older frame is dropped
+static void pushLatest(QueueHandle_t q, PipelineFrame& f) {
+  while (xQueueSend(q, &f, 0) != pdTRUE) {
+    PipelineFrame old;
+    if (xQueueReceive(q, &old, 0) == pdTRUE) {
+      releaseFrame(old);
+      statDropped++;
+    }
+  }
+}
+
+static void captureTask(void*) {
+  for (;;) {
+    camera_fb_t* fb = esp_camera_fb_get();
+    if (!fb) {
+      vTaskDelay(pdMS_TO_TICKS(10));
+      continue;
+    }
+    int64_t captureUs = (int64_t)fb->timestamp.tv_sec * 1000000 + fb->timestamp.tv_usec;
+    PipelineFrame f = {fb, fb->buf, fb->len, false, (uint16_t)fb->width, (uint16_t)fb->height,
+                       0, captureUs, esp_timer_get_time(), 0, 0};
+    statCaptured++;
+    pushLatest(captureQueue, f);
+  }
+}
+
+static void encodeTask(void*) {
+  for (;;) {
+    PipelineFrame f;
+    if (xQueueReceive(captureQueue, &f, portMAX_DELAY) != pdTRUE) continue;
+    if (cfg.skip && cfg.skip(f.fb)) {
+      releaseFrame(f);
+      statSkipped++;
+      continue;
+    }
+    f.seq = nextSeq++;
+    f.encodeStartUs = esp_timer_get_time();
+    if (cfg.encode && !cfg.encode(f.fb, &f)) {
+      releaseFrame(f);
+      statFailed++;
+      continue;
+    }
+    f.encodeEndUs = esp_timer_get_time();
+    statEncoded++;
+    pushLatest(sendQueue, f);
+  }
+}
+
+static void networkTask(void*) {
+  for (;;) {
+    PipelineFrame f;
+    if (xQueueReceive(sendQueue, &f, NETWORK_POLL_TICKS) != pdTRUE) {
+      if (cfg.idle) cfg.idle();
+      continue;
+    }
+    if (cfg.idle) cfg.idle();
+    int64_t sendStart = esp_timer_get_time();
+    bool ok = cfg.send(f);
+    releaseFrame(f);
+    if (ok) {
+      lastSendUs = (uint32_t)(esp_timer_get_time() - sendStart);
+      lastSendSeq = f.seq;
+      statSent++;
+    } else {
+      statFailed++;
+      vTaskDelay(SEND_FAIL_BACKOFF);
+    }
+  }
+}
+
+static uint32_t usSince(int64_t t, int64_t base) {
+  return t > base ? (uint32_t)(t - base) : 0;
+}
+
+void fillFrameTiming(const PipelineFrame& frame, FrameTimingHeader* out) {
+  memcpy(out->magic, "FTS1", 4);
+  out->seq = frame.seq;
+  out->captureUs = (uint64_t)frame.captureUs;
+  out->grabUs = usSince(frame.grabUs, frame.captureUs);
+  out->encodeStartUs = usSince(frame.encodeStartUs, frame.captureUs);
+  out->encodeUs = usSince(frame.encodeEndUs, frame.encodeStartUs);
+  out->sendStartUs = usSince(esp_timer_get_time(), frame.captureUs);
+  out->lastSendUs = lastSendUs;
+  out->lastSendSeq = lastSendSeq;
+}
+
+bool startFramePipeline(const FramePipelineConfig& config) {
+  if (!config.send || captureQueue) return false;
+  cfg = config;
+  captureQueue = xQueueCreate(1, sizeof(PipelineFrame));
+  sendQueue    = xQueueCreate(1, sizeof(PipelineFrame));
+  if (!captureQueue || !sendQueue) return false;
+
+  bool ok = xTaskCreatePinnedToCore(networkTask, "net", NETWORK_STACK, nullptr, NETWORK_PRIO, nullptr, NETWORK_CORE) == pdPASS;
+  ok = ok && xTaskCreatePinnedToCore(encodeTask, "encode", ENCODE_STACK, nullptr, ENCODE_PRIO, nullptr, ENCODE_CORE) == pdPASS;
+  ok = ok && xTaskCreatePinnedToCore(captureTask, "capture", CAPTURE_STACK, nullptr, CAPTURE_PRIO, nullptr, CAPTURE_CORE) == pdPASS;
+  return ok;
+}
+
+void logFramePipelineStats(uint32_t periodMs) {
+  static uint32_t lastMs = 0;
+  static uint32_t lastCap = 0, lastEnc = 0, lastSent = 0;
+  uint32_t now = millis();
+  if (now - lastMs < periodMs) return;
+
+  float secs = (now - lastMs) / 1000.0f;
+  uint32_t cap = statCaptured, enc = statEncoded, sent = statSent;
+  Serial.printf("[pipe] fps capture=%.1f encode=%.1f send=%.1f dropped=%u skipped=%u failed=%u heap=%u psram=%u\n",
+                (cap - lastCap) / secs, (enc - lastEnc) / secs, (sent - lastSent) / secs,
+                (unsigned)statDropped, (unsigned)statSkipped, (unsigned)statFailed,
+                ESP.getFreeHeap(), ESP.getFreePsram());
+  lastMs = now;
+  lastCap = cap;
+  lastEnc = enc;
+  lastSent = sent;
+}
@@ -0,0 +1,82 @@
+#ifndef FRAME_PIPELINE_H
+#define FRAME_PIPELINE_H
+
+//
+// Three-stage camera pipeline: capture -> encode -> send.
+//
+// Each stage is its own FreeRTOS task, connected by one-slot queues of
+// frame handles, so the sensor keeps capturing while the previous frame is
+// being encoded and the one before that is on the wire. Throughput is set
+// by the slowest stage instead of the sum of all three. Queues are
+// latest-wins: a stage that falls behind drops the older queued frame
+// (returning its framebuffer) instead of making the others wait.
+//
+// Needs fb_count >= 3 in PSRAM: one buffer being filled by the driver, one
+// queued, one held by the stage working on it.
+//
+// Copied into several sketches; keep the copies identical with
+// ../check_shared.py.
+//
+
+#include "esp_camera.h"
+
+static const int PIPELINE_FB_COUNT = 3;
+
+struct PipelineFrame {
+  camera_fb_t* fb;   // returned to the driver on release, if still held
+  uint8_t* data;     // payload for the send stage
+  size_t len;
+  bool ownsData;     // free(data) on release (encoder output)
+  uint16_t width;
+  uint16_t height;
+  uint32_t seq;            // numbered once rate control accepts the frame
+  int64_t captureUs;       // sensor timestamp (fb->timestamp, esp_timer clock)
+  int64_t grabUs;          // esp_camera_fb_get() returned
+  int64_t encodeStartUs;
+  int64_t encodeEndUs;
+};
+
+// Sent in front of every upload so the server can split latency by stage.
+// Stage times are microseconds after captureUs; the server maps captureUs
+// onto its own clock. Little-endian, 40 bytes.
+struct __attribute__((packed)) FrameTimingHeader {
+  char magic[4];           // "FTS1"
+  uint32_t seq;            // gaps = frames lost after rate control (drops, failed sends)
+  uint64_t captureUs;
+  uint32_t grabUs;
+  uint32_t encodeStartUs;
+  uint32_t encodeUs;       // 0 without an encode stage
+  uint32_t sendStartUs;    // when this message started going out
+  uint32_t lastSendUs;     // how long the previous sent frame took on the wire
+  uint32_t lastSendSeq;    // ...and which frame that was
+};
+
+// Fills `out` from `fb`. An encoder that no longer needs the pixels may
+// esp_camera_fb_return() them itself and set out->fb = nullptr, freeing
+// the buffer for the sensor early. Null = send fb->buf as is.
+typedef bool (*FrameEncodeFn)(camera_fb_t* fb, PipelineFrame* out);
+// Sends one frame; runs on the network task only.
+typedef bool (*FrameSendFn)(const PipelineFrame& frame);
+// Called by the network task while it waits for a frame (e.g. ws.loop()).
+typedef void (*NetworkIdleFn)();
+// Called by the encode task first; true drops the frame unencoded (rate
+// control pacing). Null = keep every frame.
+typedef bool (*FrameSkipFn)(camera_fb_t* fb);
+
+struct FramePipelineConfig {
+  FrameEncodeFn encode;
+  FrameSendFn send;
+  NetworkIdleFn idle;
+  FrameSkipFn skip;
+};
+
+bool startFramePipeline(const FramePipelineConfig& config);
+
+// Fills `out` for `frame`; call from the send function right before the
+// first byte goes out
+void fillFrameTiming(const PipelineFrame& frame, FrameTimingHeader* out);
+
+// Prints per-stage FPS, drops and skips every `periodMs`; call from loop()
+void logFramePipelineStats(uint32_t periodMs = 5000);
+
+#endif  // FRAME_PIPELINE_H
@@ -0,0 +1,87 @@
+#include "motion_detect.h"
+#include <string.h>
+
+static const uint32_t LANES = 0x00FF00FF;   // bytes 0 and 2 of a word
+static const uint32_t LANE_ONES = 0x00010001;
+
+static size_t sampledWords(uint16_t width, uint16_t height) {
+  size_t rows = (height + MotionDetector::ROW_STEP - 1) / MotionDetector::ROW_STEP;
+  size_t words = (width / 4 + MotionDetector::WORD_STEP - 1) / MotionDetector::WORD_STEP;
+  return rows * words;
+}
+
+// |a - b| of two bytes per 16-bit lane: 256 + a - b can't borrow from the
+// next lane, and bit 8 says which side was larger
+static inline uint32_t absDiffLanes(uint32_t a, uint32_t b) {
+  uint32_t v = (a | 0x01000100) - b;
+  uint32_t ge = (v >> 8) & LANE_ONES;         // 1 where a >= b
+  uint32_t mask = (ge << 8) - ge;             // 0xFF where a >= b
+  return ((v ^ ~mask) & LANES) + (ge ^ LANE_ONES);
+}
+
+// Sum of the four byte differences of two words
+static inline uint32_t wordSad(uint32_t a, uint32_t b) {
+  uint32_t s = absDiffLanes(a & LANES, b & LANES) + absDiffLanes((a >> 8) & LANES, (b >> 8) & LANES);
+  return (s & 0xFFFF) + (s >> 16);
+}
+
+// (7 * bg + frame) / 8 per byte, rounded
+static inline uint32_t blendWord(uint32_t bg, uint32_t f) {
+  const uint32_t keep = (1 << MotionDetector::BACKGROUND_SHIFT) - 1;
+  const uint32_t round = LANE_ONES << (MotionDetector::BACKGROUND_SHIFT - 1);
+  uint32_t lo = (((bg & LANES) * keep + (f & LANES) + round) >> MotionDetector::BACKGROUND_SHIFT) & LANES;
+  uint32_t hi = ((((bg >> 8) & LANES) * keep + ((f >> 8) & LANES) + round) >> MotionDetector::BACKGROUND_SHIFT) & LANES;
+  return lo | (hi << 8);
+}
+
+MotionDetector::MotionDetector()
+  : bg_(nullptr), capWords_(0), width_(0), height_(0), threshold_(0) {}
+
+MotionDetector::~MotionDetector() {
+  free(bg_);
+}
+
+bool MotionDetector::begin(uint16_t maxWidth, uint16_t maxHeight, uint16_t thresholdPermille) {
+  free(bg_);
+  capWords_ = sampledWords(maxWidth, maxHeight);
+  size_t bytes = capWords_ * sizeof(uint32_t);
+  bg_ = (uint32_t*)(psramFound() ? ps_malloc(bytes) : malloc(bytes));
+  width_ = 0;
+  height_ = 0;
+  threshold_ = thresholdPermille;
+  return bg_ != nullptr;
+}
+
+MotionResult MotionDetector::update(const uint8_t* frame, uint16_t width, uint16_t height) {
+  MotionResult r = {false, 0, 0};
+  if (!bg_ || sampledWords(width, height) > capWords_) return r;
+
+  bool seed = width != width_ || height != height_;
+  width_ = width;
+  height_ = height;
+
+  uint32_t* bg = bg_;
+  uint32_t sad = 0, changed = 0, samples = 0;
+  for (uint16_t y = 0; y < height; y += ROW_STEP) {
+    const uint32_t* row = (const uint32_t*)(frame + (size_t)y * width);
+    for (uint16_t i = 0; i < width / 4; i += WORD_STEP, bg++) {
+      uint32_t f = row[i];
+      if (seed) {
+        *bg = f;
+        continue;
+      }
+      uint32_t d = wordSad(f, *bg);
+      sad += d;
+      if (d > WORD_SAD) changed++;
+      samples++;
+      *bg = blendWord(*bg, f);
+    }
+  }
+
+  if (samples) {
+    r.changedPermille = changed * 1000 / samples;
+    r.meanDiff = sad / (samples * 4);
+    r.motion = r.changedPermille > threshold_;
+  }
+  return r;
+}
@@ -0,0 +1,54 @@
+#ifndef MOTION_DETECT_H
+#define MOTION_DETECT_H
+
+//
+// Cheap motion detector for the raw grayscale stream.
+//
+// Every ROW_STEP-th row is compared against a running-average background,
+// one 32-bit word (four pixels) out of every WORD_STEP, with the absolute
+// differences of all four bytes computed in one go. A word counts as
+// changed when its SAD exceeds WORD_SAD; there is motion when more than
+// the threshold (per mille of sampled words) changed. The background
+// follows the scene by 1/8 per frame, so lighting drift and objects that
+// stop moving fade into it.
+//
+// At VGA that is 120 rows x 80 words: ~10k word compares per frame and a
+// 38 KB background, cheap enough to run on every captured frame.
+//
+
+#include <Arduino.h>
+
+struct MotionResult {
+  bool motion;
+  uint16_t changedPermille;   // sampled words that changed, per 1000
+  uint8_t meanDiff;           // mean absolute difference per sampled pixel
+};
+
+class MotionDetector {
+public:
+  static const int ROW_STEP = 4;
+  static const int WORD_STEP = 2;
+  static const uint32_t WORD_SAD = 4 * 12;     // four pixels, ~12 levels each
+  static const int BACKGROUND_SHIFT = 3;       // background += (frame - background) / 8
+
+  MotionDetector();
+  ~MotionDetector();
+
+  bool begin(uint16_t maxWidth, uint16_t maxHeight, uint16_t thresholdPermille);
+  // Not synchronized: call from the task that runs update()
+  void setThreshold(uint16_t permille) { threshold_ = permille; }
+
+  // Compares `frame` (4-byte aligned) with the background and folds it in.
+  // The first frame, and the first after a size change, only seed the
+  // background and report no motion.
+  MotionResult update(const uint8_t* frame, uint16_t width, uint16_t height);
+
+private:
+  uint32_t* bg_;
+  size_t capWords_;
+  uint16_t width_;
+  uint16_t height_;
+  uint16_t threshold_;
+};
+
+#endif  // MOTION_DETECT_H
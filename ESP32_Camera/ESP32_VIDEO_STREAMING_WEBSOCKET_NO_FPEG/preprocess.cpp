@@ -0,0 +1,149 @@
+#include "preprocess.h"
+#include <stdio.h>
+#include <string.h>
+
+static const uint32_t LANES = 0x00FF00FF;   // bytes 0 and 2 of a word
+static const uint32_t STRETCH_CLIP_PCT = 1;  // ignore this % of pixels at each end
+
+PreprocessConfig defaultPreprocess() {
+  PreprocessConfig cfg = {0, 0, 0, 0, 1, false};
+  return cfg;
+}
+
+bool isPassthrough(const PreprocessConfig& cfg, uint16_t srcW, uint16_t srcH) {
+  return cfg.scale == 1 && !cfg.stretch && cfg.roiX == 0 && cfg.roiY == 0 &&
+         (cfg.roiW == 0 || cfg.roiW == srcW) && (cfg.roiH == 0 || cfg.roiH == srcH);
+}
+
+bool parsePreprocessCommand(const char* text, size_t len, PreprocessConfig* cfg) {
+  char buf[96];
+  if (len >= sizeof(buf) || len < 10 || memcmp(text, "preprocess", 10) != 0) return false;
+  memcpy(buf, text, len);
+  buf[len] = 0;
+
+  PreprocessConfig c = defaultPreprocess();
+  for (char* tok = strtok(buf + 10, " "); tok; tok = strtok(nullptr, " ")) {
+    unsigned a, b, w, h;
+    if (sscanf(tok, "scale=%u", &a) == 1) {
+      c.scale = (a >= 4) ? 4 : (a >= 2) ? 2 : 1;
+    } else if (sscanf(tok, "roi=%u,%u,%u,%u", &a, &b, &w, &h) == 4) {
+      c.roiX = a; c.roiY = b; c.roiW = w; c.roiH = h;
+    } else if (sscanf(tok, "stretch=%u", &a) == 1) {
+      c.stretch = a != 0;
+    }
+  }
+  *cfg = c;
+  return true;
+}
+
+void resolvePreprocess(PreprocessConfig* cfg, uint16_t srcW, uint16_t srcH,
+                       uint16_t* outW, uint16_t* outH) {
+  uint16_t s = cfg->scale;
+  uint16_t alignX = ROI_ALIGN, alignY = s;
+
+  uint16_t x = cfg->roiX < srcW ? cfg->roiX : 0;
+  uint16_t y = cfg->roiY < srcH ? cfg->roiY : 0;
+  x -= x % alignX;
+  y -= y % alignY;
+  uint16_t w = (cfg->roiW && cfg->roiW <= srcW - x) ? cfg->roiW : srcW - x;
+  uint16_t h = (cfg->roiH && cfg->roiH <= srcH - y) ? cfg->roiH : srcH - y;
+  w -= w % alignX;
+  h -= h % alignY;
+  if (w == 0 || h == 0) {       // ROI collapsed: fall back to the full frame
+    x = 0; y = 0;
+    w = srcW - srcW % alignX;
+    h = srcH - srcH % alignY;
+  }
+
+  cfg->roiX = x; cfg->roiY = y; cfg->roiW = w; cfg->roiH = h;
+  *outW = w / s;
+  *outH = h / s;
+}
+
+// 1:1 crop, a word at a time
+static void cropRows(const uint8_t* src, uint16_t srcW, const PreprocessConfig& c,
+                     uint8_t* dst, uint16_t outW, uint16_t outH) {
+  for (uint16_t y = 0; y < outH; y++) {
+    const uint32_t* s = (const uint32_t*)(src + (size_t)(c.roiY + y) * srcW + c.roiX);
+    uint32_t* d = (uint32_t*)(dst + (size_t)y * outW);
+    for (uint16_t i = 0; i < outW / 4; i++) d[i] = s[i];
+  }
+}
+
+// 2x2 box: each pair of source words (two rows) gives two output pixels.
+// Adjacent pixels are summed in 16-bit lanes, so 4 pixels never overflow.
+static void downscale2(const uint8_t* src, uint16_t srcW, const PreprocessConfig& c,
+                       uint8_t* dst, uint16_t outW, uint16_t outH) {
+  for (uint16_t y = 0; y < outH; y++) {
+    const uint32_t* r0 = (const uint32_t*)(src + (size_t)(c.roiY + 2 * y) * srcW + c.roiX);
+    const uint32_t* r1 = (const uint32_t*)((const uint8_t*)r0 + srcW);
+    uint32_t* d = (uint32_t*)(dst + (size_t)y * outW);
+    for (uint16_t i = 0; i < outW / 4; i++) {
+      uint32_t a = r0[2 * i], b = r1[2 * i];
+      uint32_t lo = (a & LANES) + ((a >> 8) & LANES) + (b & LANES) + ((b >> 8) & LANES);
+      a = r0[2 * i + 1];
+      b = r1[2 * i + 1];
+      uint32_t hi = (a & LANES) + ((a >> 8) & LANES) + (b & LANES) + ((b >> 8) & LANES);
+      lo = ((lo + 0x00020002) >> 2) & LANES;   // two averages, bytes 0 and 2
+      hi = ((hi + 0x00020002) >> 2) & LANES;
+      d[i] = (lo & 0xFF) | ((lo >> 8) & 0xFF00) | ((hi & 0xFF) << 16) | ((hi << 8) & 0xFF000000);
+    }
+  }
+}
+
+// 4x4 box: one source word per row gives one output pixel
+static void downscale4(const uint8_t* src, uint16_t srcW, const PreprocessConfig& c,
+                       uint8_t* dst, uint16_t outW, uint16_t outH) {
+  for (uint16_t y = 0; y < outH; y++) {
+    const uint8_t* row = src + (size_t)(c.roiY + 4 * y) * srcW + c.roiX;
+    uint32_t* d = (uint32_t*)(dst + (size_t)y * outW);
+    for (uint16_t i = 0; i < outW / 4; i++) {
+      uint32_t out = 0;
+      for (int k = 0; k < 4; k++) {
+        uint32_t acc = 0;
+        const uint8_t* p = row + 16 * i + 4 * k;
+        for (int r = 0; r < 4; r++) {
+          uint32_t a = *(const uint32_t*)(p + (size_t)r * srcW);
+          acc += (a & LANES) + ((a >> 8) & LANES);
+        }
+        uint32_t sum = (acc & 0xFFFF) + (acc >> 16);
+        out |= ((sum + 8) >> 4) << (8 * k);
+      }
+      d[i] = out;
+    }
+  }
+}
+
+// Maps the 1st..99th percentile onto 0..255 through a lookup table
+static void stretchHistogram(uint8_t* img, size_t n) {
+  uint32_t hist[256] = {0};
+  for (size_t i = 0; i < n; i++) hist[img[i]]++;
+
+  uint32_t clip = n * STRETCH_CLIP_PCT / 100;
+  int lo = 0, hi = 255;
+  for (uint32_t seen = 0; lo < 255 && (seen += hist[lo]) <= clip; lo++) {}
+  for (uint32_t seen = 0; hi > 0 && (seen += hist[hi]) <= clip; hi--) {}
+  if (hi <= lo) return;    // flat image: nothing to stretch
+
+  uint8_t lut[256];
+  for (int v = 0; v < 256; v++) {
+    int o = (v - lo) * 255 / (hi - lo);
+    lut[v] = o < 0 ? 0 : o > 255 ? 255 : o;
+  }
+  uint32_t* w = (uint32_t*)img;
+  for (size_t i = 0; i < n / 4; i++) {
+    uint32_t v = w[i];
+    w[i] = lut[v & 0xFF] | (lut[(v >> 8) & 0xFF] << 8) |
+           (lut[(v >> 16) & 0xFF] << 16) | ((uint32_t)lut[v >> 24] << 24);
+  }
+}
+
+void preprocessFrame(const uint8_t* src, uint16_t srcW, const PreprocessConfig& cfg,
+                     uint8_t* dst, uint16_t outW, uint16_t outH) {
+  switch (cfg.scale) {
+    case 4:  downscale4(src, srcW, cfg, dst, outW, outH); break;
+    case 2:  downscale2(src, srcW, cfg, dst, outW, outH); break;
+    default: cropRows(src, srcW, cfg, dst, outW, outH); break;
+  }
+  if (cfg.stretch) stretchHistogram(dst, (size_t)outW * outH);
+}
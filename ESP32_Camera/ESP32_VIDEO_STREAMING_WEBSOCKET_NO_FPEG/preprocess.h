@@ -0,0 +1,48 @@
+#ifndef PREPROCESS_H
+#define PREPROCESS_H
+
+//
+// Grayscale preprocessing before a frame is sent: ROI crop, 2x/4x box
+// downscale and an optional histogram stretch, all done on the device so a
+// thumbnail or ROI viewer costs a fraction of the bandwidth without
+// touching the sensor.
+//
+// Kernels work on 32-bit words (four pixels per load/store), so the ROI is
+// snapped to ROI_ALIGN pixels horizontally and to the scale vertically.
+// Plain ESP32 has no SIMD; the same code runs on the S3.
+//
+// Selected at runtime by a text message on the upload WebSocket:
+//   preprocess scale=2 roi=x,y,w,h stretch=1
+// Missing keys fall back to the defaults (full frame, scale 1, no stretch).
+//
+
+#include <Arduino.h>
+
+static const uint16_t ROI_ALIGN = 16;
+
+struct PreprocessConfig {
+  uint16_t roiX;
+  uint16_t roiY;
+  uint16_t roiW;    // 0 = to the right edge
+  uint16_t roiH;    // 0 = to the bottom edge
+  uint8_t scale;    // 1, 2 or 4
+  bool stretch;
+};
+
+// Full frame, no scaling, no stretch
+PreprocessConfig defaultPreprocess();
+bool isPassthrough(const PreprocessConfig& cfg, uint16_t srcW, uint16_t srcH);
+
+// Parses a "preprocess ..." command into `cfg`; false if it isn't one
+bool parsePreprocessCommand(const char* text, size_t len, PreprocessConfig* cfg);
+
+// Clamps and aligns the ROI to a `srcW` x `srcH` frame; returns the output size
+void resolvePreprocess(PreprocessConfig* cfg, uint16_t srcW, uint16_t srcH,
+                       uint16_t* outW, uint16_t* outH);
+
+// Runs crop/downscale/stretch from `src` into `dst` (outW * outH bytes,
+// 4-byte aligned). `cfg` must have been through resolvePreprocess().
+void preprocessFrame(const uint8_t* src, uint16_t srcW, const PreprocessConfig& cfg,
+                     uint8_t* dst, uint16_t outW, uint16_t outH);
+
+#endif  // PREPROCESS_H
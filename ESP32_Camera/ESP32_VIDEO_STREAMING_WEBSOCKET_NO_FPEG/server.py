@@ -1,7 +1,9 @@
 import asyncio
 import time
+from concurrent.futures import ThreadPoolExecutor
 from typing import Optional, Set
 import io
+import json
 import struct
 from PIL import Image
 
@@ -11,35 +13,244 @@ from fastapi.responses import Response, StreamingResponse
 app = FastAPI()
 
 UPLOAD_TOKEN = "change-me"
+# Required for anything that reconfigures the camera (POST /control and
+# commands over /ws/view?token=...); plain viewers only get frames
+CONTROL_TOKEN = "change-me-control"
 
+# Only ever replaced as a whole (no await in between), so readers on the
+# event loop never see a torn pair and every consumer shares the same bytes
 latest_jpeg: Optional[bytes] = None
 latest_ts: float = 0.0
-
-frame_lock = asyncio.Lock()
-frame_event = asyncio.Event()
-
-# Optional: WS viewers that want frames too
-viewers: Set[WebSocket] = set()
-viewers_lock = asyncio.Lock()
+latest_meta: Optional[dict] = None
+
+# PIL releases the GIL while encoding, so re-encodes run here in parallel
+# instead of blocking the event loop
+encode_pool = ThreadPoolExecutor(max_workers=2, thread_name_prefix="jpeg")
+
+
+class FrameMailbox:
+    """Latest-frame slot for one viewer (/stream.mjpeg or /ws/view).
+
+    Publishing never waits on a viewer: a new frame replaces one the viewer
+    hasn't taken yet, so a slow viewer skips frames instead of stalling
+    ingest or the other viewers.
+    """
+
+    def __init__(self):
+        self.frame: Optional[tuple] = None  # (jpeg, timing metadata or None)
+        self.ready = asyncio.Event()
+        self.dropped = 0
+
+    def put(self, jpg: bytes, meta: Optional[dict] = None):
+        if self.frame is not None:
+            self.dropped += 1
+        self.frame = (jpg, meta)
+        self.ready.set()
+
+    async def get(self) -> tuple:
+        await self.ready.wait()
+        self.ready.clear()
+        frame, self.frame = self.frame, None
+        return frame
+
+
+mailboxes: Set[FrameMailbox] = set()
+
+
+def publish_frame(jpg: bytes, ts: float, meta: Optional[dict] = None):
+    """`ts` is when the upload arrived; relay_ms covers decoding and re-encoding."""
+    global latest_jpeg, latest_ts, latest_meta
+    if meta is not None:
+        meta["published"] = time.time()
+        meta["relay_ms"] = round((meta["published"] - ts) * 1000, 2)
+    latest_jpeg, latest_ts, latest_meta = jpg, ts, meta
+    for box in mailboxes:
+        box.put(jpg, meta)
+
+
+# Per-frame device timings (FrameTimingHeader in frame_pipeline.h)
+TIMING_MAGIC = b"FTS1"
+TIMING_HEADER = struct.Struct("<4sIQIIIIII")
+
+
+class LatencyTracker:
+    """Turns the device's frame timings into per-stage latencies.
+
+    The ESP32 only knows time since boot, so its clock is mapped onto ours
+    using the fastest upload seen so far. net_ms is how much longer a frame
+    took than that one, and capture_ts is a lower bound (off by the
+    best-case network delay).
+    """
+
+    def __init__(self):
+        self.offset_us: Optional[int] = None
+        self.last_seq: Optional[int] = None
+        self.missing = 0
+
+    def frame_meta(self, header: bytes, recv: float) -> dict:
+        (_, seq, capture_us, grab, encode_start, encode, send_start,
+         last_send, last_send_seq) = TIMING_HEADER.unpack_from(header)
+        if self.last_seq is None or seq <= self.last_seq:
+            self.offset_us = None  # first frame, or the device restarted
+        elif seq > self.last_seq + 1:
+            self.missing += seq - self.last_seq - 1
+        self.last_seq = seq
+
+        transit_us = int(recv * 1e6) - (capture_us + send_start)
+        if self.offset_us is None or transit_us < self.offset_us:
+            self.offset_us = transit_us
+
+        def ms(us):
+            return round(us / 1000.0, 2)
+
+        return {
+            "seq": seq,
+            "capture_ts": (capture_us + self.offset_us) / 1e6,
+            "capture_ms": ms(grab),
+            "encode_queue_ms": ms(encode_start - grab),
+            "encode_ms": ms(encode),
+            "send_queue_ms": ms(send_start - encode_start - encode),
+            "send_ms": ms(last_send),  # previous frame (last_send_seq)
+            "send_seq": last_send_seq,
+            "net_ms": ms(transit_us - self.offset_us),
+            "device_missing": self.missing,
+        }
+
+
+def frame_headers(ts: float, meta: Optional[dict]) -> dict:
+    """X-Frame-* response headers: capture time when the device sent timings."""
+    if meta is None:
+        return {"Cache-Control": "no-store", "X-Frame-Timestamp": str(ts)}
+    return {
+        "Cache-Control": "no-store",
+        "X-Frame-Timestamp": str(meta["capture_ts"]),
+        "X-Frame-Seq": str(meta["seq"]),
+        "X-Frame-Timing": json.dumps(meta, separators=(",", ":")),
+    }
+
+
+# Connected ESP32 uploaders, for control messages (preprocess, keyframe, motion)
+uploaders: Set[WebSocket] = set()
+
+# Latest "motion start|stop|idle changed=.. diff=.." event from the camera
+# (motion_detect.h); while idle the camera sends these instead of frames
+motion_state: dict = {"state": "unknown", "ts": 0.0}
+
+
+def parse_motion_event(text: str, now: float) -> dict:
+    parts = text.split()
+    event = {"state": parts[1] if len(parts) > 1 else "unknown", "ts": now}
+    for part in parts[2:]:
+        key, _, value = part.partition("=")
+        if value.isdigit():
+            event[key] = int(value)
+    return event
 
 
 @app.get("/health")
 def health():
-    return {"ok": True, "has_frame": latest_jpeg is not None, "ts": latest_ts}
+    return {"ok": True, "has_frame": latest_jpeg is not None, "ts": latest_ts, "viewers": len(mailboxes),
+            "motion": motion_state["state"]}
+
+
+def preprocess_command(scale: int = 1, roi: Optional[str] = None, stretch: bool = False) -> str:
+    """Builds the device's "preprocess" control message (see preprocess.h)."""
+    if scale not in (1, 2, 4):
+        raise HTTPException(status_code=400, detail="scale must be 1, 2 or 4")
+    cmd = f"preprocess scale={scale} stretch={int(stretch)}"
+    if roi:
+        parts = roi.split(",")
+        if len(parts) != 4 or not all(p.strip().isdigit() for p in parts):
+            raise HTTPException(status_code=400, detail="roi must be x,y,w,h")
+        cmd += " roi=" + ",".join(p.strip() for p in parts)
+    return cmd
+
+
+def require_control_token(token: Optional[str]):
+    if token != CONTROL_TOKEN:
+        raise HTTPException(status_code=403, detail="control token required")
+
+
+async def send_control(cmd: str) -> int:
+    sent = 0
+    for up in list(uploaders):
+        try:
+            await up.send_text(cmd)
+            sent += 1
+        except Exception:
+            uploaders.discard(up)
+    return sent
+
+
+@app.post("/control")
+async def control(scale: int = 1, roi: Optional[str] = None, stretch: bool = False, token: Optional[str] = None):
+    """Selects on-device crop/downscale/stretch, e.g. /control?scale=4&roi=0,0,320,240&token=..."""
+    require_control_token(token)
+    cmd = preprocess_command(scale, roi, stretch)
+    return {"command": cmd, "devices": await send_control(cmd)}
+
+
+@app.get("/motion")
+def motion():
+    return motion_state
+
+
+@app.post("/motion")
+async def motion_control(gate: Optional[bool] = None, threshold: Optional[int] = None, token: Optional[str] = None):
+    """Motion gating on/off and its threshold (per mille), e.g. /motion?gate=0&token=..."""
+    require_control_token(token)
+    cmd = "motion"
+    if gate is not None:
+        cmd += f" gate={int(gate)}"
+    if threshold is not None:
+        cmd += f" threshold={threshold}"
+    return {"command": cmd, "devices": await send_control(cmd)}
 
 
 @app.get("/latest.jpg")
 async def latest():
-    async with frame_lock:
-        if latest_jpeg is None:
-            raise HTTPException(status_code=404, detail="no frame yet")
-        data = latest_jpeg
-        ts = latest_ts
+    if latest_jpeg is None:
+        raise HTTPException(status_code=404, detail="no frame yet")
+    data, ts, meta = latest_jpeg, latest_ts, latest_meta
 
     return Response(
         content=data,
         media_type="image/jpeg",
-        headers={"Cache-Control": "no-store", "X-Frame-Timestamp": str(ts)},
+        headers=frame_headers(ts, meta),
+    )
+
+
+# Grayscale for clients that want pixels: decoded here from the latest JPEG
+# on request, instead of the ESP32 encoding or sending raw frames
+gray_cache: Optional[bytes] = None
+gray_cache_ts: float = 0.0
+
+
+def jpeg_to_pgm(jpg: bytes) -> bytes:
+    img = Image.open(io.BytesIO(jpg))
+    img.draft("L", img.size)  # lets libjpeg skip the chroma planes
+    img = img.convert("L")
+    return b"P5\n%d %d\n255\n" % img.size + img.tobytes()
+
+
+@app.get("/latest.pgm")
+async def latest_gray():
+    global gray_cache, gray_cache_ts
+    if latest_jpeg is None:
+        raise HTTPException(status_code=404, detail="no frame yet")
+    data, ts, meta = latest_jpeg, latest_ts, latest_meta
+
+    if ts == gray_cache_ts and gray_cache is not None:
+        pgm = gray_cache
+    else:
+        pgm = await asyncio.to_thread(jpeg_to_pgm, data)
+        if ts > gray_cache_ts:
+            gray_cache, gray_cache_ts = pgm, ts
+
+    return Response(
+        content=pgm,
+        media_type="image/x-portable-graymap",
+        headers=frame_headers(ts, meta),
     )
 
 
@@ -48,29 +259,28 @@ async def stream():
     boundary = "frame"
 
     async def gen():
-        last_sent = 0.0
-        while True:
-            try:
-                await asyncio.wait_for(frame_event.wait(), timeout=10.0)
-            except asyncio.TimeoutError:
-                continue
-
-            async with frame_lock:
-                if latest_jpeg is None:
-                    continue
-                ts = latest_ts
-                jpg = latest_jpeg
-
-            if ts == last_sent:
-                continue
-            last_sent = ts
-
-            yield (
-                f"--{boundary}\r\n"
-                "Content-Type: image/jpeg\r\n"
-                f"Content-Length: {len(jpg)}\r\n"
-                "\r\n"
-            ).encode("utf-8") + jpg + b"\r\n"
+        box = FrameMailbox()
+        if latest_jpeg is not None:
+            box.put(latest_jpeg, latest_meta)
+        mailboxes.add(box)
+        try:
+            while True:
+                jpg, meta = await box.get()
+                # Same X-Timestamp part header as CameraWebServer's /stream
+                timing = f"X-Timestamp: {meta['capture_ts']:.6f}\r\nX-Frame-Seq: {meta['seq']}\r\n" if meta else ""
+                # Header and frame go out as separate chunks so the JPEG
+                # isn't copied per viewer
+                yield (
+                    f"--{boundary}\r\n"
+                    "Content-Type: image/jpeg\r\n"
+                    f"Content-Length: {len(jpg)}\r\n"
+                    f"{timing}"
+                    "\r\n"
+                ).encode("utf-8")
+                yield jpg
+                yield b"\r\n"
+        finally:
+            mailboxes.discard(box)
 
     return StreamingResponse(
         gen(),
@@ -78,6 +288,69 @@ async def stream():
         headers={"Cache-Control": "no-store"},
     )
 
+JPEG_SOI = b"\xff\xd8"
+TILE_MAGIC = b"TDL1"
+TILE_HEADER = struct.Struct("<4sHHBBHI")
+TILE_KEYFRAME = 0x01
+
+
+class TileFrameDecoder:
+    """Rebuilds frames from the ESP32's tile delta messages (see tile_delta.h).
+
+    Keyframes carry the whole frame; deltas carry a tile bitmap followed by
+    the changed tiles, which are pasted over the previous frame.
+    """
+
+    def __init__(self):
+        self.frame: Optional[bytearray] = None
+        self.w = 0
+        self.h = 0
+        self.next_seq = 0
+
+    def decode(self, msg: bytes):
+        """Returns (w, h, frame bytes, tiles sent), or None if a keyframe is needed."""
+        magic, w, h, tile, flags, tiles, seq = TILE_HEADER.unpack_from(msg)
+        body = memoryview(msg)[TILE_HEADER.size:]
+
+        if flags & TILE_KEYFRAME:
+            if len(body) != w * h:
+                raise ValueError(f"keyframe size {len(body)} != {w}x{h}")
+            self.frame = bytearray(body)
+            self.w, self.h = w, h
+            self.next_seq = seq + 1
+            return w, h, self.frame, tiles
+
+        if self.frame is None or (w, h) != (self.w, self.h) or seq != self.next_seq:
+            return None
+        self.next_seq = seq + 1
+
+        tiles_x = (w + tile - 1) // tile
+        tiles_y = (h + tile - 1) // tile
+        bitmap_len = (tiles_x * tiles_y + 7) // 8
+        bitmap = body[:bitmap_len]
+        pos = bitmap_len
+        frame = self.frame
+        for i in range(tiles_x * tiles_y):
+            if not bitmap[i >> 3] & (1 << (i & 7)):
+                continue
+            ty, tx = divmod(i, tiles_x)
+            x0, y0 = tx * tile, ty * tile
+            tw, th = min(tile, w - x0), min(tile, h - y0)
+            if pos + tw * th > len(body):
+                raise ValueError("delta truncated")
+            for y in range(y0, y0 + th):
+                row = y * w + x0
+                frame[row:row + tw] = body[pos:pos + tw]
+                pos += tw
+        return w, h, frame, tiles
+
+
+def encode_gray(w: int, h: int, raw: bytes) -> bytes:
+    buf = io.BytesIO()
+    Image.frombytes("L", (w, h), raw).save(buf, format="JPEG", quality=75)
+    return buf.getvalue()
+
+
 @app.websocket("/ws/upload")
 async def ws_upload(ws: WebSocket):
     token = ws.query_params.get("token")
@@ -86,62 +359,89 @@ async def ws_upload(ws: WebSocket):
         return
 
     await ws.accept()
+    uploaders.add(ws)
     print("[WS-UPLOAD] connected")
 
     last_log = 0.0
     frames = 0
+    tiles = TileFrameDecoder()
+    timing = LatencyTracker()
+    last_key_request = 0.0
 
     try:
         while True:
             msg = await ws.receive()
 
+            text = msg.get("text")
+            if text and text.startswith("motion"):
+                motion_state.clear()
+                motion_state.update(parse_motion_event(text, time.time()))
+                if motion_state["state"] != "idle":
+                    print(f"[WS-UPLOAD] {text}")
+                continue
+
             if "bytes" not in msg or msg["bytes"] is None:
                 continue
 
             raw_msg = msg["bytes"]
             now = time.time()
 
-            if len(raw_msg) < 8:
-                print(f"[WS-UPLOAD] bad packet too small: {len(raw_msg)}")
-                continue
+            meta = None
+            if raw_msg[:4] == TIMING_MAGIC and len(raw_msg) >= TIMING_HEADER.size:
+                meta = timing.frame_meta(raw_msg, now)
+                raw_msg = raw_msg[TIMING_HEADER.size:]
+
+            jpg = None
+            if raw_msg[:2] == JPEG_SOI:
+                # Sensor JPEG (SENSOR_JPEG=1): relayed as is, no re-encode
+                jpg = raw_msg
+                w = h = 0
+            elif raw_msg[:4] == TILE_MAGIC and len(raw_msg) >= TILE_HEADER.size:
+                try:
+                    decoded = tiles.decode(raw_msg)
+                except ValueError as e:
+                    print(f"[WS-UPLOAD] bad tile message: {e}")
+                    decoded = None
+                if decoded is None:
+                    # Missing or stale reference: ask for a fresh keyframe
+                    if now - last_key_request >= 1.0:
+                        await ws.send_text("keyframe")
+                        last_key_request = now
+                    continue
+                w, h, raw, sent_tiles = decoded
+                if sent_tiles == 0:
+                    frames += 1  # nothing changed; keep the current JPEG
+                    continue
+            else:
+                # Legacy raw frame: <u32 w><u32 h> + w*h pixels
+                if len(raw_msg) < 8:
+                    print(f"[WS-UPLOAD] bad packet too small: {len(raw_msg)}")
+                    continue
 
-            w, h = struct.unpack("<II", raw_msg[:8])
-            raw = raw_msg[8:]
+                w, h = struct.unpack("<II", raw_msg[:8])
+                raw = raw_msg[8:]
 
-            if w <= 0 or h <= 0 or w > 2000 or h > 2000:
-                print(f"[WS-UPLOAD] bad dims: {w}x{h}")
-                continue
+                if w <= 0 or h <= 0 or w > 2000 or h > 2000:
+                    print(f"[WS-UPLOAD] bad dims: {w}x{h}")
+                    continue
 
-            expected = w * h
-            if len(raw) != expected:
-                print(f"[WS-UPLOAD] size mismatch got={len(raw)} expected={expected} ({w}x{h})")
-                continue
+                expected = w * h
+                if len(raw) != expected:
+                    print(f"[WS-UPLOAD] size mismatch got={len(raw)} expected={expected} ({w}x{h})")
+                    continue
 
-            img = Image.frombytes("L", (w, h), raw)
-            buf = io.BytesIO()
-            img.save(buf, format="JPEG", quality=75, optimize=True)
-            jpg = buf.getvalue()
-
-            async with frame_lock:
-                global latest_jpeg, latest_ts
-                latest_jpeg = jpg
-                latest_ts = now
-                frame_event.set()
-                frame_event.clear()
-
-            async with viewers_lock:
-                dead = []
-                for v in viewers:
-                    try:
-                        await v.send_bytes(jpg)
-                    except Exception:
-                        dead.append(v)
-                for v in dead:
-                    viewers.discard(v)
+            if jpg is None:
+                # bytes() snapshots the tile decoder's frame, which the next
+                # delta updates in place
+                loop = asyncio.get_running_loop()
+                jpg = await loop.run_in_executor(encode_pool, encode_gray, w, h, bytes(raw))
+
+            publish_frame(jpg, now, meta)
 
             frames += 1
             if now - last_log >= 1.0:
-                print(f"[WS-UPLOAD] ~FPS={frames} dims={w}x{h} raw={len(raw)} jpeg={len(jpg)}")
+                dims = f"{w}x{h}" if w else "sensor-jpeg"
+                print(f"[WS-UPLOAD] ~FPS={frames} dims={dims} msg={len(raw_msg)} jpeg={len(jpg)}")
                 frames = 0
                 last_log = now
 
@@ -153,21 +453,47 @@ async def ws_upload(ws: WebSocket):
             await ws.close()
         except Exception:
             pass
+    finally:
+        uploaders.discard(ws)
 
 
 
+async def send_frames(ws: WebSocket, box: FrameMailbox, with_meta: bool):
+    try:
+        while True:
+            jpg, meta = await box.get()
+            if with_meta and meta is not None:
+                # Timings for the binary frame that follows (bench.py)
+                await ws.send_text(json.dumps({**meta, "relay_dropped": box.dropped}))
+            await ws.send_bytes(jpg)
+    except Exception:
+        pass  # the receive loop sees the disconnect
+
+
 @app.websocket("/ws/view")
 async def ws_view(ws: WebSocket):
     await ws.accept()
-    async with viewers_lock:
-        viewers.add(ws)
+    box = FrameMailbox()
+    mailboxes.add(box)
+    # /ws/view?meta=1: a JSON text message with the frame's timings before each frame
+    with_meta = ws.query_params.get("meta") == "1"
+    # Only viewers that present the control token may reconfigure the camera
+    can_control = ws.query_params.get("token") == CONTROL_TOKEN
+    sender = asyncio.create_task(send_frames(ws, box, with_meta))
     print("[WS-VIEW] connected")
 
     try:
+        # Control viewers may send "preprocess ..." text to pick a thumbnail
+        # or ROI; anything else, and everything from plain viewers, is
+        # ignored. Motion gating is only changed through POST /motion.
         while True:
-            await asyncio.sleep(60)
+            text = await ws.receive_text()
+            if can_control and text.startswith("preprocess"):
+                await send_control(text)
+    except WebSocketDisconnect:
+        pass
     finally:
-        async with viewers_lock:
-            viewers.discard(ws)
-        print("[WS-VIEW] disconnected")
+        mailboxes.discard(box)
+        sender.cancel()
+        print(f"[WS-VIEW] disconnected, skipped {box.dropped} frames")
 
@@ -0,0 +1,154 @@
+#include "tile_delta.h"
+#include <string.h>
+
+static uint8_t* allocBuffer(size_t n) {
+  return (uint8_t*)(psramFound() ? ps_malloc(n) : malloc(n));
+}
+
+// Tile extent along one axis, cropped at the frame edge
+static inline int tileSpan(int remaining) {
+  return remaining < TileDeltaEncoder::TILE ? remaining : TileDeltaEncoder::TILE;
+}
+
+TileDeltaEncoder::TileDeltaEncoder()
+  : width_(0), height_(0), tilesX_(0), tilesY_(0), ref_(nullptr), out_(nullptr),
+    maxPixels_(0), outCap_(0), bitmapBytes_(0), seq_(0), sinceKey_(0), lastTiles_(0), needKey_(true) {}
+
+TileDeltaEncoder::~TileDeltaEncoder() {
+  free(ref_);
+  free(out_);
+}
+
+bool TileDeltaEncoder::begin(uint16_t maxWidth, uint16_t maxHeight) {
+  free(ref_);
+  free(out_);
+  maxPixels_ = (size_t)maxWidth * maxHeight;
+  outCap_ = deltaLimit(maxWidth, maxHeight);
+  ref_ = allocBuffer(maxPixels_);
+  out_ = allocBuffer(outCap_);
+  width_ = 0;
+  return ref_ && out_ && setFrameSize(maxWidth, maxHeight);
+}
+
+// Deltas bigger than half a frame are sent as keyframes instead
+size_t TileDeltaEncoder::deltaLimit(uint16_t width, uint16_t height) {
+  size_t tiles = (size_t)((width + TILE - 1) / TILE) * ((height + TILE - 1) / TILE);
+  return sizeof(TileDeltaHeader) + (tiles + 7) / 8 + (size_t)width * height / 2;
+}
+
+bool TileDeltaEncoder::setFrameSize(uint16_t width, uint16_t height) {
+  if (width == width_ && height == height_) return true;
+  if ((size_t)width * height > maxPixels_ || deltaLimit(width, height) > outCap_) return false;
+  width_ = width;
+  height_ = height;
+  tilesX_ = (width + TILE - 1) / TILE;
+  tilesY_ = (height + TILE - 1) / TILE;
+  bitmapBytes_ = (tileCount() + 7) / 8;
+  needKey_ = true;  // the server's reference has the old size
+  return true;
+}
+
+void TileDeltaEncoder::fillHeader(TileDeltaHeader* h, uint8_t flags, uint16_t tiles) {
+  memcpy(h->magic, "TDL1", 4);
+  h->width = width_;
+  h->height = height_;
+  h->tile = TILE;
+  h->flags = flags;
+  h->tiles = tiles;
+  h->seq = seq_++;
+}
+
+// SAD against the reference, four pixels per load; stops at the threshold.
+// A single pixel that moved a lot also counts, so small objects aren't lost.
+bool TileDeltaEncoder::tileChanged(const uint8_t* frame, int tx, int ty) const {
+  int x0 = tx * TILE, y0 = ty * TILE;
+  int tw = tileSpan(width_ - x0), th = tileSpan(height_ - y0);
+  uint32_t limit = SAD_PER_PIXEL * tw * th;
+  uint32_t sad = 0;
+
+  for (int y = 0; y < th; y++) {
+    size_t row = (size_t)(y0 + y) * width_ + x0;
+    const uint8_t* a = frame + row;
+    const uint8_t* b = ref_ + row;
+    int x = 0;
+    for (; x + 4 <= tw; x += 4) {
+      uint32_t wa, wb;
+      memcpy(&wa, a + x, 4);
+      memcpy(&wb, b + x, 4);
+      if (wa == wb) continue;
+      for (int s = 0; s < 32; s += 8) {
+        int d = (int)((wa >> s) & 0xFF) - (int)((wb >> s) & 0xFF);
+        d = d < 0 ? -d : d;
+        if (d > PIXEL_DELTA) return true;
+        sad += d;
+      }
+    }
+    for (; x < tw; x++) {
+      int d = (int)a[x] - (int)b[x];
+      d = d < 0 ? -d : d;
+      if (d > PIXEL_DELTA) return true;
+      sad += d;
+    }
+    if (sad > limit) return true;
+  }
+  return false;
+}
+
+bool TileDeltaEncoder::encodeDelta(const uint8_t* frame, const uint8_t** msg, size_t* len) {
+  if (needKey_ || !ref_ || sinceKey_ >= KEYFRAME_INTERVAL) return false;
+
+  uint8_t* bitmap = out_ + sizeof(TileDeltaHeader);
+  memset(bitmap, 0, bitmapBytes_);
+
+  // Pass 1: mark changed tiles; bail out to a keyframe if they won't fit
+  size_t payload = 0;
+  uint16_t tiles = 0;
+  uint32_t i = 0;
+  for (int ty = 0; ty < tilesY_; ty++) {
+    for (int tx = 0; tx < tilesX_; tx++, i++) {
+      if (!tileChanged(frame, tx, ty)) continue;
+      bitmap[i >> 3] |= 1 << (i & 7);
+      payload += (size_t)tileSpan(width_ - tx * TILE) * tileSpan(height_ - ty * TILE);
+      tiles++;
+    }
+  }
+  size_t total = sizeof(TileDeltaHeader) + bitmapBytes_ + payload;
+  if (total > deltaLimit(width_, height_)) return false;
+
+  // Pass 2: copy changed tiles out and into the reference
+  uint8_t* p = bitmap + bitmapBytes_;
+  i = 0;
+  for (int ty = 0; ty < tilesY_; ty++) {
+    for (int tx = 0; tx < tilesX_; tx++, i++) {
+      if (!(bitmap[i >> 3] & (1 << (i & 7)))) continue;
+      int x0 = tx * TILE, y0 = ty * TILE;
+      int tw = tileSpan(width_ - x0), th = tileSpan(height_ - y0);
+      for (int y = 0; y < th; y++) {
+        size_t row = (size_t)(y0 + y) * width_ + x0;
+        memcpy(p, frame + row, tw);
+        memcpy(ref_ + row, frame + row, tw);
+        p += tw;
+      }
+    }
+  }
+
+  fillHeader((TileDeltaHeader*)out_, 0, tiles);
+  sinceKey_++;
+  lastTiles_ = tiles;
+  *msg = out_;
+  *len = total;
+  return true;
+}
+
+TileDeltaHeader TileDeltaEncoder::keyframeHeader() {
+  TileDeltaHeader h;
+  fillHeader(&h, TD_KEYFRAME, (uint16_t)tileCount());
+  return h;
+}
+
+void TileDeltaEncoder::keyframeSent(const uint8_t* frame) {
+  if (ref_) memcpy(ref_, frame, (size_t)width_ * height_);
+  needKey_ = false;
+  sinceKey_ = 0;
+  lastTiles_ = tileCount();
+}
@@ -0,0 +1,84 @@
+#ifndef TILE_DELTA_H
+#define TILE_DELTA_H
+
+//
+// 16x16 tile delta encoder for the raw grayscale stream.
+//
+// The encoder keeps a reference copy of what the server has. Each frame,
+// every tile is compared against it (sum of absolute differences plus a
+// per-pixel limit, stopping as soon as either is crossed); only tiles that
+// changed are sent and copied into the reference, so slow drift is still
+// sent once it adds up. Keyframes (the whole frame, row order) go out every
+// KEYFRAME_INTERVAL frames, after a reconnect or failed send, on request
+// from the server, and whenever so much changed that a keyframe is cheaper.
+//
+// Message layout (little endian), decoded by server.py /ws/upload:
+//   "TDL1" u16 width, u16 height, u8 tile, u8 flags, u16 tiles, u32 seq
+//   flags & TD_KEYFRAME: width*height pixels, row order
+//   otherwise: tile bitmap (raster order, LSB first), then each changed
+//   tile's rows (edge tiles are cropped to the frame)
+//
+
+#include <Arduino.h>
+
+static const uint8_t TD_KEYFRAME = 0x01;
+
+struct TileDeltaHeader {
+  char magic[4];
+  uint16_t width;
+  uint16_t height;
+  uint8_t tile;
+  uint8_t flags;
+  uint16_t tiles;
+  uint32_t seq;
+} __attribute__((packed));
+
+class TileDeltaEncoder {
+public:
+  static const int TILE = 16;
+  static const uint32_t KEYFRAME_INTERVAL = 100;
+  static const uint32_t SAD_PER_PIXEL = 4;    // mean abs difference that counts as a change
+  static const int PIXEL_DELTA = 48;          // or any one pixel changing by more than this
+
+  TileDeltaEncoder();
+  ~TileDeltaEncoder();
+
+  // Allocates the reference frame and delta buffer (PSRAM when present)
+  // for frames up to maxWidth x maxHeight
+  bool begin(uint16_t maxWidth, uint16_t maxHeight);
+  // Switches to a new frame size (e.g. preprocessing changed); the next
+  // frame is a keyframe. False if it doesn't fit the buffers.
+  bool setFrameSize(uint16_t width, uint16_t height);
+  void forceKeyframe() { needKey_ = true; }
+
+  // Builds a delta message for `frame` and updates the reference. Returns
+  // false when a keyframe should be sent instead: then call keyframeHeader(),
+  // send it followed by the frame, and keyframeSent() if that worked.
+  bool encodeDelta(const uint8_t* frame, const uint8_t** msg, size_t* len);
+  TileDeltaHeader keyframeHeader();
+  void keyframeSent(const uint8_t* frame);
+
+  uint32_t lastTilesSent() const { return lastTiles_; }
+  uint32_t tileCount() const { return (uint32_t)tilesX_ * tilesY_; }
+
+private:
+  static size_t deltaLimit(uint16_t width, uint16_t height);
+  bool tileChanged(const uint8_t* frame, int tx, int ty) const;
+  void fillHeader(TileDeltaHeader* h, uint8_t flags, uint16_t tiles);
+
+  uint16_t width_;
+  uint16_t height_;
+  uint16_t tilesX_;
+  uint16_t tilesY_;
+  uint8_t* ref_;      // frame as last delivered to the server
+  uint8_t* out_;      // header + bitmap + tiles
+  size_t maxPixels_;
+  size_t outCap_;
+  size_t bitmapBytes_;
+  uint32_t seq_;
+  uint32_t sinceKey_;
+  uint32_t lastTiles_;
+  bool needKey_;
+};
+
+#endif  // TILE_DELTA_H
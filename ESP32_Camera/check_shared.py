@@ -0,0 +1,64 @@
+"""Checks that the sources shared between camera sketches are identical.
+
+Arduino only compiles files inside a sketch's own folder, so these modules
+are copied into every sketch that uses them instead of being included from
+one place. Edit any one copy, then
+
+    python check_shared.py --sync ESP32_VIDEO_STREAMING_WEBSOCKET
+
+copies that sketch's version over the others. Without --sync it only
+reports copies that differ and exits non-zero.
+"""
+import argparse
+import filecmp
+import shutil
+import sys
+from pathlib import Path
+
+ROOT = Path(__file__).resolve().parent
+
+SHARED = {
+    ("rate_control.h", "rate_control.cpp"): [
+        "CameraWebServer",
+        "CameraAndLEDMAtrix",
+        "ESP32_VIDEO_STREAMING",
+        "ESP32_VIDEO_STREAMING_WEBSOCKET",
+    ],
+    ("frame_pipeline.h", "frame_pipeline.cpp"): [
+        "ESP32_VIDEO_STREAMING",
+        "ESP32_VIDEO_STREAMING_WEBSOCKET",
+        "ESP32_VIDEO_STREAMING_WEBSOCKET_NO_FPEG",
+    ],
+}
+
+
+def main() -> int:
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--sync", metavar="SKETCH", help="copy this sketch's version to the other sketches")
+    args = parser.parse_args()
+
+    bad = 0
+    for files, sketches in SHARED.items():
+        if args.sync and args.sync not in sketches:
+            continue
+        source = args.sync or sketches[0]
+        for name in files:
+            ref = ROOT / source / name
+            for sketch in sketches:
+                copy = ROOT / sketch / name
+                if copy == ref or (copy.exists() and filecmp.cmp(ref, copy, shallow=False)):
+                    continue
+                if args.sync:
+                    shutil.copyfile(ref, copy)
+                    print(f"updated {sketch}/{name}")
+                else:
+                    print(f"{sketch}/{name} differs from {source}/{name}")
+                    bad += 1
+    if args.sync and not any(args.sync in s for s in SHARED.values()):
+        print(f"{args.sync} has no shared sources", file=sys.stderr)
+        return 2
+    return 1 if bad else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
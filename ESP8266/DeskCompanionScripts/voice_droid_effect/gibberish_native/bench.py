@@ -0,0 +1,72 @@
+#!/usr/bin/env python3
+"""Benchmark ../gibberish.py against the native renderer.
+
+Usage:
+  python bench.py input1.wav [input2.wav ...] [--runs 3]
+
+Each input is first trimmed to a multiple of 3 frames (the Python
+sample_hold needs that), then both renderers are run as subprocesses with
+default options and the best of --runs wall-clock times is reported.
+"""
+from pathlib import Path
+import argparse
+import subprocess
+import sys
+import tempfile
+import time
+import wave
+
+HERE = Path(__file__).resolve().parent
+PY_SCRIPT = HERE.parent / "gibberish.py"
+NATIVE = HERE / ("gibberish.exe" if sys.platform == "win32" else "gibberish")
+
+
+def trimmed_copy(src: Path, dst: Path) -> float:
+    with wave.open(str(src), "rb") as r:
+        params = r.getparams()
+        frames = r.readframes(params.nframes - params.nframes % 3)
+    with wave.open(str(dst), "wb") as w:
+        w.setparams(params)
+        w.writeframes(frames)
+    return (params.nframes - params.nframes % 3) / params.framerate
+
+
+def best_time(cmd, runs):
+    best = None
+    for _ in range(runs):
+        t0 = time.perf_counter()
+        res = subprocess.run(cmd, stdout=subprocess.DEVNULL, stderr=subprocess.PIPE, text=True)
+        dt = time.perf_counter() - t0
+        if res.returncode != 0:
+            print(f"  failed: {' '.join(map(str, cmd))}\n{res.stderr}", file=sys.stderr)
+            return None
+        best = dt if best is None else min(best, dt)
+    return best
+
+
+def main():
+    ap = argparse.ArgumentParser()
+    ap.add_argument("inputs", nargs="+")
+    ap.add_argument("--runs", type=int, default=3)
+    args = ap.parse_args()
+
+    if not NATIVE.exists():
+        print(f"Build the native renderer first (make): {NATIVE}", file=sys.stderr)
+        return 2
+
+    with tempfile.TemporaryDirectory() as tmp:
+        tmp = Path(tmp)
+        print(f"{'input':<24}{'audio s':>9}{'python s':>10}{'native s':>10}{'speedup':>9}")
+        for i, name in enumerate(args.inputs):
+            src = tmp / f"in{i}.wav"
+            secs = trimmed_copy(Path(name), src)
+            py = best_time([sys.executable, str(PY_SCRIPT), str(src), str(tmp / "py.wav")], args.runs)
+            nat = best_time([str(NATIVE), str(src), str(tmp / "native.wav")], args.runs)
+            speed = f"{py / nat:.0f}x" if py and nat else "-"
+            fmt = lambda v: f"{v:.2f}" if v is not None else "-"
+            print(f"{Path(name).name:<24}{secs:>9.1f}{fmt(py):>10}{fmt(nat):>10}{speed:>9}")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,442 @@
+// Native port of ../gibberish.py: same effect chain and the same command
+// line, plus whole-directory processing on a thread pool.
+//
+//   gibberish input.wav output.wav [--attack 4 --release 80 --seed 0 ...]
+//   gibberish in_dir/ out_dir/ [--jobs N] [options]   (every *.wav in in_dir)
+//
+// Each stage runs over the whole buffer as a simple loop over contiguous
+// doubles, so the element-wise ones (abs, gain, crush, normalize, carrier
+// mix) auto-vectorize at -O3. The IIR stages (biquads, envelope follower)
+// and the running-sum Savitzky-Golay smoother are sequential by nature and
+// run as tight scalar loops, which is where the Python version spends its
+// time. The smoother only ever sees the three-level glitch gate, so its
+// running sums are exact int32 fixed point.
+//
+// Differences from the script: the noise carrier uses std::mt19937_64, so
+// output is not bit-identical to numpy's generator (same statistics);
+// sample_hold repeats every `hold`-th sample for any length (the numpy
+// slicing only works when the length divides evenly); --raw writes
+// interleaved stereo s16le (the device format) instead of a WAV.
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace fs = std::filesystem;
+typedef std::vector<double> Buf;
+
+struct Options {
+    double attack = 4.0;
+    double release = 80.0;
+    int seed = 0;
+    double hp = 250.0;
+    double lp = 4200.0;
+    int bits = 10;
+    int hold = 3;
+    double glitch_rate = 14.0;
+    double glitch_depth = 0.30;
+    bool raw = false;
+    int jobs = 0;
+};
+
+// ---------------------------------------------------------------- WAV I/O
+
+static uint32_t rd32(const uint8_t* p) { return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24); }
+static uint16_t rd16(const uint8_t* p) { return (uint16_t)(p[0] | (p[1] << 8)); }
+
+// Reads PCM 8/16/24/32-bit or float32/64 WAV and mixes down to mono
+// (to_mono in the script).
+static bool readWav(const std::string& path, Buf& mono, int& sr, std::string& err) {
+    FILE* f = fopen(path.c_str(), "rb");
+    if (!f) { err = "cannot open"; return false; }
+    std::vector<uint8_t> data;
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    data.resize(size > 0 ? size : 0);
+    size_t got = fread(data.data(), 1, data.size(), f);
+    fclose(f);
+    if (got != data.size() || data.size() < 12 || memcmp(data.data(), "RIFF", 4) || memcmp(data.data() + 8, "WAVE", 4)) {
+        err = "not a RIFF/WAVE file";
+        return false;
+    }
+    int fmt = 0, channels = 0, bits = 0;
+    const uint8_t* pcm = nullptr;
+    size_t pcmLen = 0;
+    for (size_t pos = 12; pos + 8 <= data.size();) {
+        uint32_t len = rd32(&data[pos + 4]);
+        const uint8_t* body = &data[pos + 8];
+        size_t avail = std::min<size_t>(len, data.size() - pos - 8);
+        if (!memcmp(&data[pos], "fmt ", 4) && avail >= 16) {
+            fmt = rd16(body);
+            channels = rd16(body + 2);
+            sr = (int)rd32(body + 4);
+            bits = rd16(body + 14);
+            if (fmt == 0xFFFE && avail >= 26) fmt = rd16(body + 24); // WAVE_FORMAT_EXTENSIBLE
+        } else if (!memcmp(&data[pos], "data", 4)) {
+            pcm = body;
+            pcmLen = avail;
+        }
+        pos += 8 + len + (len & 1);
+    }
+    if (!pcm || channels <= 0 || (fmt != 1 && fmt != 3)) { err = "unsupported WAV format"; return false; }
+    int bytes = bits / 8;
+    if ((fmt == 1 && (bytes < 1 || bytes > 4)) || (fmt == 3 && bytes != 4 && bytes != 8)) { err = "unsupported sample size"; return false; }
+    size_t frames = pcmLen / (size_t)(bytes * channels);
+    mono.assign(frames, 0.0);
+    for (size_t i = 0; i < frames; ++i) {
+        double acc = 0.0;
+        for (int c = 0; c < channels; ++c) {
+            const uint8_t* s = pcm + (i * channels + c) * bytes;
+            double v;
+            if (fmt == 3) {
+                if (bytes == 4) { float x; memcpy(&x, s, 4); v = x; }
+                else { double x; memcpy(&x, s, 8); v = x; }
+            } else if (bytes == 1) {
+                v = (s[0] - 128) / 128.0;
+            } else {
+                int32_t x = 0;
+                memcpy(&x, s, bytes);
+                x <<= 32 - 8 * bytes; // sign-extend
+                v = x / 2147483648.0;
+            }
+            acc += v;
+        }
+        mono[i] = acc / channels;
+    }
+    return true;
+}
+
+static int16_t toPcm16(double v) {
+    long s = lrint(v * 32767.0);
+    return (int16_t)std::max(-32768L, std::min(32767L, s));
+}
+
+static void put32(std::vector<uint8_t>& o, uint32_t v) { for (int i = 0; i < 4; ++i) o.push_back((uint8_t)(v >> (8 * i))); }
+static void put16(std::vector<uint8_t>& o, uint16_t v) { o.push_back((uint8_t)v); o.push_back((uint8_t)(v >> 8)); }
+
+// 16-bit mono WAV (what soundfile writes by default), or stereo s16le raw.
+static bool writeOutput(const std::string& path, const Buf& y, int sr, bool raw) {
+    std::vector<uint8_t> o;
+    int channels = raw ? 2 : 1;
+    uint32_t dataLen = (uint32_t)(y.size() * 2 * channels);
+    if (!raw) {
+        o.insert(o.end(), { 'R', 'I', 'F', 'F' });
+        put32(o, 36 + dataLen);
+        o.insert(o.end(), { 'W', 'A', 'V', 'E', 'f', 'm', 't', ' ' });
+        put32(o, 16);
+        put16(o, 1);
+        put16(o, (uint16_t)channels);
+        put32(o, (uint32_t)sr);
+        put32(o, (uint32_t)sr * 2 * channels);
+        put16(o, (uint16_t)(2 * channels));
+        put16(o, 16);
+        o.insert(o.end(), { 'd', 'a', 't', 'a' });
+        put32(o, dataLen);
+    }
+    o.reserve(o.size() + dataLen);
+    for (double v : y) {
+        uint16_t s = (uint16_t)toPcm16(v);
+        for (int c = 0; c < channels; ++c) put16(o, s);
+    }
+    FILE* f = fopen(path.c_str(), "wb");
+    if (!f) return false;
+    bool ok = fwrite(o.data(), 1, o.size(), f) == o.size();
+    return fclose(f) == 0 && ok;
+}
+
+// ---------------------------------------------------------------- DSP
+
+// One second-order section, transposed direct form II (scipy sosfilt)
+struct Section { double b0, b1, b2, a1, a2; };
+
+static void sosfilt(const std::vector<Section>& sos, Buf& y) {
+    const size_t n = y.size();
+    double* p = y.data();
+    for (const Section& s : sos) {
+        double z1 = 0.0, z2 = 0.0;
+        for (size_t i = 0; i < n; ++i) {
+            double x = p[i];
+            double out = s.b0 * x + z1;
+            z1 = s.b1 * x - s.a1 * out + z2;
+            z2 = s.b2 * x - s.a2 * out;
+            p[i] = out;
+        }
+    }
+}
+
+// Butterworth sections via the bilinear transform with the cutoff
+// prewarped, which is what scipy.signal.butter(..., output="sos") designs.
+static std::vector<Section> butter(int order, double fc, double sr, bool highpass) {
+    std::vector<Section> sos;
+    double w = 2.0 * M_PI * fc / sr, c = cos(w), sn = sin(w);
+    for (int k = 0; k < order / 2; ++k) {
+        double q = 1.0 / (2.0 * cos(M_PI * (2 * k + 1) / (2.0 * order)));
+        double alpha = sn / (2.0 * q), a0 = 1.0 + alpha;
+        double b0 = highpass ? (1.0 + c) / 2.0 : (1.0 - c) / 2.0;
+        double b1 = highpass ? -(1.0 + c) : 1.0 - c;
+        sos.push_back({ b0 / a0, b1 / a0, b0 / a0, -2.0 * c / a0, (1.0 - alpha) / a0 });
+    }
+    return sos;
+}
+
+static void butterBand(Buf& y, double sr, double hp, double lp, int order = 4) {
+    sosfilt(butter(order, hp, sr, true), y);
+    sosfilt(butter(order, lp, sr, false), y);
+}
+
+static Buf envelopeFollower(const Buf& y, double sr, double attackMs, double releaseMs) {
+    const size_t n = y.size();
+    Buf env(n);
+    for (size_t i = 0; i < n; ++i) env[i] = std::fabs(y[i]);
+    const double attack = exp(-1.0 / (sr * (attackMs / 1000.0)));
+    const double release = exp(-1.0 / (sr * (releaseMs / 1000.0)));
+    double e = 0.0, m = 0.0;
+    for (size_t i = 0; i < n; ++i) {
+        double v = env[i];
+        double k = v > e ? attack : release;
+        e = k * e + (1.0 - k) * v;
+        env[i] = e;
+        m = std::max(m, e);
+    }
+    const double inv = 1.0 / (m + 1e-12);
+    for (size_t i = 0; i < n; ++i) env[i] *= inv;
+    return env;
+}
+
+static Buf makeCarrier(double sr, size_t n, int seed) {
+    std::mt19937_64 rng((uint64_t)seed);
+    std::normal_distribution<double> normal(0.0, 1.0);
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+
+    Buf noise(n);
+    for (size_t i = 0; i < n; ++i) noise[i] = normal(rng);
+    butterBand(noise, sr, 180.0, 3200.0);
+
+    static const double baseFreqs[] = { 220.0, 330.0, 440.0, 660.0 };
+    Buf tones(n, 0.0);
+    for (double f : baseFreqs) {
+        double rate = 2.0 * M_PI * (0.25 + uniform(rng) * 0.35);
+        double phase0 = uniform(rng) * 6.28;
+        double w = 2.0 * M_PI * f;
+        for (size_t i = 0; i < n; ++i) {
+            double t = i / sr;
+            double drift = 1.0 + 0.03 * sin(rate * t + phase0);
+            tones[i] += sin(w * drift * t);
+        }
+    }
+    Buf carrier(n);
+    const double scale = 1.0 / (4.0 + 1e-12);
+    for (size_t i = 0; i < n; ++i) carrier[i] = 0.65 * noise[i] + 0.35 * tones[i] * scale;
+    return carrier;
+}
+
+// scipy.signal.savgol_filter(x, window, polyorder=2), mode="interp": the
+// centre is a convolution with fixed weights, the edges are evaluated from
+// a quadratic fitted to the first/last window. Only the glitch gate goes
+// through it, so the input is the gate's levels in Q1 (0, 1, 2 for
+// 0 / 0.5 / 1).
+static Buf savgol2Gate(const std::vector<int32_t>& x, int window) {
+    const size_t n = x.size();
+    const int m = window / 2;
+    Buf out(n);
+    if ((size_t)window > n) {
+        for (size_t i = 0; i < n; ++i) out[i] = x[i] * 0.5;
+        return out;
+    }
+    // Quadratic smoothing weights are (A - 15 k^2) / den, so the convolution
+    // only needs the running sums of x, k*x and k^2*x over the window:
+    // O(1) per sample instead of O(window). The sums are exact integers in
+    // int32, so nothing drifts; with levels up to 2 and window <= 501
+    // (m <= 250) the largest term, A * s0, stays under 2^30.
+    const int32_t A = 3 * (3 * m * m + 3 * m - 1);
+    const double den = 2.0 * (2.0 * m - 1) * (2.0 * m + 1) * (2.0 * m + 3); // includes the Q1 scale
+    int32_t s0 = 0, s1 = 0, s2 = 0;
+    for (int k = -m; k <= m; ++k) {
+        int32_t v = x[k + m];
+        s0 += v; s1 += k * v; s2 += k * k * v;
+    }
+    const int32_t mm = m * m, m1 = (m + 1) * (m + 1);
+    for (size_t i = m;; ++i) {
+        out[i] = (A * s0 - 15 * s2) / den;
+        if (i + m + 1 >= n) break;
+        int32_t vOut = x[i - m], vIn = x[i + m + 1];
+        // Slide the window, then re-centre the k weights on i + 1
+        s0 += vIn - vOut;
+        int32_t e1 = s1 + m * vOut + (m + 1) * vIn;
+        int32_t e2 = s2 - mm * vOut + m1 * vIn;
+        s1 = e1 - s0;
+        s2 = e2 - 2 * e1 + s0;
+    }
+    // Least-squares quadratic over a window, evaluated at its own positions
+    auto fitEdge = [&](size_t start, size_t from, size_t to) {
+        double s[5] = { 0 }, t[3] = { 0 };
+        for (int k = 0; k < window; ++k) {
+            double u = k - m, u2 = u * u, v = x[start + k] * 0.5;
+            s[0] += 1; s[1] += u; s[2] += u2; s[3] += u2 * u; s[4] += u2 * u2;
+            t[0] += v; t[1] += u * v; t[2] += u2 * v;
+        }
+        // Solve the 3x3 normal equations [s0 s1 s2; s1 s2 s3; s2 s3 s4] c = t
+        double A[3][4] = { { s[0], s[1], s[2], t[0] }, { s[1], s[2], s[3], t[1] }, { s[2], s[3], s[4], t[2] } };
+        for (int col = 0; col < 3; ++col)
+            for (int r = col + 1; r < 3; ++r) {
+                double f = A[r][col] / A[col][col];
+                for (int c2 = col; c2 < 4; ++c2) A[r][c2] -= f * A[col][c2];
+            }
+        double c[3];
+        for (int r = 2; r >= 0; --r) {
+            double v = A[r][3];
+            for (int c2 = r + 1; c2 < 3; ++c2) v -= A[r][c2] * c[c2];
+            c[r] = v / A[r][r];
+        }
+        for (size_t i = from; i < to; ++i) {
+            double u = (double)i - (double)(start + m);
+            out[i] = c[0] + c[1] * u + c[2] * u * u;
+        }
+    };
+    fitEdge(0, 0, m);
+    fitEdge(n - window, n - m, n);
+    return out;
+}
+
+static void addGlitchGates(Buf& y, double sr, double rateHz, double depth, int seed) {
+    std::mt19937_64 rng((uint64_t)seed);
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    const size_t n = y.size();
+    const double phase0 = uniform(rng) * 6.28;
+    // 0.5 * (1 + sign(sin)), kept as Q1 levels 0 / 1 / 2
+    std::vector<int32_t> lfo(n);
+    for (size_t i = 0; i < n; ++i) {
+        double s = sin(2.0 * M_PI * rateHz * (i / sr) + phase0);
+        lfo[i] = 1 + (s > 0) - (s < 0);
+    }
+    int window = n > 501 ? 501 : std::max<int>(5, (int)(n / 10) | 1);
+    Buf g = savgol2Gate(lfo, window);
+    for (size_t i = 0; i < n; ++i) y[i] *= (1.0 - depth) + depth * g[i];
+}
+
+static void bitcrush(Buf& y, int bits) {
+    const double half = std::ldexp(1.0, bits - 1);
+    const double inv = 1.0 / half;
+    // nearbyint rounds half to even, like np.round
+    for (double& v : y) v = std::nearbyint(v * half) * inv;
+}
+
+static void sampleHold(Buf& y, int factor) {
+    if (factor <= 1) return;
+    for (size_t i = 0; i < y.size(); ++i) y[i] = y[i - i % factor];
+}
+
+static void normalize(Buf& y, double headroomDb = 1.0) {
+    double peak = 0.0;
+    for (double v : y) peak = std::max(peak, std::fabs(v));
+    const double g = pow(10.0, -headroomDb / 20.0) / (peak + 1e-12);
+    for (double& v : y) v *= g;
+}
+
+static Buf strayGibberish(const Buf& y, double sr, const Options& o) {
+    Buf env = envelopeFollower(y, sr, o.attack, o.release);
+    Buf out = makeCarrier(sr, y.size(), o.seed);
+    for (size_t i = 0; i < out.size(); ++i) out[i] *= pow(env[i], 1.15);
+    addGlitchGates(out, sr, o.glitch_rate, o.glitch_depth, o.seed + 10);
+    butterBand(out, sr, o.hp, o.lp);
+    bitcrush(out, o.bits);
+    sampleHold(out, o.hold);
+    normalize(out, 1.0);
+    return out;
+}
+
+// ---------------------------------------------------------------- CLI
+
+static bool processFile(const std::string& in, const std::string& out, const Options& o, bool quiet) {
+    Buf y;
+    int sr = 0;
+    std::string err;
+    if (!readWav(in, y, sr, err)) {
+        fprintf(stderr, "%s: %s\n", in.c_str(), err.c_str());
+        return false;
+    }
+    if (o.raw && sr != 44100) fprintf(stderr, "%s: warning: %d Hz input, --raw output is not 44.1 kHz\n", in.c_str(), sr);
+    Buf res = strayGibberish(y, sr, o);
+    if (!writeOutput(out, res, sr, o.raw)) {
+        fprintf(stderr, "%s: cannot write\n", out.c_str());
+        return false;
+    }
+    if (!quiet) printf("Wrote: %s\n", out.c_str());
+    return true;
+}
+
+static void usage() {
+    fprintf(stderr,
+            "usage: gibberish input_wav output_wav [options]\n"
+            "       gibberish input_dir output_dir [--jobs N] [options]\n"
+            "options: --attack MS --release MS --seed N --hp HZ --lp HZ --bits N --hold N\n"
+            "         --glitch_rate HZ --glitch_depth X --raw\n");
+}
+
+int main(int argc, char** argv) {
+    Options o;
+    std::vector<std::string> pos;
+    for (int i = 1; i < argc; ++i) {
+        std::string a = argv[i];
+        auto next = [&](void) -> const char* {
+            if (i + 1 >= argc) { usage(); exit(2); }
+            return argv[++i];
+        };
+        if (a == "--attack") o.attack = atof(next());
+        else if (a == "--release") o.release = atof(next());
+        else if (a == "--seed") o.seed = atoi(next());
+        else if (a == "--hp") o.hp = atof(next());
+        else if (a == "--lp") o.lp = atof(next());
+        else if (a == "--bits") o.bits = atoi(next());
+        else if (a == "--hold") o.hold = atoi(next());
+        else if (a == "--glitch_rate") o.glitch_rate = atof(next());
+        else if (a == "--glitch_depth") o.glitch_depth = atof(next());
+        else if (a == "--jobs") o.jobs = atoi(next());
+        else if (a == "--raw") o.raw = true;
+        else if (a == "-h" || a == "--help") { usage(); return 0; }
+        else if (a.size() > 1 && a[0] == '-' && a[1] == '-') { usage(); return 2; }
+        else pos.push_back(a);
+    }
+    if (pos.size() != 2) { usage(); return 2; }
+
+    if (!fs::is_directory(pos[0])) return processFile(pos[0], pos[1], o, false) ? 0 : 1;
+
+    // Directory mode: every .wav in input_dir (non-recursive), same names
+    std::vector<fs::path> inputs;
+    for (const auto& e : fs::directory_iterator(pos[0])) {
+        std::string ext = e.path().extension().string();
+        std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+        if (e.is_regular_file() && ext == ".wav") inputs.push_back(e.path());
+    }
+    std::sort(inputs.begin(), inputs.end());
+    fs::create_directories(pos[1]);
+
+    int jobs = o.jobs > 0 ? o.jobs : (int)std::max(1u, std::thread::hardware_concurrency());
+    std::atomic<size_t> next(0);
+    std::atomic<int> failed(0);
+    auto t0 = std::chrono::steady_clock::now();
+    std::vector<std::thread> pool;
+    for (int j = 0; j < jobs; ++j) {
+        pool.emplace_back([&]() {
+            for (size_t k; (k = next++) < inputs.size();) {
+                fs::path out = fs::path(pos[1]) / inputs[k].filename();
+                if (o.raw) out.replace_extension(".raw");
+                if (!processFile(inputs[k].string(), out.string(), o, true)) failed++;
+            }
+        });
+    }
+    for (auto& t : pool) t.join();
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    printf("Processed %zu files (%d failed) in %.2f s with %d threads\n", inputs.size(), failed.load(), secs, jobs);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,283 @@
+#!/usr/bin/env python3
+"""Pack audio clips into one IMA-ADPCM blob for the ESP sketches.
+
+Usage:
+  python pack_audio.py S0.raw --raw-channels 1 -o ../../ESP8266_PLAY_RAW_TO_AMPLIFIER_SPEAKER/data/audio_pack.bin
+  python pack_audio.py robot.wav beep.wav -o data/sound_pack.bin --asm src/sound_pack.S
+
+Replaces the hex arrays written by convert_raw_to_h.py. Every clip is
+encoded as 4-bit IMA-ADPCM (about 4:1 against 16-bit PCM) in standard
+WAV/DVI blocks, so the device decodes one block at a time with a few
+hundred bytes of state. The blob is either uploaded to the SPIFFS/LittleFS
+partition (clips can then be swapped without recompiling) or linked into
+the firmware with the optional `.incbin` stub.
+
+Inputs are 16-bit .wav files, or headerless s16le .raw files described by
+--raw-rate/--raw-channels (defaults match convert_wavs_to_raw.py; S0.raw is
+mono, so it needs --raw-channels 1). A .raw file whose size is not a whole
+number of frames is rejected rather than guessed at.
+
+Blob layout (little endian):
+  header  16 bytes  "ADPK", u16 version, u16 clip count, u32 blob size, u32 0
+  index   32 bytes per clip
+          char name[16], u32 sample rate, u32 frames, u32 data offset,
+          u16 block bytes (all channels), u8 channels, u8 0
+  data    per clip, 4-byte aligned, whole blocks (last one zero padded)
+"""
+from pathlib import Path
+import argparse
+import array
+import math
+import re
+import struct
+import sys
+import wave
+
+MAGIC = b"ADPK"
+VERSION = 1
+HEADER = struct.Struct("<4sHHII")
+ENTRY = struct.Struct("<16sIIIHBB")
+
+INDEX_TABLE = [-1, -1, -1, -1, 2, 4, 6, 8]
+STEP_TABLE = [
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+    50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230,
+    253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963,
+    1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024, 3327,
+    3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442,
+    11487, 12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794,
+    32767,
+]
+
+
+class Channel:
+    """Encoder state for one channel; mirrors the device decoder exactly."""
+
+    def __init__(self):
+        self.pred = 0
+        self.index = 0
+
+    def encode(self, sample):
+        step = STEP_TABLE[self.index]
+        diff = sample - self.pred
+        code = 0
+        if diff < 0:
+            code = 8
+            diff = -diff
+        delta = step >> 3
+        if diff >= step:
+            code |= 4
+            diff -= step
+            delta += step
+        if diff >= step >> 1:
+            code |= 2
+            diff -= step >> 1
+            delta += step >> 1
+        if diff >= step >> 2:
+            code |= 1
+            delta += step >> 2
+        self.pred = self.pred - delta if code & 8 else self.pred + delta
+        self.pred = max(-32768, min(32767, self.pred))
+        self.index = max(0, min(88, self.index + INDEX_TABLE[code & 7]))
+        return code
+
+    def decode(self, code):
+        step = STEP_TABLE[self.index]
+        delta = step >> 3
+        if code & 4:
+            delta += step
+        if code & 2:
+            delta += step >> 1
+        if code & 1:
+            delta += step >> 2
+        self.pred = self.pred - delta if code & 8 else self.pred + delta
+        self.pred = max(-32768, min(32767, self.pred))
+        self.index = max(0, min(88, self.index + INDEX_TABLE[code & 7]))
+        return self.pred
+
+
+def frames_per_block(block_bytes, channels):
+    return (block_bytes // channels - 4) * 2 + 1
+
+
+def encode_clip(pcm, channels, block_bytes):
+    """pcm: interleaved int16 samples. Returns the encoded block stream."""
+    frames = len(pcm) // channels
+    per_block = frames_per_block(block_bytes, channels)
+    state = [Channel() for _ in range(channels)]
+    out = bytearray()
+    for start in range(0, frames, per_block):
+        block = bytearray()
+        for ch in range(channels):
+            first = pcm[start * channels + ch]
+            state[ch].pred = first
+            block += struct.pack("<hBB", first, state[ch].index, 0)
+        # Remaining frames go out in groups of 8 per channel, 4 bytes each
+        body = per_block - 1
+        for group in range(0, body, 8):
+            for ch in range(channels):
+                codes = []
+                for k in range(8):
+                    f = start + 1 + group + k
+                    s = pcm[f * channels + ch] if f < frames else state[ch].pred
+                    codes.append(state[ch].encode(s))
+                for k in range(0, 8, 2):
+                    block.append(codes[k] | (codes[k + 1] << 4))
+        out += block
+    return bytes(out)
+
+
+def decode_clip(data, channels, block_bytes, frames):
+    """Reference decoder, used for --check and --decode."""
+    per_block = frames_per_block(block_bytes, channels)
+    pcm = array.array("h")
+    for off in range(0, len(data), block_bytes):
+        block = data[off:off + block_bytes]
+        state = [Channel() for _ in range(channels)]
+        out = [[] for _ in range(channels)]
+        for ch in range(channels):
+            pred, index, _ = struct.unpack_from("<hBB", block, ch * 4)
+            state[ch].pred = pred
+            state[ch].index = min(index, 88)
+            out[ch].append(pred)
+        pos = channels * 4
+        while pos < len(block):
+            for ch in range(channels):
+                for b in block[pos:pos + 4]:
+                    out[ch].append(state[ch].decode(b & 0x0F))
+                    out[ch].append(state[ch].decode(b >> 4))
+                pos += 4
+        for i in range(per_block):
+            for ch in range(channels):
+                pcm.append(out[ch][i])
+    del pcm[frames * channels:]
+    return pcm
+
+
+def load_clip(path, raw_rate, raw_channels):
+    if path.suffix.lower() == ".wav":
+        with wave.open(str(path), "rb") as w:
+            if w.getsampwidth() != 2:
+                raise ValueError(f"{path}: only 16-bit PCM WAV is supported")
+            rate, channels = w.getframerate(), w.getnchannels()
+            data = w.readframes(w.getnframes())
+    else:
+        rate, channels = raw_rate, raw_channels
+        data = path.read_bytes()
+        if len(data) % (2 * channels):
+            raise ValueError(f"{path}: {len(data)} bytes is not a whole number of "
+                             f"{channels}-channel s16le frames (check --raw-channels)")
+    pcm = array.array("h")
+    pcm.frombytes(data[:len(data) // (2 * channels) * 2 * channels])
+    if sys.byteorder == "big":
+        pcm.byteswap()
+    if channels > 2:
+        raise ValueError(f"{path}: {channels} channels, only mono/stereo supported")
+    return rate, channels, pcm
+
+
+def clip_name(path):
+    name = re.sub(r"[^A-Za-z0-9_]", "_", path.stem)
+    return name[:15]
+
+
+def snr_db(ref, test):
+    sig = sum(s * s for s in ref) or 1
+    err = sum((a - b) * (a - b) for a, b in zip(ref, test)) or 1
+    return 10 * math.log10(sig / err)
+
+
+def write_asm(asm_path, blob_path, symbol, section):
+    header_path = asm_path.with_suffix(".h")
+    asm_path.write_text(
+        f"/* Generated by pack_audio.py. Links {blob_path.name} into flash. */\n"
+        f"    .section {section},\"a\"\n"
+        f"    .balign 4\n"
+        f"    .global {symbol}\n"
+        f"{symbol}:\n"
+        f"    .incbin \"{blob_path.as_posix()}\"\n"
+        f"    .global {symbol}_end\n"
+        f"{symbol}_end:\n",
+        encoding="utf-8",
+    )
+    header_path.write_text(
+        "#pragma once\n"
+        "#include <stdint.h>\n\n"
+        f"// Generated by pack_audio.py: blob linked by {asm_path.name}\n"
+        f"extern \"C\" const uint8_t {symbol}[];\n"
+        f"extern \"C\" const uint8_t {symbol}_end[];\n",
+        encoding="utf-8",
+    )
+    print(f"Wrote: {asm_path} and {header_path}")
+
+
+def main() -> int:
+    p = argparse.ArgumentParser(description="Pack audio clips into an IMA-ADPCM blob")
+    p.add_argument("inputs", nargs="+", type=Path, help=".wav or s16le .raw clips")
+    p.add_argument("-o", "--output", type=Path, required=True, help="Blob to write (.bin)")
+    p.add_argument("--raw-rate", type=int, default=44100, help="Sample rate of .raw inputs")
+    p.add_argument("--raw-channels", type=int, default=2, choices=(1, 2), help="Channels of .raw inputs")
+    p.add_argument("--block", type=int, default=512, help="Block bytes per channel (multiple of 4)")
+    p.add_argument("--asm", type=Path, help="Also write an .incbin stub (.S) and matching .h")
+    p.add_argument("--symbol", default="audio_pack", help="Symbol name used by --asm")
+    p.add_argument("--section", default=".rodata.audio_pack",
+                   help="Section for --asm (use .irom.text.audio_pack on ESP8266)")
+    p.add_argument("--check", action="store_true", help="Decode again and print the SNR per clip")
+    p.add_argument("--decode", type=Path, help="Write the decoded clips as WAVs into this folder")
+    args = p.parse_args()
+
+    if args.block < 8 or args.block % 4:
+        print("--block must be a multiple of 4 and at least 8", file=sys.stderr)
+        return 2
+
+    clips = []
+    for path in args.inputs:
+        try:
+            rate, channels, pcm = load_clip(path, args.raw_rate, args.raw_channels)
+        except ValueError as e:
+            print(e, file=sys.stderr)
+            return 2
+        data = encode_clip(pcm, channels, args.block * channels)
+        clips.append((clip_name(path), rate, channels, pcm, data))
+
+    offset = HEADER.size + ENTRY.size * len(clips)
+    index = bytearray()
+    body = bytearray()
+    for name, rate, channels, pcm, data in clips:
+        pad = (-(offset + len(body))) % 4
+        body += b"\0" * pad
+        index += ENTRY.pack(name.encode(), rate, len(pcm) // channels, offset + len(body),
+                            args.block * channels, channels, 0)
+        body += data
+    total = offset + len(body)
+    blob = HEADER.pack(MAGIC, VERSION, len(clips), total, 0) + index + body
+
+    args.output.parent.mkdir(parents=True, exist_ok=True)
+    args.output.write_bytes(blob)
+    pcm_bytes = sum(len(c[3]) * 2 for c in clips)
+    print(f"Wrote: {args.output} ({len(clips)} clips, {total} bytes, {pcm_bytes / total:.2f}:1 vs PCM)")
+
+    for name, rate, channels, pcm, data in clips:
+        line = f"  {name}: {rate} Hz, {channels} ch, {len(pcm) // channels} frames, {len(data)} bytes"
+        if args.check or args.decode:
+            dec = decode_clip(data, channels, args.block * channels, len(pcm) // channels)
+            if args.check:
+                line += f", SNR {snr_db(pcm, dec):.1f} dB"
+            if args.decode:
+                args.decode.mkdir(parents=True, exist_ok=True)
+                with wave.open(str(args.decode / f"{name}.wav"), "wb") as w:
+                    w.setnchannels(channels)
+                    w.setsampwidth(2)
+                    w.setframerate(rate)
+                    if sys.byteorder == "big":
+                        dec.byteswap()
+                    w.writeframes(dec.tobytes())
+        print(line)
+
+    if args.asm:
+        write_asm(args.asm, args.output, args.symbol, args.section)
+    return 0
+
+
+if __name__ == "__main__":
+    raise SystemExit(main())
@@ -1,18 +1,37 @@
 #include <Arduino.h>
 
-#include "AudioFileSourceSPIFFS.h"
+#include <FS.h>
 #include "AudioGeneratorMP3.h"
-#include "AudioOutputI2SNoDAC.h"
+#include "audio_pack.h"
+#include "readahead_source.h"
+#include "sigma_delta_output.h"
 
-AudioGeneratorMP3 *mp3;
-AudioFileSourceSPIFFS *file;
-AudioOutputI2SNoDAC *out;
+// 1 = play clip S0 from /audio_pack.bin (IMA-ADPCM, built by
+// DeskCompanionScripts/voice_droid_effect/pack_audio.py and uploaded from
+// data/), 0 = decode /S0.mp3
+#define PLAY_AUDIO_PACK 1
+
+#if PLAY_AUDIO_PACK
+const char *AUDIO_PATH = "/audio_pack.bin";
+#else
+const char *AUDIO_PATH = "/S0.mp3";
+#endif
+
+AudioGenerator *player;
+AudioFileSourceReadAhead *file;
+AudioOutputI2SSigmaDelta *out;
+
+// Flash is read 1 KB at a time from loop(), never from inside the decoder
+static uint8_t sourceRing[8192];
 
 // ===== LED =====
 const int LED_PIN = 2;   // D4, built-in LED (active LOW)
 unsigned long lastBlink = 0;
 bool ledState = false;
 
+const unsigned long STATS_MS = 5000;
+unsigned long lastStats = 0;
+
 void setup() {
   Serial.begin(115200);
 
@@ -29,24 +48,33 @@ void setup() {
 
   Serial.println("Setting up audio...");
 
-  out = new AudioOutputI2SNoDAC();
+  out = new AudioOutputI2SSigmaDelta();
   out->SetPinout(
     14, // BCLK  D5
     15, // LRC   D8
     13  // DIN   D7
   );
-  out->SetGain(0.5);
+  out->SetGain(0.5); // folded into the modulator, no per-sample multiply
 
-  file = new AudioFileSourceSPIFFS("/S0.mp3");
-  mp3  = new AudioGeneratorMP3();
+  file = new AudioFileSourceReadAhead(SPIFFS, sourceRing, sizeof(sourceRing));
+  file->open(AUDIO_PATH);
+  file->fill(sizeof(sourceRing));
+
+#if PLAY_AUDIO_PACK
+  AudioGeneratorAdpcmPack *pack = new AudioGeneratorAdpcmPack();
+  pack->selectClip("S0");
+  player = pack;
+#else
+  player = new AudioGeneratorMP3();
+#endif
 
   if (!file->isOpen()) {
-    Serial.println("MP3 file NOT open!");
+    Serial.println("Audio file NOT open!");
   } else {
-    Serial.println("MP3 file opened");
+    Serial.println("Audio file opened");
   }
 
-  mp3->begin(file, out);
+  player->begin(file, out);
   Serial.println("Playback started");
 }
 
@@ -60,12 +88,22 @@ void loop() {
   }
 
   // ===== Audio loop =====
-  if (mp3->isRunning()) {
-    mp3->loop();
+  if (player->isRunning()) {
+    player->loop(); // also tops up the read-ahead ring
   } else {
-    mp3->stop();
+    player->stop();
     Serial.println("Playback ended, restarting...");
     delay(1000);
-    mp3->begin(file, out);
+    if (!file->isOpen()) file->open(AUDIO_PATH); // the MP3 decoder closes it on stop()
+    player->begin(file, out);
+  }
+
+  // ===== Read-ahead stats =====
+  if (now - lastStats >= STATS_MS) {
+    lastStats = now;
+    const ReadAheadStats &s = file->stats();
+    Serial.printf("Source: refills=%u (%u KB) underruns=%u min level=%u B slowest read=%u us\n",
+                  s.refills, s.refillBytes / 1024, s.underruns, s.minLevel, s.maxRefillUs);
+    file->resetStats();
   }
 }
@@ -0,0 +1,178 @@
+#include "audio_pack.h"
+
+static const uint32_t PACK_MAGIC = 0x4B504441; // "ADPK"
+static const uint16_t PACK_VERSION = 1;
+static const uint8_t PACK_HEADER_BYTES = 16;
+static const uint8_t PACK_ENTRY_BYTES = 32;
+
+static const int8_t kIndexTable[8] = {-1, -1, -1, -1, 2, 4, 6, 8};
+static const int16_t kStepTable[89] = {
+  7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+  50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230,
+  253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963,
+  1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024, 3327,
+  3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442,
+  11487, 12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794,
+  32767
+};
+
+static inline uint16_t rd16(const uint8_t *p) { return p[0] | (p[1] << 8); }
+static inline uint32_t rd32(const uint8_t *p) { return rd16(p) | ((uint32_t)rd16(p + 2) << 16); }
+
+static inline int16_t decodeNibble(uint8_t code, int32_t &pred, int8_t &index) {
+  int32_t step = kStepTable[index];
+  int32_t delta = step >> 3;
+  if (code & 4) delta += step;
+  if (code & 2) delta += step >> 1;
+  if (code & 1) delta += step >> 2;
+  pred += (code & 8) ? -delta : delta;
+  if (pred > 32767) pred = 32767;
+  else if (pred < -32768) pred = -32768;
+  index += kIndexTable[code & 7];
+  if (index < 0) index = 0;
+  else if (index > 88) index = 88;
+  return (int16_t)pred;
+}
+
+AudioGeneratorAdpcmPack::AudioGeneratorAdpcmPack()
+  : clipCount_(0), wantIndex_(0), framesLeft_(0), blockLen_(0), blockPos_(0),
+    groupLen_(0), groupPos_(0) {
+  running = false;
+  file = nullptr;
+  output = nullptr;
+  wantName_[0] = '\0';
+  memset(&clip_, 0, sizeof(clip_));
+}
+
+AudioGeneratorAdpcmPack::~AudioGeneratorAdpcmPack() {
+  if (running) stop();
+}
+
+void AudioGeneratorAdpcmPack::selectClip(uint16_t index) {
+  wantIndex_ = index;
+  wantName_[0] = '\0';
+}
+
+void AudioGeneratorAdpcmPack::selectClip(const char *name) {
+  strncpy(wantName_, name ? name : "", sizeof(wantName_) - 1);
+  wantName_[sizeof(wantName_) - 1] = '\0';
+}
+
+// Finds the selected clip in the pack index and leaves the source at its data
+bool AudioGeneratorAdpcmPack::readIndex() {
+  uint8_t hdr[PACK_ENTRY_BYTES];
+  if (!file->seek(0, SEEK_SET) || file->read(hdr, PACK_HEADER_BYTES) != PACK_HEADER_BYTES) return false;
+  if (rd32(hdr) != PACK_MAGIC || rd16(hdr + 4) != PACK_VERSION) return false;
+  clipCount_ = rd16(hdr + 6);
+
+  for (uint16_t i = 0; i < clipCount_; i++) {
+    if (file->read(hdr, PACK_ENTRY_BYTES) != PACK_ENTRY_BYTES) return false;
+    bool match = wantName_[0] ? strncmp((const char *)hdr, wantName_, 16) == 0 : i == wantIndex_;
+    if (!match) continue;
+    memcpy(clip_.name, hdr, 16);
+    clip_.name[16] = '\0';
+    clip_.rate = rd32(hdr + 16);
+    clip_.frames = rd32(hdr + 20);
+    clip_.offset = rd32(hdr + 24);
+    clip_.blockBytes = rd16(hdr + 28);
+    clip_.channels = hdr[30];
+    if (clip_.channels < 1 || clip_.channels > 2) return false;
+    if (clip_.blockBytes > MAX_BLOCK_BYTES || clip_.blockBytes < 8 * clip_.channels) return false;
+    return file->seek(clip_.offset, SEEK_SET);
+  }
+  return false;
+}
+
+// Loads the next block and yields its header sample as a one-frame group
+bool AudioGeneratorAdpcmPack::readBlock() {
+  uint8_t ch = clip_.channels;
+  blockLen_ = file->read(block_, clip_.blockBytes);
+  if (blockLen_ < 4 * ch) return false;
+  for (uint8_t c = 0; c < ch; c++) {
+    const uint8_t *h = block_ + 4 * c;
+    pred_[c] = (int16_t)rd16(h);
+    step_[c] = h[2] > 88 ? 88 : h[2];
+    group_[0][c] = (int16_t)pred_[c];
+  }
+  if (ch == 1) group_[0][1] = group_[0][0];
+  blockPos_ = 4 * ch;
+  groupLen_ = 1;
+  groupPos_ = 0;
+  return true;
+}
+
+// Decodes the next 8 frames: 4 bytes per channel, low nibble first
+bool AudioGeneratorAdpcmPack::nextGroup() {
+  uint8_t ch = clip_.channels;
+  if (blockPos_ + 4 * ch > blockLen_) return readBlock();
+  for (uint8_t c = 0; c < ch; c++) {
+    const uint8_t *p = block_ + blockPos_ + 4 * c;
+    for (uint8_t k = 0; k < 4; k++) {
+      group_[2 * k][c] = decodeNibble(p[k] & 0x0F, pred_[c], step_[c]);
+      group_[2 * k + 1][c] = decodeNibble(p[k] >> 4, pred_[c], step_[c]);
+    }
+  }
+  if (ch == 1) {
+    for (uint8_t k = 0; k < 8; k++) group_[k][1] = group_[k][0];
+  }
+  blockPos_ += 4 * ch;
+  groupLen_ = 8;
+  groupPos_ = 0;
+  return true;
+}
+
+bool AudioGeneratorAdpcmPack::nextFrame() {
+  if (framesLeft_ == 0) return false;
+  if (groupPos_ >= groupLen_ && !nextGroup()) return false;
+  lastSample[AudioOutput::LEFTCHANNEL] = group_[groupPos_][0];
+  lastSample[AudioOutput::RIGHTCHANNEL] = group_[groupPos_][1];
+  groupPos_++;
+  framesLeft_--;
+  return true;
+}
+
+bool AudioGeneratorAdpcmPack::begin(AudioFileSource *source, AudioOutput *output) {
+  if (!source || !output || !source->isOpen()) return false;
+  file = source;
+  this->output = output;
+  if (!readIndex()) {
+    Serial.println("AudioPack: bad pack or clip not found");
+    return false;
+  }
+
+  framesLeft_ = clip_.frames;
+  groupLen_ = 0;
+  groupPos_ = 0;
+  blockLen_ = 0;
+  blockPos_ = 0;
+  if (!nextFrame()) return false;
+
+  output->SetRate(clip_.rate);
+  output->SetBitsPerSample(16);
+  output->SetChannels(clip_.channels);
+  if (!output->begin()) return false;
+  running = true;
+  return true;
+}
+
+bool AudioGeneratorAdpcmPack::loop() {
+  if (!file || !output) return false;
+  if (running) {
+    // lastSample always holds the next frame still owed to the output
+    while (output->ConsumeSample(lastSample)) {
+      if (!nextFrame()) {
+        running = false;
+        break;
+      }
+    }
+  }
+  file->loop();
+  output->loop();
+  return running;
+}
+
+bool AudioGeneratorAdpcmPack::stop() {
+  running = false;
+  if (output) output->stop();
+  return true;
+}
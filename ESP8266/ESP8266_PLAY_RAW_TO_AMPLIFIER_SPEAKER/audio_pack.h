@@ -0,0 +1,66 @@
+// Streaming player for the IMA-ADPCM clip packs written by
+// DeskCompanionScripts/voice_droid_effect/pack_audio.py.
+//
+// The pack is read through any AudioFileSource: AudioFileSourceSPIFFS for a
+// blob uploaded to the filesystem partition, or AudioFileSourcePROGMEM over
+// the symbols of a blob linked with the generated `.incbin` stub. One block
+// (512 bytes per channel by default) is read at a time and decoded 8 frames
+// at a time, so the whole decoder needs about 2.5 KB of RAM.
+#ifndef AUDIO_PACK_H
+#define AUDIO_PACK_H
+
+#include <Arduino.h>
+#include "AudioGenerator.h"
+
+struct AudioPackClip {
+  char name[17];
+  uint32_t rate;
+  uint32_t frames;
+  uint32_t offset;
+  uint16_t blockBytes;
+  uint8_t channels;
+};
+
+class AudioGeneratorAdpcmPack : public AudioGenerator {
+public:
+  static const uint16_t MAX_BLOCK_BYTES = 2048;
+
+  AudioGeneratorAdpcmPack();
+  virtual ~AudioGeneratorAdpcmPack() override;
+
+  // Clip played by the next begin(). Defaults to the first clip.
+  void selectClip(uint16_t index);
+  void selectClip(const char *name);
+
+  // Valid after a successful begin()
+  uint16_t clipCount() const { return clipCount_; }
+  const AudioPackClip &clip() const { return clip_; }
+
+  virtual bool begin(AudioFileSource *source, AudioOutput *output) override;
+  virtual bool loop() override;
+  virtual bool stop() override;
+  virtual bool isRunning() override { return running; }
+
+private:
+  bool readIndex();
+  bool readBlock();
+  bool nextGroup();
+  bool nextFrame();
+
+  uint16_t clipCount_;
+  uint16_t wantIndex_;
+  char wantName_[17];
+  AudioPackClip clip_;
+
+  uint32_t framesLeft_;   // clip frames not yet handed to lastSample
+  uint16_t blockLen_;     // valid bytes in block_
+  uint16_t blockPos_;     // next nibble group in block_
+  uint8_t groupLen_;      // decoded frames in group_
+  uint8_t groupPos_;
+  int32_t pred_[2];
+  int8_t step_[2];
+  int16_t group_[8][2];
+  uint8_t block_[MAX_BLOCK_BYTES];
+};
+
+#endif
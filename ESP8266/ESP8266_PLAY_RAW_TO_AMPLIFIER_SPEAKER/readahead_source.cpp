@@ -0,0 +1,117 @@
+#include "readahead_source.h"
+
+// Keeps each loop() pass short; 2 KB is ~60 ms of 256 kbps MP3
+static const uint32_t LOOP_FILL_BYTES = 2 * AudioFileSourceReadAhead::REFILL;
+
+AudioFileSourceReadAhead::AudioFileSourceReadAhead(fs::FS &fs, uint8_t *buf, uint32_t capacity)
+  : fs_(fs), buf_(buf), mask_(capacity - 1), pos_(0), end_(0), size_(0) {
+  resetStats();
+}
+
+AudioFileSourceReadAhead::~AudioFileSourceReadAhead() {
+  close();
+}
+
+bool AudioFileSourceReadAhead::open(const char *filename) {
+  close();
+  f_ = fs_.open(filename, "r");
+  if (!f_) return false;
+  size_ = f_.size();
+  return true;
+}
+
+bool AudioFileSourceReadAhead::close() {
+  if (f_) f_.close();
+  pos_ = 0;
+  end_ = 0;
+  size_ = 0;
+  return true;
+}
+
+bool AudioFileSourceReadAhead::isOpen() {
+  return (bool)f_;
+}
+
+uint32_t AudioFileSourceReadAhead::getSize() {
+  return size_;
+}
+
+uint32_t AudioFileSourceReadAhead::getPos() {
+  return pos_;
+}
+
+void AudioFileSourceReadAhead::resetStats() {
+  memset(&stats_, 0, sizeof(stats_));
+  stats_.minLevel = mask_ + 1;
+}
+
+// One flash read up to the next REFILL boundary, if it fits in the ring
+uint32_t AudioFileSourceReadAhead::refillOnce() {
+  if (!f_ || end_ >= size_) return 0;
+  uint32_t n = REFILL - (end_ & (REFILL - 1));
+  if (n > size_ - end_) n = size_ - end_;
+  if ((end_ - pos_) + n > mask_ + 1) return 0;
+  if (f_.position() != end_ && !f_.seek(end_, SeekSet)) return 0;
+
+  uint32_t t0 = micros();
+  uint32_t got = f_.read(buf_ + (end_ & mask_), n);
+  uint32_t us = micros() - t0;
+
+  end_ += got;
+  stats_.refills++;
+  stats_.refillBytes += got;
+  if (us > stats_.maxRefillUs) stats_.maxRefillUs = us;
+  return got;
+}
+
+uint32_t AudioFileSourceReadAhead::fill(uint32_t maxBytes) {
+  uint32_t total = 0;
+  while (total < maxBytes) {
+    uint32_t got = refillOnce();
+    if (!got) break;
+    total += got;
+  }
+  return total;
+}
+
+bool AudioFileSourceReadAhead::loop() {
+  fill(LOOP_FILL_BYTES);
+  return true;
+}
+
+uint32_t AudioFileSourceReadAhead::read(void *data, uint32_t len) {
+  uint8_t *dst = (uint8_t *)data;
+  uint32_t done = 0;
+  if (end_ - pos_ < stats_.minLevel) stats_.minLevel = end_ - pos_;
+  if (len > size_ - pos_) len = size_ - pos_;
+
+  while (done < len) {
+    if (end_ == pos_) {
+      stats_.underruns++;
+      if (!refillOnce()) break;
+    }
+    uint32_t off = pos_ & mask_;
+    uint32_t n = end_ - pos_;
+    if (n > len - done) n = len - done;
+    if (n > mask_ + 1 - off) n = mask_ + 1 - off;
+    memcpy(dst + done, buf_ + off, n);
+    done += n;
+    pos_ += n;
+  }
+  return done;
+}
+
+bool AudioFileSourceReadAhead::seek(int32_t pos, int dir) {
+  int32_t target = pos;
+  if (dir == SEEK_CUR) target += pos_;
+  else if (dir == SEEK_END) target += size_;
+  if (target < 0 || (uint32_t)target > size_) return false;
+
+  if ((uint32_t)target >= pos_ && (uint32_t)target <= end_) {
+    pos_ = target; // still buffered: just skip ahead
+  } else {
+    pos_ = target;
+    end_ = target;
+  }
+  return true;
+}
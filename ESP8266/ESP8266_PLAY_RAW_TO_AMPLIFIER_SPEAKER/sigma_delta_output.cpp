@@ -0,0 +1,76 @@
+#include "sigma_delta_output.h"
+#include <i2s.h>
+
+static const int32_t ONE_BIT = 1 << 16;        // acc_ units per output one
+static const int32_t FULL_WORD = 32 * ONE_BIT; // all 32 bits set
+
+AudioOutputI2SSigmaDelta::AudioOutputI2SSigmaDelta()
+  : AudioOutputI2SNoDAC(), gainQ12_(4096), acc_(0), stageLen_(0), stageSent_(0) {
+  for (int k = 0; k <= 32; k++) {
+    uint32_t bits = 0;
+    for (int i = 0; i < 32; i++) {
+      bits <<= 1;
+      if (((i + 1) * k) / 32 != (i * k) / 32) bits |= 1; // Bresenham spread
+    }
+    pattern_[k] = bits;
+  }
+}
+
+bool AudioOutputI2SSigmaDelta::SetGain(float f) {
+  if (f > 4.0f) f = 4.0f;
+  if (f < 0.0f) f = 0.0f;
+  gainQ12_ = (int32_t)(f * 4096.0f + 0.5f);
+  return AudioOutputI2SNoDAC::SetGain(f);
+}
+
+// Hands staged words to the DMA ring without blocking
+bool AudioOutputI2SSigmaDelta::flushStage() {
+  while (stageSent_ < stageLen_) {
+    uint16_t n = i2s_write_buffer_nb(stage_ + 2 * stageSent_, stageLen_ - stageSent_);
+    if (!n) return false;
+    stageSent_ += n;
+  }
+  stageLen_ = 0;
+  stageSent_ = 0;
+  return true;
+}
+
+bool AudioOutputI2SSigmaDelta::ConsumeSample(int16_t sample[2]) {
+  int words = oversample / 32;
+  if (stageLen_ + words > STAGE_WORDS && !flushStage()) return false; // DMA full
+
+  int16_t ms[2] = {sample[0], sample[1]};
+  MakeSampleStereo16(ms);
+  int32_t mono = ((int32_t)ms[0] + ms[1]) >> 1;
+
+  // Density of ones for this sample, gain applied, in acc_ units per word:
+  // (mono * gain + 32768) / 65536 * 32 ones
+  int32_t inc = ((mono * gainQ12_) >> 7) + FULL_WORD / 2;
+  if (inc < 0) inc = 0;
+  else if (inc > FULL_WORD) inc = FULL_WORD;
+
+  for (int w = 0; w < words; w++) {
+    acc_ += inc;
+    uint32_t k = acc_ >> 16;
+    acc_ &= ONE_BIT - 1;
+    uint32_t bits = pattern_[k];
+    stage_[2 * stageLen_] = (int16_t)(bits >> 16);
+    stage_[2 * stageLen_ + 1] = (int16_t)(bits & 0xFFFF);
+    stageLen_++;
+  }
+  if (stageLen_ + words > STAGE_WORDS) flushStage();
+  return true;
+}
+
+bool AudioOutputI2SSigmaDelta::loop() {
+  flushStage(); // don't let a partial batch wait for the next sample
+  return AudioOutputI2SNoDAC::loop();
+}
+
+bool AudioOutputI2SSigmaDelta::stop() {
+  flushStage();
+  stageLen_ = 0;
+  stageSent_ = 0;
+  acc_ = 0;
+  return AudioOutputI2SNoDAC::stop();
+}
@@ -0,0 +1,44 @@
+// Table-driven replacement for AudioOutputI2SNoDAC's delta-sigma stage.
+//
+// The stock output runs a first-order modulator one bit at a time: 32
+// compare/add steps per 32x-oversampled sample. For a first-order
+// modulator the number of ones in each 32-bit word only depends on the
+// input level and the carried error, so this version updates the error once
+// per word and looks up a precomputed, evenly spread pattern with that many
+// ones. The density of ones is equivalent to the stock loop's, not
+// bit-identical: the carry is kept in Q16 here, the gain is rounded to Q12,
+// and the bits inside a word are arranged differently, so the two bitstreams
+// differ by quantization noise while carrying the same in-band signal.
+// Gain is folded into the per-word increment, and words are staged and
+// handed to the I2S DMA ring in batches instead of one i2s_write_sample()
+// per word. ESP8266 only.
+#ifndef SIGMA_DELTA_OUTPUT_H
+#define SIGMA_DELTA_OUTPUT_H
+
+#include <Arduino.h>
+#include "AudioOutputI2SNoDAC.h"
+
+class AudioOutputI2SSigmaDelta : public AudioOutputI2SNoDAC {
+public:
+  static const uint16_t STAGE_WORDS = 128;
+
+  AudioOutputI2SSigmaDelta();
+
+  virtual bool SetGain(float f) override;
+  virtual bool ConsumeSample(int16_t sample[2]) override;
+  virtual bool loop() override;
+  virtual bool stop() override;
+
+private:
+  bool flushStage();
+
+  uint32_t pattern_[33];   // pattern_[k]: k ones spread over 32 bits, MSB first
+  int32_t gainQ12_;
+  uint32_t acc_;           // carried error, Q16 fraction of one bit
+  // Staged words as the I2S driver's int16 frame pairs (high half first)
+  int16_t stage_[2 * STAGE_WORDS];
+  uint16_t stageLen_;
+  uint16_t stageSent_;
+};
+
+#endif
@@ -0,0 +1,187 @@
+#include "async_log.h"
+#include "config.h"
+#include "log_ring.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+#include <atomic>
+#ifdef Serial
+#undef Serial
+#endif
+
+// Record kinds, packed with the level into the ring's tag byte
+#define LOG_KIND_TEXT 0x00
+#define LOG_KIND_FORMAT 0x80
+#define LOG_MAX_ARGS 8
+
+volatile uint8_t log_level_now = LOG_DEFAULT_LEVEL;
+
+// One ring per core: producers on the same core only contend on the
+// claim counter, and the two streams are merged by timestamp when drained.
+static LogRing log_rings[portNUM_PROCESSORS];
+// Drops not yet reported, bumped from both cores; the drain task moves them
+// into the running total
+static std::atomic<uint32_t> log_dropped(0);
+static volatile uint32_t log_dropped_reported = 0;
+static volatile bool log_running = false;
+static TaskHandle_t log_task_handle = NULL;
+
+static inline uint32_t logStamp() { return (uint32_t)esp_timer_get_time(); }
+
+void setLogLevel(LogLevel level) { log_level_now = level; }
+LogLevel getLogLevel() { return (LogLevel)log_level_now; }
+uint32_t logDropped() { return log_dropped_reported + log_dropped.load(std::memory_order_relaxed); }
+bool isAsyncLogRunning() { return log_running; }
+
+bool parseLogLevel(const char* name, LogLevel* out) {
+    static const char* const names[] = { "off", "error", "warn", "info", "debug" };
+    for (int i = 0; i < 5; ++i) {
+        if (strcmp(name, names[i]) == 0) {
+            if (out) *out = (LogLevel)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Format a FORMAT record's payload: format pointer followed by 32-bit args.
+// Arguments are passed back as 32-bit words, which matches the ESP32 ABI
+// for ints and pointers.
+static size_t formatRecord(char* out, size_t cap, const uint8_t* p, size_t len) {
+    const char* fmt;
+    memcpy(&fmt, p, sizeof(fmt));
+    uint32_t a[LOG_MAX_ARGS] = { 0 };
+    size_t n = (len - sizeof(fmt)) / sizeof(uint32_t);
+    if (n > LOG_MAX_ARGS) n = LOG_MAX_ARGS;
+    memcpy(a, p + sizeof(fmt), n * sizeof(uint32_t));
+    int w = snprintf(out, cap, fmt, a[0], a[1], a[2], a[3], a[4], a[5], a[6], a[7]);
+    if (w < 0) return 0;
+    return (size_t)w < cap ? (size_t)w : cap - 1;
+}
+
+static void writeRecord(const uint8_t* p, size_t len, uint8_t tag) {
+    if (tag & LOG_KIND_FORMAT) {
+        char line[LOG_LINE_MAX];
+        size_t n = formatRecord(line, sizeof(line), p, len);
+        Serial0.write((const uint8_t*)line, n);
+    } else {
+        Serial0.write(p, len);
+    }
+}
+
+// Write out the oldest record across the per-core rings. Returns false when
+// every ring is empty.
+static bool drainOne() {
+    int best = -1;
+    uint32_t best_stamp = 0;
+    const uint8_t* best_p = nullptr;
+    size_t best_len = 0;
+    uint8_t best_tag = 0;
+    for (int c = 0; c < portNUM_PROCESSORS; ++c) {
+        const uint8_t* p;
+        size_t len;
+        uint8_t tag;
+        uint32_t stamp;
+        if (!log_rings[c].peek(&p, &len, &tag, &stamp)) continue;
+        if (best < 0 || (int32_t)(stamp - best_stamp) < 0) {
+            best = c;
+            best_stamp = stamp;
+            best_p = p;
+            best_len = len;
+            best_tag = tag;
+        }
+    }
+    if (best < 0) return false;
+    writeRecord(best_p, best_len, best_tag);
+    log_rings[best].pop();
+    return true;
+}
+
+static void log_drain_task(void* pv) {
+    (void)pv;
+    for (;;) {
+        while (drainOne()) {}
+        uint32_t drops = log_dropped.exchange(0, std::memory_order_relaxed);
+        if (drops) {
+            Serial0.printf("[log] dropped %u records\n", (unsigned)drops);
+            log_dropped_reported += drops;
+        }
+        vTaskDelay(pdMS_TO_TICKS(LOG_DRAIN_MS));
+    }
+}
+
+void initAsyncLog() {
+    if (log_running) return;
+    for (int c = 0; c < portNUM_PROCESSORS; ++c) {
+        uint8_t* buf = (uint8_t*)heap_caps_malloc(LOG_RING_SIZE, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        if (!buf) buf = (uint8_t*)heap_caps_malloc(LOG_RING_SIZE, MALLOC_CAP_8BIT);
+        if (!buf || !log_rings[c].init(buf, LOG_RING_SIZE)) {
+            Serial0.println("Async log: ring allocation failed; logging stays synchronous");
+            return;
+        }
+    }
+    xTaskCreatePinnedToCore(log_drain_task, "log", 3072, NULL, tskIDLE_PRIORITY + 1, &log_task_handle, 1);
+    log_running = (log_task_handle != NULL);
+}
+
+// Claim a record in the current core's ring; counts a drop if it is full.
+static uint8_t* logReserve(size_t len, LogRing** ring) {
+    *ring = &log_rings[xPortGetCoreID()];
+    uint8_t* p = (*ring)->reserve(len);
+    if (!p) log_dropped.fetch_add(1, std::memory_order_relaxed);
+    return p;
+}
+
+void logText(LogLevel level, const char* s, size_t n, bool newline) {
+    if (level > log_level_now || !s) return;
+    if (!log_running) {
+        Serial0.write((const uint8_t*)s, n);
+        if (newline) Serial0.println();
+        return;
+    }
+    // Text longer than one record (payload and response dumps) goes out as
+    // consecutive chunks. If the ring fills part way, the rest is counted as
+    // dropped and a short marker ends the line instead.
+    static const char TRUNCATED[] = " [log truncated]\r\n";
+    LogRing* ring = &log_rings[xPortGetCoreID()];
+    size_t chunk = ring->maxPayload();
+    size_t total = n + (newline ? 2 : 0);
+    for (size_t off = 0; off < total; off += chunk) {
+        size_t len = total - off < chunk ? total - off : chunk;
+        uint8_t* p = ring->reserve(len);
+        if (!p) {
+            log_dropped.fetch_add((total - off + chunk - 1) / chunk, std::memory_order_relaxed);
+            if (off == 0) return;
+            p = ring->reserve(sizeof(TRUNCATED) - 1);
+            if (!p) return;
+            memcpy(p, TRUNCATED, sizeof(TRUNCATED) - 1);
+            ring->commit(p, sizeof(TRUNCATED) - 1, LOG_KIND_TEXT | level, logStamp());
+            return;
+        }
+        // Text bytes, then as much of the CRLF as falls in this chunk
+        size_t text = off < n ? (n - off < len ? n - off : len) : 0;
+        memcpy(p, s + off, text);
+        for (size_t i = text; i < len; ++i) p[i] = (off + i == n) ? '\r' : '\n';
+        ring->commit(p, len, LOG_KIND_TEXT | level, logStamp());
+    }
+}
+
+void logFormatArgs(LogLevel level, const char* fmt, const uint32_t* args, int nargs) {
+    if (level > log_level_now || !fmt) return;
+    if (nargs > LOG_MAX_ARGS) nargs = LOG_MAX_ARGS;
+    if (!log_running) {
+        char line[LOG_LINE_MAX];
+        uint8_t rec[sizeof(fmt) + LOG_MAX_ARGS * sizeof(uint32_t)];
+        memcpy(rec, &fmt, sizeof(fmt));
+        memcpy(rec + sizeof(fmt), args, nargs * sizeof(uint32_t));
+        size_t n = formatRecord(line, sizeof(line), rec, sizeof(fmt) + nargs * sizeof(uint32_t));
+        Serial0.write((const uint8_t*)line, n);
+        return;
+    }
+    size_t len = sizeof(fmt) + nargs * sizeof(uint32_t);
+    LogRing* ring;
+    uint8_t* p = logReserve(len, &ring);
+    if (!p) return;
+    memcpy(p, &fmt, sizeof(fmt));
+    memcpy(p + sizeof(fmt), args, nargs * sizeof(uint32_t));
+    ring->commit(p, len, LOG_KIND_FORMAT | level, logStamp());
+}
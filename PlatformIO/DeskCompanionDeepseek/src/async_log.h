@@ -0,0 +1,62 @@
+#ifndef ASYNC_LOG_H
+#define ASYNC_LOG_H
+
+#include <Arduino.h>
+#include <type_traits>
+
+// Deferred logging. Callers only copy a record into their core's lock-free
+// ring (see log_ring.h); a low-priority task formats and writes it to the
+// UART. Long text is split across several records; whatever no longer fits
+// in the ring is dropped and counted rather than blocking the caller.
+//
+// LOG_INFO(fmt, ...) and friends store the format pointer plus raw 32-bit
+// arguments, so the format string and any %s arguments must be string
+// literals or otherwise live forever. Floats are not supported. SafeSerial
+// (the Serial macro) goes through the same rings as pre-formatted text at
+// LOG_LEVEL_INFO.
+enum LogLevel : uint8_t {
+    LOG_LEVEL_OFF = 0,
+    LOG_LEVEL_ERROR,
+    LOG_LEVEL_WARN,
+    LOG_LEVEL_INFO,
+    LOG_LEVEL_DEBUG,
+};
+
+// Allocate the rings and start the drain task. Until then everything is
+// written synchronously.
+void initAsyncLog();
+bool isAsyncLogRunning();
+
+// Runtime filter: records above this level are discarded at the call site
+void setLogLevel(LogLevel level);
+LogLevel getLogLevel();
+// "off", "error", "warn", "info" or "debug"
+bool parseLogLevel(const char* name, LogLevel* out);
+// Records lost because a ring was full
+uint32_t logDropped();
+
+void logText(LogLevel level, const char* s, size_t n, bool newline);
+void logFormatArgs(LogLevel level, const char* fmt, const uint32_t* args, int nargs);
+
+extern volatile uint8_t log_level_now;
+
+template <typename T>
+inline uint32_t logArg(T v) {
+    static_assert(!std::is_floating_point<T>::value, "format floats before logging");
+    static_assert(std::is_pointer<T>::value || sizeof(T) <= sizeof(uint32_t), "log arguments are 32-bit");
+    return (uint32_t)(uintptr_t)v;
+}
+
+template <typename... A>
+inline void logFormat(LogLevel level, const char* fmt, A... a) {
+    if (level > log_level_now) return;
+    const uint32_t args[] = { 0u, logArg(a)... };
+    logFormatArgs(level, fmt, args + 1, (int)sizeof...(A));
+}
+
+#define LOG_ERROR(...) logFormat(LOG_LEVEL_ERROR, __VA_ARGS__)
+#define LOG_WARN(...) logFormat(LOG_LEVEL_WARN, __VA_ARGS__)
+#define LOG_INFO(...) logFormat(LOG_LEVEL_INFO, __VA_ARGS__)
+#define LOG_DEBUG(...) logFormat(LOG_LEVEL_DEBUG, __VA_ARGS__)
+
+#endif // ASYNC_LOG_H
@@ -1,8 +1,14 @@
 #include "bluetooth_audio.h"
+#include "async_log.h"
 #include "config.h"
 #include "oled_display.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "esp_heap_caps.h"
+#include "spsc_ring.h"
+#include "sound_catalog.h"
+#include "droid_voice.h"
 // ESP-IDF Bluetooth controller functions
 #include "esp_bt.h"
 #include "esp_bt_main.h"
@@ -25,6 +31,65 @@ static volatile bool sd_mounted = false;
 // Headset connection flag (set in A2DP connection callback)
 // `audioInitialized` is already global; reuse it for connection state.
 static volatile bool a2dp_paused = false;
+// Looping the "thinking" clip while a request is in flight
+static volatile bool thinking_active = false;
+// Output volume in percent, applied to the PCM in get_audio_data()
+static volatile uint8_t audio_volume = 100;
+
+// Guards audioFile: the SD reader task reads it while other tasks swap or
+// close it. The A2DP callback never touches the file (or this mutex).
+static SemaphoreHandle_t audio_file_mutex = NULL;
+
+// SD -> A2DP pipeline: the reader task streams the open clip into a PSRAM
+// ring with large sequential reads; the A2DP callback only memcpys out.
+static SpscRing audio_ring;
+static uint8_t* audio_ring_buf = nullptr;
+static uint8_t* sd_stage = nullptr;          // DMA-capable staging for SD reads
+static TaskHandle_t sd_reader_handle = NULL;
+static volatile bool stream_open = false;    // a clip is open for reading
+static volatile bool stream_eof = false;     // reader hit EOF (play-once) or the file closed
+static volatile bool flush_pending = false;  // clip swapped; callback drops stale ring data
+// Byte range of audioFile being played; a catalog clip is a slice of the bank
+static uint32_t stream_start = 0;
+static uint32_t stream_end = 0;
+static uint32_t stream_pos = 0;
+static bool bank_open = false;               // audioFile is SOUND_BANK_PATH
+// Synthesized speech replaces the file as the ring's source while active
+static DroidVoice droid_voice;
+static volatile bool voice_active = false;
+
+static AudioPipelineStats audio_stats = {0, 0, 0, AUDIO_RING_SIZE};
+
+static void lockAudioFile() {
+    if (audio_file_mutex) xSemaphoreTake(audio_file_mutex, portMAX_DELAY);
+}
+
+static void unlockAudioFile() {
+    if (audio_file_mutex) xSemaphoreGive(audio_file_mutex);
+}
+
+static void wakeSDReader() {
+    if (sd_reader_handle) xTaskNotifyGive(sd_reader_handle);
+}
+
+// Call with the file lock held, right after audioFile was (re)opened,
+// repositioned or closed. Plays bytes [start, end) of the file. Old ring
+// contents are dropped by the consumer on its next call.
+static void restartStreamLocked(uint32_t start, uint32_t end) {
+    voice_active = false;
+    stream_open = (bool)audioFile;
+    stream_start = start;
+    stream_end = end;
+    stream_pos = start;
+    stream_eof = !stream_open || end <= start;
+    flush_pending = true;
+}
+
+// Whole-file variant; also forgets that the bank was open.
+static void restartFileStreamLocked() {
+    bank_open = false;
+    restartStreamLocked(0, audioFile ? (uint32_t)audioFile.size() : 0);
+}
 
 // Install A2DP callbacks (used at init and when resuming after TLS)
 static void setupA2DPCallbacks() {
@@ -47,35 +112,134 @@ static QueueHandle_t audio_q = NULL;
 static TaskHandle_t audio_task_handle = NULL;
 
 int32_t get_audio_data(uint8_t *data, int32_t len) {
-    if (!audioFile) return 0;
+    if (len <= 0) return 0;
+    // A new clip was opened: drop what is left of the old one.
+    if (flush_pending) {
+        audio_ring.discard();
+        flush_pending = false;
+        wakeSDReader();
+        return 0;
+    }
 
     // If a one-shot notification already finished, return 0 to silence
     // further playback until explicitly requested again.
-    if (notification_played) return 0;
+    if (!stream_open || notification_played) return 0;
+
+    size_t n = audio_ring.read(data, len);
+    size_t left = audio_ring.available();
+    if (left < audio_stats.min_fill) audio_stats.min_fill = left;
+
+    if (n < (size_t)len) {
+        if (stream_eof) {
+            // Play once mode: ring drained after EOF, stop and mark played.
+            if (n == 0 && play_notification_once) {
+                play_notification_once = false;
+                notification_played = true;
+            }
+            return n;
+        }
+        // Reader fell behind: pad with silence so A2DP timing holds.
+        audio_stats.underruns++;
+        audio_stats.underrun_bytes += len - n;
+        memset(data + n, 0, len - n);
+        n = len;
+    }
+    if (left < AUDIO_RING_SIZE / 2) wakeSDReader();
+    uint8_t vol = audio_volume;
+    if (vol < 100) {
+        // Q8 gain on 16-bit samples
+        int32_t gain = (vol * 256) / 100;
+        int16_t* s = (int16_t*)data;
+        for (size_t i = 0; i < n / 2; ++i) s[i] = (int16_t)((s[i] * gain) >> 8);
+    }
+    return n;
+}
 
-    int bytes_read = audioFile.read(data, len);
+void setAudioVolume(int percent) {
+    if (percent < 0) percent = 0;
+    if (percent > 100) percent = 100;
+    audio_volume = (uint8_t)percent;
+    LOG_INFO("Volume: %d%%\n", percent);
+}
+
+int getAudioVolume() { return audio_volume; }
 
-    if (play_notification_once) {
-        // Play once mode: when EOF reached, stop playback and mark played.
-        if (bytes_read <= 0) {
-            play_notification_once = false;
-            notification_played = true;
-            return 0;
+// Refill the ring from the open clip. Reads and ring writes both happen
+// under the file lock so a clip swap can never interleave stale data.
+static void sd_reader_task(void* pv) {
+    (void)pv;
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(AUDIO_READER_POLL_MS));
+        while (audio_ring.space() >= AUDIO_READ_CHUNK) {
+            int n = 0;
+            lockAudioFile();
+            if (!flush_pending && voice_active && !stream_eof && !notification_played) {
+                // Synthesize straight into the staging buffer: no SD access
+                size_t frames = droid_voice.render((int16_t*)sd_stage, AUDIO_READ_CHUNK / 4);
+                n = (int)(frames * 4);
+                if (n > 0) {
+                    audio_ring.write(sd_stage, n);
+                    audio_stats.refills++;
+                }
+                if (droid_voice.done()) stream_eof = true;
+            } else if (!flush_pending && stream_open && !stream_eof && !notification_played) {
+                if (stream_pos >= stream_end) {
+                    if (play_notification_once) {
+                        stream_eof = true;
+                    } else {
+                        // Normal (loop) behavior: at the end, rewind and continue looping.
+                        audioFile.seek(stream_start);
+                        stream_pos = stream_start;
+                    }
+                }
+                if (!stream_eof) {
+                    uint32_t want = stream_end - stream_pos;
+                    if (want > AUDIO_READ_CHUNK) want = AUDIO_READ_CHUNK;
+                    n = audioFile.read(sd_stage, want);
+                    if (n <= 0) {
+                        stream_eof = true;
+                    } else {
+                        stream_pos += n;
+                        audio_ring.write(sd_stage, n);
+                        audio_stats.refills++;
+                    }
+                }
+            }
+            unlockAudioFile();
+            if (n <= 0) break;
         }
-        return bytes_read;
     }
+}
 
-    // Normal (loop) behavior: on EOF, rewind and continue looping.
-    if (bytes_read <= 0) {
-        audioFile.seek(0);
-        bytes_read = audioFile.read(data, len);
-        if (bytes_read <= 0) return 0;
+static void startSDReaderTask() {
+    if (sd_reader_handle != NULL) return;
+    if (audio_ring_buf == nullptr) {
+        audio_ring_buf = (uint8_t*)heap_caps_malloc(AUDIO_RING_SIZE, MALLOC_CAP_SPIRAM);
+        sd_stage = (uint8_t*)heap_caps_malloc(AUDIO_READ_CHUNK, MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL);
+        if (!audio_ring_buf || !sd_stage || !audio_ring.init(audio_ring_buf, AUDIO_RING_SIZE)) {
+            Serial.println("Failed to alloc audio ring/staging buffers");
+            return;
+        }
     }
-    return bytes_read;
+    // Above the UI tasks so the ring stays full; it sleeps between refills.
+    xTaskCreatePinnedToCore(sd_reader_task, "sd_reader", 3072, NULL, 3, &sd_reader_handle, 1);
+    Serial.println("Started SD reader task");
+}
+
+AudioPipelineStats getAudioPipelineStats() {
+    return audio_stats;
+}
+
+void logAudioPipelineStats() {
+    LOG_INFO("Audio pipeline: underruns=%u (%u bytes) refills=%u min_fill=%u/%u\n",
+             (unsigned)audio_stats.underruns, (unsigned)audio_stats.underrun_bytes,
+             (unsigned)audio_stats.refills, (unsigned)audio_stats.min_fill,
+             (unsigned)AUDIO_RING_SIZE);
 }
 
 void initBluetooth() {
     Serial.println("Initializing Bluetooth...");
+    if (audio_file_mutex == NULL) audio_file_mutex = xSemaphoreCreateMutex();
     
     // Set ESP32 local BT name
     a2dp.set_local_name("ESP32-CAM DeskMate");
@@ -109,64 +273,95 @@ void playNotificationSound() {
     // Ensure audio file is available; if not, try SD init once
     if (!audioFile) initSDCard();
 
-    // Choose which folder to play from: 50/50 between /beeps and /serenity
-    const char* folderA = "/beeps";
-    const char* folderB = "/serenity";
+    // Catalog normally loads at mount; retry once here if SD came up later
+    static bool catalog_attempted = false;
+    if (!isSoundCatalogReady() && !catalog_attempted && isSDMounted()) {
+        catalog_attempted = true;
+        loadSoundCatalog();
+    }
+
+    SoundClipRef clip;
+    bool haveClip = pickCatalogClip(clip);
 
-    String chosenPath = "";
-    // Try to pick a random file from selected folder
-    const int pick = random(0, 2); // 0 or 1
-    const char* selFolder = (pick == 0) ? folderA : folderB;
-    chosenPath = ""; // will be set by helper
-    
-    // Helper: collect files in directory and pick one at random
-    auto pickFromDir = [&](const char* dirPath) -> String {
-        File dir = SD_MMC.open(dirPath);
-        if (!dir) return String("");
-        const int MAX_FILES = 64;
-        String files[MAX_FILES];
-        int count = 0;
-        File entry;
-        // iterate directory
-        while ((entry = dir.openNextFile())) {
-            if (!entry.isDirectory()) {
-                if (count < MAX_FILES) files[count++] = String(dirPath) + "/" + String(entry.name());
-            }
-            entry.close();
+    lockAudioFile();
+    if (haveClip) {
+        // Keep the bank open across notifications: starting a clip is one seek.
+        if (!bank_open) {
+            if (audioFile) audioFile.close();
+            audioFile = SD_MMC.open(SOUND_BANK_PATH, FILE_READ);
+            bank_open = (bool)audioFile;
         }
-        dir.close();
-        if (count == 0) return String("");
-        int idx = random(0, count);
-        return files[idx];
-    };
-
-    chosenPath = pickFromDir(selFolder);
-    // If chosen folder empty, try the other folder
-    if (chosenPath.length() == 0) {
-        const char* other = (selFolder == folderA) ? folderB : folderA;
-        chosenPath = pickFromDir(other);
+        haveClip = bank_open && audioFile.seek(clip.offset);
     }
-
-    // Fallback to default file if still empty
-    if (chosenPath.length() == 0) {
-        Serial.println("No files found in beeps/serenity; falling back to /out2.raw");
-        chosenPath = String(AUDIO_FILE_PATH);
+    thinking_active = false;
+    if (haveClip) {
+        LOG_INFO("Playing notification: bank @%u (%u bytes)\n", (unsigned)clip.offset, (unsigned)clip.length);
+        restartStreamLocked(clip.offset, clip.offset + clip.length);
+        notification_played = false;
+        play_notification_once = true;
+    } else {
+        // Fallback to default file if the catalog is empty or the bank is gone
+        Serial.println("No catalog clips; falling back to /out2.raw");
+        if (audioFile) audioFile.close();
+        audioFile = SD_MMC.open(AUDIO_FILE_PATH, FILE_READ);
+        if (audioFile) {
+            notification_played = false;
+            play_notification_once = true;
+        } else {
+            Serial.print("Failed to open "); Serial.println(AUDIO_FILE_PATH);
+        }
+        restartFileStreamLocked();
     }
+    unlockAudioFile();
+    wakeSDReader();
+}
 
-    // Close any previously opened audio file
-    if (audioFile) {
-        audioFile.close();
-    }
+bool speakText(const char* text) {
+#if DROID_VOICE_ENABLED
+    if (!audioInitialized || sd_reader_handle == NULL || !text || !*text) return false;
+    lockAudioFile();
+    droid_voice.begin(text);
+    thinking_active = false;
+    voice_active = true;
+    stream_open = true;
+    stream_eof = false;
+    flush_pending = true;
+    notification_played = false;
+    play_notification_once = true;
+    unlockAudioFile();
+    LOG_INFO("Speaking %u ms of droid voice\n", (unsigned)(droid_voice.totalFrames() / 44));
+    wakeSDReader();
+    return true;
+#else
+    (void)text;
+    return false;
+#endif
+}
 
-    audioFile = SD_MMC.open(chosenPath, FILE_READ);
+void startThinkingSound() {
+    if (!audioInitialized || !sd_mounted) return;
+    if (!SD_MMC.exists(THINKING_SOUND_PATH)) return;
+    lockAudioFile();
+    if (audioFile) audioFile.close();
+    audioFile = SD_MMC.open(THINKING_SOUND_PATH, FILE_READ);
     if (audioFile) {
-        Serial.print("Playing notification: "); Serial.println(chosenPath);
-        audioFile.seek(0);
+        // Loop mode until stopThinkingSound()
+        play_notification_once = false;
         notification_played = false;
-        play_notification_once = true;
-    } else {
-        Serial.print("Failed to open "); Serial.println(chosenPath);
+        thinking_active = true;
     }
+    restartFileStreamLocked();
+    unlockAudioFile();
+    wakeSDReader();
+}
+
+void stopThinkingSound() {
+    if (!thinking_active) return;
+    lockAudioFile();
+    // Silence the loop; the next notification reopens a clip.
+    thinking_active = false;
+    notification_played = true;
+    unlockAudioFile();
 }
 
 void initSDCard() {
@@ -208,8 +403,13 @@ void initSDCard() {
     sd_mounted = true;
 
     // Open RAW PCM from SD root
+    lockAudioFile();
     audioFile = SD_MMC.open(AUDIO_FILE_PATH, FILE_READ);
-    if (!audioFile) {
+    bool opened = (bool)audioFile;
+    restartFileStreamLocked();
+    unlockAudioFile();
+    wakeSDReader();
+    if (!opened) {
         Serial.print("❌ Missing ");
         Serial.println(AUDIO_FILE_PATH);
         Serial.println(" on SD root");
@@ -253,6 +453,8 @@ static void bt_manager_task(void* pv) {
             }
         }
 
+        if (audioInitialized) logAudioPipelineStats();
+
         // Back off more to avoid spamming A2DP start requests during
         // controller bring-up/reconnect storms.
         vTaskDelay(pdMS_TO_TICKS(15000));
@@ -314,6 +516,8 @@ static void audio_task(void* pv) {
     (void)pv;
     // Try to mount SD once at start (user may insert later)
     initSDCard();
+    // Index (and if needed pack) the notification clips once per boot
+    if (isSDMounted()) loadSoundCatalog();
     for (;;) {
         uint8_t msg;
         if (audio_q && xQueueReceive(audio_q, &msg, portMAX_DELAY) == pdTRUE) {
@@ -329,6 +533,7 @@ void startAudioTask() {
     if (audio_q == NULL) {
         audio_q = xQueueCreate(8, sizeof(uint8_t));
     }
+    startSDReaderTask();
     if (audio_task_handle == NULL) {
         xTaskCreatePinnedToCore(audio_task, "audio_task", 4096, NULL, 1, &audio_task_handle, 1);
         Serial.println("Started audio task");
@@ -474,10 +679,13 @@ bool restartBluetoothController() {
 }
 
 void unmountSD() {
+    lockAudioFile();
     if (audioFile) {
         Serial.println("Closing audio file and unmounting SD");
         audioFile.close();
     }
+    restartFileStreamLocked();
+    unlockAudioFile();
     // End SD_MMC to free internal resources
     SD_MMC.end();
     sd_mounted = false;
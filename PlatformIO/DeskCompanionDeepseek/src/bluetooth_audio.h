@@ -6,9 +6,19 @@
 #include <SD_MMC.h>
 #include "config.h"
 
-// Audio callback function
+// Audio callback function: copies PCM out of the SD reader's ring buffer
 int32_t get_audio_data(uint8_t *data, int32_t len);
 
+// SD -> A2DP pipeline counters
+struct AudioPipelineStats {
+    uint32_t underruns;      // callbacks that found the ring short of data
+    uint32_t underrun_bytes; // silence bytes padded in for those
+    uint32_t refills;        // SD chunk reads pushed into the ring
+    uint32_t min_fill;       // lowest ring level seen by the callback
+};
+AudioPipelineStats getAudioPipelineStats();
+void logAudioPipelineStats();
+
 // Function declarations
 void initBluetooth();
 bool connectToHeadset();
@@ -45,6 +55,16 @@ bool waitForHeadsetConnection(uint32_t timeout_ms);
 // Pause/resume A2DP callbacks to reduce driver activity during TLS
 void pauseBluetoothForTLS();
 void resumeBluetoothAfterTLS();
+// Play `text` as synthesized droid speech (see droid_voice.h). Returns false
+// if speech is disabled or audio is not up; the caller can fall back to a
+// notification clip.
+bool speakText(const char* text);
+// Loop THINKING_SOUND_PATH while a request is in flight (no-op if missing)
+void startThinkingSound();
+void stopThinkingSound();
+// Software output volume, 0-100 percent
+void setAudioVolume(int percent);
+int getAudioVolume();
 
 // Global variables
 extern BluetoothA2DPSource a2dp;
@@ -22,17 +22,49 @@ extern const char* DEEPSEEK_MODEL;
 #define SCREEN_WIDTH 128
 #define SCREEN_HEIGHT 64
 #define OLED_ADDR 0x3C
+#define OLED_I2C_CHUNK 64     // data bytes per I2C transaction
+#define DISPLAY_MSG_MAX 320   // longest text a display message carries
+#define DISPLAY_QUEUE_LEN 4
 
 // Bluetooth Configuration
 extern const char* BT_DEVICE_NAME;
 
 // Audio Configuration
 #define AUDIO_FILE_PATH "/out2.raw"
+#define THINKING_SOUND_PATH "/thinking.raw" // looped during API requests (optional)
+#define AUDIO_RING_SIZE (32 * 1024)  // PSRAM ring between SD reader and A2DP (power of 2)
+#define AUDIO_READ_CHUNK 4096        // bytes per SD read
+#define AUDIO_READER_POLL_MS 20      // reader wakes at least this often
+
+// Notification sound catalog (see sound_catalog.h)
+#define SOUND_BANK_PATH "/sounds.bank"
+#define SOUND_INDEX_PATH "/sounds.idx"
+#define SOUND_CATALOG_MAX 128        // clips across /beeps and /serenity
+#define SOUND_BAG_MAX 255            // shuffle bag slots per folder (sum of weights)
+
+// Synthesized droid speech for each fact (0 = play a notification clip instead)
+#define DROID_VOICE_ENABLED 1
+
+// Memory budget: internal RAM reserved at boot for mbedTLS (see memory_budget.h)
+#define TLS_POOL_SIZE (44 * 1024)
 
 // Conversation Configuration
 #define MAX_TOKENS 100
 #define RESPONSE_TEMPERATURE 0.9
-#define TOUCH_DEBOUNCE_TIME 200 // milliseconds
+#define TOUCH_EDGE_RING 32 // timestamped edges buffered between ISR and decoder (power of two)
+#define TOUCH_VOLUME_STEP 10 // percent per hold repeat
+#define SERIAL_POLL_MS 200 // how often the conversation task checks Serial while waiting for touch
+
+// Fact cache (append-only log on SD, see fact_cache.h)
+#define FACT_CACHE_PATH "/facts.log"
+#define FACT_CACHE_SLOTS 512              // subject hash table size (power of 2)
+#define FACT_CACHE_PER_SUBJECT 8          // facts remembered per subject
+#define FACT_CACHE_MAX_FACT 256           // longest fact stored, bytes
+#define FACT_CACHE_MAX_BYTES (256 * 1024) // compact the log beyond this size
+#define FACT_CACHE_PREFETCH_TARGET 2      // unserved facts to keep per subject
+#define FACT_CACHE_IDLE_MS 60000          // prefetch only after this much idle time
+#define FACT_CACHE_PREFETCH_INTERVAL_MS 30000
+#define FACT_CACHE_MIN_RSSI -70           // dBm; skip prefetch on a weak link
 
 // Enable this to mock DeepSeek HTTP responses locally (1 = mock, 0 = real)
 #define MOCK_DEEPSEEK 1
@@ -40,4 +72,15 @@ extern const char* BT_DEVICE_NAME;
 // Disable all Serial output at compile time (set to 1 to strip prints)
 #define DISABLE_SERIAL_OUTPUT 1
 
+// Async logging (see async_log.h)
+#define LOG_RING_SIZE 4096   // bytes per core, power of two
+#define LOG_LINE_MAX 256     // longest formatted LOG_* line
+#define LOG_DRAIN_MS 20      // drain task poll interval
+// Log level at boot (0 off, 1 error, 2 warn, 3 info, 4 debug); "log <level>" over Serial changes it
+#if DISABLE_SERIAL_OUTPUT
+#define LOG_DEFAULT_LEVEL 0
+#else
+#define LOG_DEFAULT_LEVEL 3
+#endif
+
 #endif // CONFIG_H
\ No newline at end of file
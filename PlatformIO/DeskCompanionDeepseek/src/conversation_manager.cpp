@@ -1,18 +1,20 @@
 #include "conversation_manager.h"
 #include <Arduino.h>
-#include <vector>
 #include "deepseek_client.h"
 #include "subjects.h"
 #include "oled_display.h"
-#include "touch_input.h"
+#include "bluetooth_audio.h"
+#include "fact_cache.h"
 
 // Forward declaration to ensure the enqueue function is visible to this file
 bool enqueueAudioNotification();
 
-std::vector<String> history;
+FactHistory history;
 String currentSubject = "";
 String currentFact = "";
-static const size_t HISTORY_MAX = 5;
+static volatile unsigned long last_activity_ms = 0;
+
+unsigned long lastConversationActivity() { return last_activity_ms; }
 
 void initConversationManager() {
   history.clear();
@@ -22,67 +24,115 @@ void initConversationManager() {
 }
 
 void saveFactToHistory(const String& fact) {
-  history.push_back(fact);
-  while (history.size() > HISTORY_MAX) history.erase(history.begin());
+  history.push(fact.c_str());
 }
 
 void printCurrentFactSerial() {
   if (!currentFact.isEmpty()) Serial.println(currentFact);
 }
 
+// Append a seed to break server-side caching.
+static void writeSeed(PromptWriter& w) {
+  w.text("Seed:").number(millis()).text("_").number(random(0, 1000000));
+}
+
+void writeSubjectPrompt(PromptWriter& w, const String& subject) {
+  w.text("Give one short intriguing sentence (8-12 words) about: ")
+   .text(subject.c_str(), subject.length())
+   .text(". Respond with a single sentence only. ");
+  writeSeed(w);
+}
+
+// Offline fallback: walk the subject table from a random start and take the
+// first subject that has anything cached.
+static bool takeAnyCachedFact(String& subjectOut, String& factOut) {
+  int count = sizeof(SUBJECTS) / sizeof(SUBJECTS[0]);
+  int start = random(count);
+  for (int i = 0; i < count; ++i) {
+    String subj = SUBJECTS[(start + i) % count];
+    if (factCacheTakeAny(subj, factOut)) {
+      subjectOut = subj;
+      return true;
+    }
+  }
+  return false;
+}
+
+static void presentFact(const String& fact) {
+  currentFact = fact;
+  printCurrentFactSerial();
+  // Display on OLED
+  displayWrappedText(currentFact);
+  // Speak the fact; fall back to a notification clip
+  if (!speakText(currentFact.c_str())) enqueueAudioNotification();
+  saveFactToHistory(fact);
+}
+
 void startNewSubject() {
+  last_activity_ms = millis();
   // Discard history so the model picks a fresh subject
   history.clear();
   currentSubject = ""; currentFact = "";
   Serial.println("Requesting new subject/fact");
-  // Pick a local random subject and add a seed to break server-side caching.
+  // Pick a local random subject; serve a prefetched fact instantly if one is cached.
   String subj = pickRandomSubject();
-  String seed = String(millis()) + "_" + String(random(0, 1000000));
-  String prompt = "Give one short intriguing sentence (8-12 words) about: " + subj + ". Respond with a single sentence only. Seed:" + seed;
-  String resp = sendToDeepSeek(prompt);
   String fact;
-  if (extractFactFromResponse(resp, fact)) {
-    currentFact = fact;
-    currentSubject = ""; // subject not extracted from plain-text response
-    printCurrentFactSerial();
-    // Display on OLED
-    displayWrappedText(currentFact);
-    // Signal audio notification
-    enqueueAudioNotification();
-    saveFactToHistory(fact);
+  if (factCacheTakeFresh(subj, fact)) {
+    Serial.println("Serving cached fact");
   } else {
-    Serial.println("Failed to get a fact from response");
+    writeSubjectPrompt(beginDeepSeekRequest(), subj);
+    String resp = finishDeepSeekRequest();
+    if (!isDeepSeekError(resp) && extractFactFromResponse(resp, fact)) {
+      factCacheStore(subj, fact, true);
+    } else if (factCacheTakeAny(subj, fact) || takeAnyCachedFact(subj, fact)) {
+      Serial.println("API unavailable; serving cached fact");
+    } else {
+      Serial.println("Failed to get a fact from response");
+      return;
+    }
   }
+  currentSubject = subj;
+  presentFact(fact);
 }
 
 void onUserInput(const String& input) {
+  last_activity_ms = millis();
   if (input == "more") {
-    // Build a context containing up to the last 5 facts so the model can continue coherently
-    String context = "Previous facts:\n";
+    // Ask the model not to repeat the last 5 facts so it can continue
+    // coherently; the context is written straight into the request body.
+    PromptWriter& w = beginDeepSeekRequest();
+    w.text("Avoid repeating these recent facts. \nPrevious facts:\n");
     for (size_t i = 0; i < history.size(); ++i) {
-      context += "- ";
-      context += history[i];
-      context += "\n";
+      w.text("- ").text(history.at(i)).text("\n");
     }
-    // Ask the model explicitly not to repeat recent facts and add a seed
-    String avoid = "Avoid repeating these recent facts. ";
-    String seed = String(millis()) + "_" + String(random(0, 1000000));
-    String prompt = avoid + "\n" + context + "Continue about the current subject; provide one short sentence (8-12 words). Seed:" + seed;
-    String resp = sendToDeepSeek(prompt);
+    w.text("Continue about the current subject; provide one short sentence (8-12 words). ");
+    writeSeed(w);
+    String resp = finishDeepSeekRequest();
     String fact2;
-    if (extractFactFromResponse(resp, fact2)) {
-      currentFact = fact2;
-      printCurrentFactSerial();
-      // Show the continued fact on the OLED as well
-      displayWrappedText(currentFact);
-      // Signal audio notification
-      enqueueAudioNotification();
-      saveFactToHistory(fact2);
+    if (!isDeepSeekError(resp) && extractFactFromResponse(resp, fact2)) {
+      if (currentSubject.length()) factCacheStore(currentSubject, fact2, true);
+      presentFact(fact2);
+    } else if (currentSubject.length() && factCacheTakeAny(currentSubject, fact2)) {
+      Serial.println("API unavailable; serving cached fact");
+      presentFact(fact2);
     } else {
       Serial.println("No continuation");
     }
   } else if (input == "other") {
     startNewSubject();
+  } else if (input == "repeat") {
+    // Show and chime the current fact again; the OLED layout is cached
+    if (currentFact.isEmpty()) return;
+    printCurrentFactSerial();
+    displayWrappedText(currentFact);
+    if (!speakText(currentFact.c_str())) enqueueAudioNotification();
+  } else if (input == "volume") {
+    int v = getAudioVolume() + TOUCH_VOLUME_STEP;
+    setAudioVolume(v > 100 ? TOUCH_VOLUME_STEP : v);
+  } else if (input == "volume up") {
+    setAudioVolume(getAudioVolume() + TOUCH_VOLUME_STEP);
+  } else if (input == "volume down") {
+    setAudioVolume(getAudioVolume() - TOUCH_VOLUME_STEP);
   }
 }
 
@@ -2,18 +2,24 @@
 #define CONVERSATION_MANAGER_H
 
 #include <Arduino.h>
-#include <vector>
+#include "prompt_writer.h"
 
 // History: last 5 assistant turns (facts/continuations)
-extern std::vector<String> history;
+extern FactHistory history;
 extern String currentSubject;
 extern String currentFact;
 
 void initConversationManager();
 void startNewSubject();
-void onUserInput(const String& input); // "more" or "other"
+// "more", "other", "repeat", "volume" (step up, wraps), "volume up"/"volume down"
+void onUserInput(const String& input);
 void clearHistory();
 void saveFactToHistory(const String& fact);
 void printCurrentFactSerial();
+// Write the prompt asking for a fresh fact about `subject` (also used by the
+// prefetch task)
+void writeSubjectPrompt(PromptWriter& w, const String& subject);
+// millis() of the last user-driven request; the prefetch task waits for idle
+unsigned long lastConversationActivity();
 
 #endif // CONVERSATION_MANAGER_H
\ No newline at end of file
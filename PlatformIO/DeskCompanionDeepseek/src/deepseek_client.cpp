@@ -1,12 +1,15 @@
 #include "deepseek_client.h"
+#include "async_log.h"
 #include "config.h"
 #include <WiFi.h>
 #include <HTTPClient.h>
 #include <WiFiClientSecure.h>
 #include <ArduinoJson.h>
 #include "esp_heap_caps.h"
+#include "freertos/semphr.h"
 // Bluetooth/SD enabled: include bluetooth_audio so we can close/unmount before TLS
 #include "bluetooth_audio.h"
+#include "memory_budget.h"
 // For local subject picks when mocking
 #include "subjects.h"
 
@@ -65,23 +68,59 @@ bool connectToWiFi() {
     }
 }
 
-String sendToDeepSeek(const String& userMessage) {
-    if (WiFi.status() != WL_CONNECTED) {
-        Serial.println("WiFi not connected");
-        return "WiFi error";
+// Serializes requests: the conversation task and the fact-cache prefetch
+// task both call sendToDeepSeek, and each call tears down audio/SD around TLS.
+// The mutex is held from beginDeepSeekRequest() until finishDeepSeekRequest().
+static SemaphoreHandle_t request_mutex = NULL;
+
+// Outgoing request body. Allocated once in PSRAM and reused; the prompt is
+// serialized straight into it by PromptWriter (no String/JSON doc copies).
+static const size_t PAYLOAD_CAP = 2048;
+static char* payload_buf = nullptr;
+static PromptWriter request_writer;
+
+static const char* SYSTEM_PROMPT = "You are DeskMate, a friendly desk companion. You speak in short, clear sentences suitable for a speaker or an OLED 128x64 screen. You randomly pick subjects and give short facts. Keep sentences short (8-12 words each). Use Yes/No questions.";
+
+static String sendToDeepSeekLocked(const char* payload, size_t payloadLen);
+
+PromptWriter& beginDeepSeekRequest() {
+    if (request_mutex == NULL) request_mutex = xSemaphoreCreateMutex();
+    xSemaphoreTake(request_mutex, portMAX_DELAY);
+    if (payload_buf == nullptr) {
+        payload_buf = (char*)heap_caps_malloc(PAYLOAD_CAP, MALLOC_CAP_SPIRAM);
+        if (!payload_buf) Serial.println("Failed to alloc PSRAM for payload");
     }
-    // If mock mode is enabled, return a quick canned/plain-text response
-    // so the rest of the flow (parsing, audio enqueue) behaves the same.
-#if MOCK_DEEPSEEK
-    Serial.println("MOCK: returning canned DeepSeek response");
-    String subj = pickRandomSubject();
-    String mockFact = "Mock: " + subj + " are surprisingly interesting.";
-    return mockFact;
-#endif
-    
-    // Diagnostic: print free heap before starting TLS handshake
-    Serial.print("Free heap before TLS: "); Serial.println(String(ESP.getFreeHeap()));
+    request_writer.reset(payload_buf, PAYLOAD_CAP);
+    request_writer.beginRequest(DEEPSEEK_MODEL, MAX_TOKENS, RESPONSE_TEMPERATURE, SYSTEM_PROMPT);
+    return request_writer;
+}
+
+String finishDeepSeekRequest() {
+    const char* payload = request_writer.endRequest();
+    String response;
+    if (!payload) {
+        Serial.println("Request payload overflow; not sending");
+        response = "API Error";
+    } else {
+        response = sendToDeepSeekLocked(payload, request_writer.length());
+    }
+    xSemaphoreGive(request_mutex);
+    return response;
+}
 
+String sendToDeepSeek(const String& userMessage) {
+    beginDeepSeekRequest().text(userMessage.c_str(), userMessage.length());
+    return finishDeepSeekRequest();
+}
+
+bool isDeepSeekError(const String& response) {
+    return response == "API Error" || response == "WiFi error";
+}
+
+// Fallback when no TLS pool could be reserved: free internal heap for the
+// handshake by suspending audio and unmounting SD. Returns true if the audio
+// task had to be deleted (it must then be restarted, not resumed).
+static bool releaseAudioForTLS() {
     // Reduce memory pressure: gently suspend audio and unmount SD. We avoid
     // stopping the BT manager entirely — keep it running to preserve the
     // Bluetooth stack state and avoid restart fragility.
@@ -120,6 +159,55 @@ String sendToDeepSeek(const String& userMessage) {
 
     // Quiet A2DP activity to reduce driver/internal allocations during TLS
     pauseBluetoothForTLS();
+    return audio_was_deleted;
+}
+
+static void restoreAudioAfterTLS(bool audio_was_deleted) {
+    // Restore A2DP callbacks so the stack can operate normally again.
+    resumeBluetoothAfterTLS();
+
+    // Restore audio task depending on how it was stopped. Leave BT
+    // manager running as we did not stop it.
+    if (audio_was_deleted) {
+        startAudioTask();
+    } else {
+        resumeAudioTask();
+    }
+
+    // Give audio init time
+    delay(200);
+
+    Serial.println("Restored audio task after request (BT manager left running)");
+}
+
+static String sendToDeepSeekLocked(const char* payload, size_t payloadLen) {
+    if (WiFi.status() != WL_CONNECTED) {
+        Serial.println("WiFi not connected");
+        return "WiFi error";
+    }
+    // If mock mode is enabled, return a quick canned/plain-text response
+    // so the rest of the flow (parsing, audio enqueue) behaves the same.
+#if MOCK_DEEPSEEK
+    Serial.println("MOCK: returning canned DeepSeek response");
+    String subj = pickRandomSubject();
+    String mockFact = "Mock: " + subj + " are surprisingly interesting.";
+    return mockFact;
+#endif
+    
+    // Diagnostic: print free heap before starting TLS handshake
+    LOG_INFO("Free heap before TLS: %u\n", (unsigned)ESP.getFreeHeap());
+
+    // With the TLS pool reserved at boot, mbedTLS has its own internal RAM,
+    // so audio and SD stay up and a "thinking" clip plays through the
+    // request. Without it, tear audio/SD down to free internal heap.
+    const bool keep_audio = isTLSPoolReserved();
+    bool audio_was_deleted = false;
+    if (keep_audio) {
+        startThinkingSound();
+        logMemoryBudget("pre-tls");
+    } else {
+        audio_was_deleted = releaseAudioForTLS();
+    }
 
     HTTPClient http;
     http.setTimeout(10000); // 10 second timeout
@@ -133,52 +221,17 @@ String sendToDeepSeek(const String& userMessage) {
     http.addHeader("Content-Type", "application/json");
     http.addHeader("Authorization", "Bearer " + String(DEEPSEEK_API_KEY));
     
-        // Build request JSON in PSRAM-backed StaticJsonDocument to avoid internal-heap
-        // Keep document small to reduce allocations.
-        const size_t REQ_DOC_CAP = 768;
-        void* reqPool = heap_caps_malloc(sizeof(StaticJsonDocument<REQ_DOC_CAP>), MALLOC_CAP_SPIRAM);
-        if (!reqPool) {
-            Serial.println("Failed to alloc PSRAM for request doc");
-            return String("API Error");
-        }
-        StaticJsonDocument<REQ_DOC_CAP>* reqDoc = new (reqPool) StaticJsonDocument<REQ_DOC_CAP>();
-        (*reqDoc)["model"] = DEEPSEEK_MODEL;
-        (*reqDoc)["max_tokens"] = MAX_TOKENS;
-        (*reqDoc)["temperature"] = RESPONSE_TEMPERATURE;
-        JsonArray messages = reqDoc->createNestedArray("messages");
-        JsonObject systemMsg = messages.createNestedObject();
-        systemMsg["role"] = "system";
-        systemMsg["content"] = "You are DeskMate, a friendly desk companion. You speak in short, clear sentences suitable for a speaker or an OLED 128x64 screen. You randomly pick subjects and give short facts. Keep sentences short (8-12 words each). Use Yes/No questions.";
-        JsonObject userMsg = messages.createNestedObject();
-        userMsg["role"] = "user";
-        userMsg["content"] = userMessage;
-
-        // Use a modest payload buffer; request is small so 1536 bytes should be enough.
-        const size_t payloadCap = 1536;
-        char* payload = (char*)heap_caps_malloc(payloadCap, MALLOC_CAP_SPIRAM);
-        if (!payload) {
-            Serial.println("Failed to alloc PSRAM for payload");
-            reqDoc->~StaticJsonDocument();
-            heap_caps_free(reqPool);
-            return String("API Error");
-        }
-        serializeJson(*reqDoc, payload, payloadCap);
-        // free request doc pool
-        reqDoc->~StaticJsonDocument();
-        heap_caps_free(reqPool);
-
-        Serial.println("Sending to DeepSeek: " + userMessage);
         Serial.print("Full payload: "); Serial.println(payload);
 
-        int httpResponseCode = http.POST((uint8_t*)payload, strlen(payload));
+        int httpResponseCode = http.POST((uint8_t*)payload, payloadLen);
 
         // If the POST failed (likely TLS allocation), try one quick retry.
         if (httpResponseCode <= 0) {
-            Serial.println("Initial HTTP POST failed; retrying once");
+            LOG_WARN("Initial HTTP POST failed; retrying once\n");
             http.end();
             WiFiClientSecure client2;
             http.begin(client2, DEEPSEEK_ENDPOINT);
-            httpResponseCode = http.POST((uint8_t*)payload, strlen(payload));
+            httpResponseCode = http.POST((uint8_t*)payload, payloadLen);
         }
 
         String response = "";
@@ -187,10 +240,10 @@ String sendToDeepSeek(const String& userMessage) {
                 size_t respCap = 4096;
                 char* respBuf = (char*)heap_caps_malloc(respCap, MALLOC_CAP_SPIRAM);
                 if (!respBuf) {
-                    Serial.println("Failed to alloc PSRAM for response buffer");
+                    LOG_ERROR("Failed to alloc PSRAM for response buffer\n");
                     // fallback to getString()
                     response = http.getString();
-                    Serial.print("HTTP Response code: "); Serial.println(httpResponseCode);
+                    LOG_INFO("HTTP Response code: %d\n", httpResponseCode);
                     Serial.print("Response: "); Serial.println(response);
                 } else {
                     WiFiClient* stream = http.getStreamPtr();
@@ -217,20 +270,20 @@ String sendToDeepSeek(const String& userMessage) {
                                                 idx = rlen;
                                             }
                                         }
-                                        Serial.print("HTTP Response code: "); Serial.println(httpResponseCode);
+                                        LOG_INFO("HTTP Response code: %d\n", httpResponseCode);
                                         Serial.print("Response: "); Serial.println(respBuf);
 
                     // Parse JSON response in PSRAM via StaticJsonDocument placement-new
                     const size_t RESP_DOC_CAP = 2048;
                     void* respPool = heap_caps_malloc(sizeof(StaticJsonDocument<RESP_DOC_CAP>), MALLOC_CAP_SPIRAM);
                     if (!respPool) {
-                        Serial.println("Failed to alloc PSRAM for response doc");
+                        LOG_ERROR("Failed to alloc PSRAM for response doc\n");
                         response = String(respBuf);
                     } else {
                         StaticJsonDocument<RESP_DOC_CAP>* respDoc = new (respPool) StaticJsonDocument<RESP_DOC_CAP>();
                         DeserializationError err = deserializeJson(*respDoc, respBuf);
                         if (err) {
-                            Serial.print("JSON parsing failed: "); Serial.println(err.c_str());
+                            LOG_WARN("JSON parsing failed: %s\n", err.c_str());
                             response = String(respBuf);
                         } else {
                             if (respDoc->containsKey("choices") && (*respDoc)["choices"].size() > 0) {
@@ -246,35 +299,21 @@ String sendToDeepSeek(const String& userMessage) {
                         heap_caps_free(respBuf);
                 }
         } else {
-                Serial.print("Error on HTTP request: "); Serial.println(httpResponseCode);
+                LOG_ERROR("Error on HTTP request: %d\n", httpResponseCode);
                 response = "API Error";
         }
 
             http.end();
-            heap_caps_free(payload);
 
-            // Restore A2DP callbacks so the stack can operate normally again.
-            resumeBluetoothAfterTLS();
-
-            // Restore audio task depending on how it was stopped. Leave BT
-            // manager running as we did not stop it.
-            if (audio_was_deleted) {
-                startAudioTask();
+            if (keep_audio) {
+                stopThinkingSound();
+                logMemoryBudget("post-tls");
             } else {
-                resumeAudioTask();
+                restoreAudioAfterTLS(audio_was_deleted);
             }
 
-            // Give audio init time
-            delay(200);
-
-            Serial.println("Restored audio task after request (BT manager left running)");
-
-    // Resume audio/BT tasks now that TLS/HTTP work is done. Give tasks a
-    // moment to restart their init paths (they will lazily remount SD).
-    resumeAudioTask();
-
     // Diagnostic: print free heap after TLS and HTTP complete
-    Serial.print("Free heap after TLS: "); Serial.println(String(ESP.getFreeHeap()));
+    LOG_INFO("Free heap after TLS: %u\n", (unsigned)ESP.getFreeHeap());
 
     // `response` already contains the assistant's content (plain text) when parsed
     // above; return it directly to callers. Avoid re-parsing plain text as JSON.
@@ -6,6 +6,7 @@
 #include <HTTPClient.h>
 #include <ArduinoJson.h>
 #include "config.h"
+#include "prompt_writer.h"
 
 // Conversation structure
 struct ConversationState {
@@ -21,6 +22,13 @@ extern ConversationState convState;
 // Function declarations
 bool connectToWiFi();
 String sendToDeepSeek(const String& userMessage);
+// Build the user message in place: the returned writer is positioned inside
+// the request body's user content, append to it with text()/number(), then
+// call finishDeepSeekRequest() to send. Holds the request lock in between.
+PromptWriter& beginDeepSeekRequest();
+String finishDeepSeekRequest();
+// True for the sentinel strings sendToDeepSeek returns on failure
+bool isDeepSeekError(const String& response);
 String parseDeepSeekResponse(const String& jsonResponse);
 bool extractFactFromResponse(const String& response, String& factOut);
 void updateConversationState(const String& response);
@@ -0,0 +1,270 @@
+#include "droid_voice.h"
+#include <math.h>
+#include <string.h>
+
+namespace {
+
+const float kPi = 3.14159265f;
+const int kOutGain = 448;            // Q8 make-up gain (the offline script normalizes to -1 dB)
+const float kNoiseHp = 180.0f, kNoiseLp = 3200.0f;
+const float kBandHp = 250.0f, kBandLp = 4200.0f;
+const float kButterQ[2] = { 0.5411961f, 1.3065630f }; // 4th-order Butterworth sections
+const float kAttackMs = 4.0f, kReleaseMs = 80.0f;
+const float kGlitchRate = 14.0f;
+const int kGlitchDepthQ15 = 9830;    // 0.30
+const float kGateSmoothMs = 5.0f;    // stands in for the script's savgol smoothing
+const uint32_t kToneHz[4] = { 220, 330, 440, 660 };
+const uint16_t kPitchQ8[5] = { 205, 230, 256, 282, 307 }; // 0.8x .. 1.2x
+
+int16_t sineTable[256];
+bool sineReady = false;
+
+void initSine() {
+  if (sineReady) return;
+  for (int i = 0; i < 256; ++i) sineTable[i] = (int16_t)lrintf(32767.0f * sinf(2.0f * kPi * i / 256.0f));
+  sineReady = true;
+}
+
+inline int32_t sine(uint32_t phase) { return sineTable[phase >> 24]; }
+
+inline uint32_t hz(float f) { return (uint32_t)(f * 4294967296.0f / DroidVoice::SAMPLE_RATE); }
+
+inline uint32_t msFrames(int ms) { return (uint32_t)ms * DroidVoice::SAMPLE_RATE / 1000; }
+
+// One-pole smoothing coefficient 1 - exp(-1 / (sr * ms)), Q16
+int32_t onePole(float ms) {
+  return (int32_t)lrintf(65536.0f * (1.0f - expf(-1.0f / (DroidVoice::SAMPLE_RATE * ms / 1000.0f))));
+}
+
+inline uint32_t nextRandom(uint32_t& s) { s = s * 1664525u + 1013904223u; return s; }
+
+inline int16_t saturate(int32_t v) {
+  if (v > 32767) return 32767;
+  if (v < -32768) return -32768;
+  return (int16_t)v;
+}
+
+bool isLetter(char c) {
+  unsigned char u = (unsigned char)c;
+  return (u >= 'a' && u <= 'z') || (u >= 'A' && u <= 'Z') || (u >= '0' && u <= '9') || u >= 0x80;
+}
+
+bool isVowel(char c) {
+  switch (c | 0x20) {
+    case 'a': case 'e': case 'i': case 'o': case 'u': case 'y': return true;
+    default: return false;
+  }
+}
+
+} // namespace
+
+static void setCoefs(Biquad& f, float b0, float b1, float b2, float a0, float a1, float a2) {
+  const float q28 = 268435456.0f;
+  f.b0 = (int32_t)lrintf(b0 / a0 * q28);
+  f.b1 = (int32_t)lrintf(b1 / a0 * q28);
+  f.b2 = (int32_t)lrintf(b2 / a0 * q28);
+  f.a1 = (int32_t)lrintf(a1 / a0 * q28);
+  f.a2 = (int32_t)lrintf(a2 / a0 * q28);
+  f.reset();
+}
+
+void Biquad::lowpass(float fc, float q, float sr) {
+  float w = 2.0f * kPi * fc / sr, c = cosf(w), alpha = sinf(w) / (2.0f * q);
+  setCoefs(*this, (1.0f - c) / 2.0f, 1.0f - c, (1.0f - c) / 2.0f, 1.0f + alpha, -2.0f * c, 1.0f - alpha);
+}
+
+void Biquad::highpass(float fc, float q, float sr) {
+  float w = 2.0f * kPi * fc / sr, c = cosf(w), alpha = sinf(w) / (2.0f * q);
+  setCoefs(*this, (1.0f + c) / 2.0f, -(1.0f + c), (1.0f + c) / 2.0f, 1.0f + alpha, -2.0f * c, 1.0f - alpha);
+}
+
+DroidVoice::DroidVoice() {
+  initSine();
+  attack_ = onePole(kAttackMs);
+  release_ = onePole(kReleaseMs);
+  gateSmooth_ = onePole(kGateSmoothMs);
+  gateInc_ = hz(kGlitchRate);
+  noiseHp_.highpass(kNoiseHp, 0.7071f, SAMPLE_RATE);
+  noiseLp_.lowpass(kNoiseLp, 0.7071f, SAMPLE_RATE);
+  for (int i = 0; i < 2; ++i) {
+    hp_[i].highpass(kBandHp, kButterQ[i], SAMPLE_RATE);
+    lp_[i].lowpass(kBandLp, kButterQ[i], SAMPLE_RATE);
+  }
+  text_[0] = '\0';
+  total_ = 0;
+  segLeft_ = 0;
+  blockLeft_ = 0;
+  done_ = true;
+}
+
+// Cut the text into cadence segments: a voiced burst per syllable
+// (consonants + vowel run, trailing consonants stay with the last
+// syllable of the word), silent gaps between syllables and words, longer
+// pauses at punctuation, and a silent tail at the end.
+bool DroidVoice::scanSegment(const char* text, Cursor& c, Segment& seg) {
+  seg.voiced = false;
+  seg.pitch = 256;
+  if (c.gapNext) {
+    c.gapNext = false;
+    seg.frames = msFrames(SYLLABLE_GAP_MS);
+    return true;
+  }
+  while (text[c.pos]) {
+    char ch = text[c.pos];
+    if (isLetter(ch)) {
+      size_t start = c.pos;
+      while (isLetter(text[c.pos]) && !isVowel(text[c.pos])) ++c.pos;
+      while (isVowel(text[c.pos])) ++c.pos;
+      // Consonants that end the word belong to this syllable
+      size_t p = c.pos;
+      while (isLetter(text[p]) && !isVowel(text[p])) ++p;
+      if (!isLetter(text[p])) c.pos = p;
+      size_t len = c.pos - start;
+      uint32_t h = 2166136261u;
+      for (size_t i = start; i < c.pos; ++i) { h ^= (unsigned char)(text[i] | 0x20); h *= 16777619u; }
+      int ms = SYLLABLE_MS + SYLLABLE_PER_CHAR_MS * (int)len;
+      if (ms > SYLLABLE_MAX_MS) ms = SYLLABLE_MAX_MS;
+      seg.frames = msFrames(ms);
+      seg.voiced = true;
+      seg.pitch = kPitchQ8[h % 5];
+      c.gapNext = isLetter(text[c.pos]);
+      return true;
+    }
+    ++c.pos;
+    switch (ch) {
+      case ' ':
+        while (text[c.pos] == ' ') ++c.pos;
+        seg.frames = msFrames(WORD_GAP_MS);
+        return true;
+      case '.': case '!': case '?': case '\n':
+        seg.frames = msFrames(PAUSE_MS);
+        return true;
+      case ',': case ';': case ':': case '-':
+        seg.frames = msFrames(PAUSE_MS / 2);
+        return true;
+      default:
+        break; // quotes, brackets etc. are silent and take no time
+    }
+  }
+  if (c.tailDone) return false;
+  c.tailDone = true;
+  seg.frames = msFrames(TAIL_MS);
+  return true;
+}
+
+void DroidVoice::begin(const char* text) {
+  if (!text) text = "";
+  size_t n = strlen(text);
+  if (n >= TEXT_MAX) n = TEXT_MAX - 1;
+  memcpy(text_, text, n);
+  text_[n] = '\0';
+
+  // Total length up front, so callers can size progress/timeouts
+  Cursor c = { 0, false, false };
+  Segment s;
+  total_ = 0;
+  while (scanSegment(text_, c, s)) total_ += s.frames;
+
+  uint32_t seed = 2166136261u;
+  for (size_t i = 0; i < n; ++i) { seed ^= (unsigned char)text_[i]; seed *= 16777619u; }
+  rng_ = seed;
+  for (int k = 0; k < 4; ++k) {
+    phase_[k] = nextRandom(rng_);
+    lfoPhase_[k] = nextRandom(rng_);
+    // Drift LFO between 0.25 and 0.60 Hz, as in make_carrier()
+    lfoInc_[k] = hz(0.25f + 0.35f * (nextRandom(rng_) >> 8) / 16777216.0f);
+    inc_[k] = hz((float)kToneHz[k]);
+  }
+  gatePhase_ = nextRandom(rng_);
+  gate_ = 0;
+  env_ = 0;
+  noiseHp_.reset();
+  noiseLp_.reset();
+  for (int i = 0; i < 2; ++i) { hp_[i].reset(); lp_[i].reset(); }
+  held_ = 0;
+  holdCount_ = 0;
+
+  cursor_ = { 0, false, false };
+  segLeft_ = 0;
+  blockLeft_ = 0;
+  seg_.voiced = false;
+  seg_.pitch = 256;
+  done_ = false;
+}
+
+// Control-rate update, once per block: tone frequencies follow the
+// syllable pitch and their slow drift (+-3%).
+void DroidVoice::control() {
+  for (int k = 0; k < 4; ++k) {
+    lfoPhase_[k] += lfoInc_[k] * (uint32_t)BLOCK;
+    int32_t drift = 32768 + ((983 * sine(lfoPhase_[k])) >> 15);
+    uint64_t base = (uint64_t)hz((float)kToneHz[k]) * seg_.pitch >> 8;
+    inc_[k] = (uint32_t)((base * (uint32_t)drift) >> 15);
+  }
+}
+
+inline int16_t DroidVoice::sample() {
+  // Envelope follower on the cadence target: fast attack, slow release
+  int32_t target = seg_.voiced ? (1 << 30) : 0;
+  int32_t coef = target > env_ ? attack_ : release_;
+  env_ += (int32_t)(((int64_t)(target - env_) * coef) >> 16);
+  int32_t e = env_ >> 15;                          // Q15
+  int32_t shaped = (e * (27853 + ((4915 * e) >> 15))) >> 15; // ~ e^1.15
+
+  // Carrier: band-limited noise + four drifting tones
+  int32_t noise = (int32_t)nextRandom(rng_) >> 17;
+  noise = noiseLp_.process(noiseHp_.process(noise));
+  int32_t tones = 0;
+  for (int k = 0; k < 4; ++k) { phase_[k] += inc_[k]; tones += sine(phase_[k]); }
+  int32_t carrier = (21299 * noise + 11469 * (tones >> 2)) >> 15; // 0.65 / 0.35
+  int32_t out = (carrier * shaped) >> 15;
+
+  // Glitch gate: smoothed 14 Hz square, 30% depth
+  gatePhase_ += gateInc_;
+  int32_t sq = gatePhase_ < 0x80000000u ? 32767 : 0;
+  gate_ += ((sq - gate_) * gateSmooth_) >> 16;
+  out = (out * (32768 - kGlitchDepthQ15 + ((kGlitchDepthQ15 * gate_) >> 15))) >> 15;
+
+  // Speaker band, make-up gain, bitcrush, sample-and-hold
+  for (int i = 0; i < 2; ++i) out = hp_[i].process(out);
+  for (int i = 0; i < 2; ++i) out = lp_[i].process(out);
+  out = (out * kOutGain) >> 8;
+  if (holdCount_ == 0) held_ = crush(out);
+  if (++holdCount_ == HOLD) holdCount_ = 0;
+  return held_;
+}
+
+int16_t DroidVoice::crush(int32_t v) {
+  // Masking rounds negative samples too; shifting a negative value left is UB
+  const int32_t step = 1 << (16 - BITS);
+  v = (v + step / 2) & ~(step - 1);
+  if (v > 32767) return (int16_t)(32768 - step);
+  return saturate(v);
+}
+
+size_t DroidVoice::render(int16_t* stereo, size_t frames) {
+  size_t out = 0;
+  while (out < frames && !done_) {
+    if (segLeft_ == 0) {
+      if (!scanSegment(text_, cursor_, seg_)) { done_ = true; break; }
+      segLeft_ = seg_.frames;
+      continue;
+    }
+    if (blockLeft_ == 0) {
+      control();
+      blockLeft_ = BLOCK;
+    }
+    size_t n = frames - out;
+    if (n > (size_t)blockLeft_) n = blockLeft_;
+    if (n > segLeft_) n = segLeft_;
+    blockLeft_ -= (int)n;
+    for (size_t i = 0; i < n; ++i) {
+      int16_t s = sample();
+      stereo[2 * (out + i)] = s;
+      stereo[2 * (out + i) + 1] = s;
+    }
+    out += n;
+    segLeft_ -= (uint32_t)n;
+  }
+  return out;
+}
@@ -0,0 +1,113 @@
+// Streaming "droid speech" synthesizer: a fixed-point port of the offline
+// gibberish.py chain (noise + drifting tones carrier, envelope follower,
+// glitch gate, band filter, bitcrush, sample-and-hold). Instead of following
+// a recorded voice, the envelope follows a cadence derived from the text:
+// one burst per syllable, gaps between words, pauses at punctuation.
+//
+// Output is 44.1 kHz 16-bit stereo, the format the A2DP callback expects.
+// Plain C++ so it can be exercised by the host tests.
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Direct form I biquad with Q28 coefficients (RBJ cookbook designs)
+struct Biquad {
+  int32_t b0, b1, b2, a1, a2;
+  int32_t x1, x2, y1, y2;
+
+  void lowpass(float fc, float q, float sr);
+  void highpass(float fc, float q, float sr);
+  void reset() { x1 = x2 = y1 = y2 = 0; }
+
+  inline int32_t process(int32_t x) {
+    int64_t acc = (int64_t)b0 * x + (int64_t)b1 * x1 + (int64_t)b2 * x2
+                - (int64_t)a1 * y1 - (int64_t)a2 * y2;
+    int32_t y = (int32_t)(acc >> 28);
+    x2 = x1; x1 = x;
+    y2 = y1; y1 = y;
+    return y;
+  }
+};
+
+class DroidVoice {
+public:
+  static const uint32_t SAMPLE_RATE = 44100;
+  static const size_t TEXT_MAX = 320;   // longer text is truncated
+  static const int BLOCK = 32;          // frames between control-rate updates (independent of render() sizes)
+
+  // gibberish.py defaults
+  static const int BITS = 10;           // bitcrush depth
+  static const int HOLD = 3;            // sample-and-hold factor
+
+  // Cadence, in milliseconds
+  static const int SYLLABLE_MS = 90;    // plus SYLLABLE_PER_CHAR_MS per letter
+  static const int SYLLABLE_PER_CHAR_MS = 15;
+  static const int SYLLABLE_MAX_MS = 220;
+  static const int SYLLABLE_GAP_MS = 25;
+  static const int WORD_GAP_MS = 70;
+  static const int PAUSE_MS = 280;      // '.', '!', '?', newline; half for ',;:-'
+  static const int TAIL_MS = 200;       // lets the envelope release at the end
+
+  DroidVoice();
+
+  // Start speaking `text`. The carrier seed is derived from the text, so the
+  // same fact always sounds the same.
+  void begin(const char* text);
+  // Render up to `frames` stereo frames; returns the number written, which
+  // is less than requested only when the utterance ends.
+  size_t render(int16_t* stereo, size_t frames);
+  bool done() const { return done_; }
+  // Length of the whole utterance, known as soon as begin() returns
+  uint32_t totalFrames() const { return total_; }
+
+  // Round to BITS bits and saturate to a value that stays on the crushed grid
+  static int16_t crush(int32_t v);
+
+private:
+  struct Segment {
+    uint32_t frames;
+    bool voiced;
+    uint16_t pitch;  // Q8 multiplier for the tone carrier
+  };
+  struct Cursor {
+    size_t pos;
+    bool gapNext;    // a short gap is due between syllables of one word
+    bool tailDone;
+  };
+
+  static bool scanSegment(const char* text, Cursor& c, Segment& seg);
+  void control();
+  int16_t sample();
+
+  char text_[TEXT_MAX];
+  Cursor cursor_;
+  Segment seg_;
+  uint32_t segLeft_;
+  int blockLeft_;     // frames until the next control-rate update
+  uint32_t total_;
+  bool done_;
+
+  // Carrier
+  uint32_t rng_;
+  uint32_t phase_[4];
+  uint32_t inc_[4];
+  uint32_t lfoPhase_[4];
+  uint32_t lfoInc_[4];
+  Biquad noiseHp_, noiseLp_;
+
+  // Envelope follower (Q30) and its attack/release coefficients (Q16)
+  int32_t env_;
+  int32_t attack_, release_;
+
+  // Glitch gate: smoothed square LFO (Q15)
+  uint32_t gatePhase_;
+  uint32_t gateInc_;
+  int32_t gate_;
+  int32_t gateSmooth_;
+
+  // Output band (4th-order high-pass + 4th-order low-pass), crush, hold
+  Biquad hp_[2], lp_[2];
+  int16_t held_;
+  int holdCount_;
+};
@@ -0,0 +1,388 @@
+#include "fact_cache.h"
+#include "config.h"
+#include "bluetooth_audio.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_heap_caps.h"
+
+// On-disk record header. A FACT record is followed by `len` bytes of text.
+struct FactRecord {
+    uint32_t magic;
+    uint8_t type;
+    uint8_t flags;
+    uint16_t len;
+    uint32_t subjectHash;
+    uint32_t factHash;
+};
+
+static const uint32_t FACT_RECORD_MAGIC = 0x43464D44; // "DMFC"
+static const uint8_t FACT_RECORD_FACT = 1;
+static const uint8_t FACT_RECORD_SERVED = 2;
+static const uint8_t FACT_FLAG_SERVED = 0x01;
+
+// RAM index: open-addressing table of subjects, each with a small ring of
+// the most recent facts. Lives in PSRAM; ~55 KB with the default sizes.
+struct FactEntry {
+    uint32_t offset;   // file offset of the fact text
+    uint32_t hash;     // FNV-1a of the fact text
+    uint16_t len;
+    uint8_t served;
+    uint8_t used;
+};
+
+struct SubjectSlot {
+    uint32_t subjectHash; // 0 = empty slot
+    uint8_t next;         // ring write position
+    uint8_t reserved[3];
+    FactEntry entries[FACT_CACHE_PER_SUBJECT];
+};
+
+static SubjectSlot* slots = nullptr;
+static SemaphoreHandle_t cache_mutex = NULL;
+static volatile bool cache_ready = false;
+static uint32_t log_size = 0;
+
+static uint32_t fnv1a(const char* s, size_t n) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < n; ++i) {
+        h ^= (uint8_t)s[i];
+        h *= 16777619u;
+    }
+    return h ? h : 1; // 0 marks an empty slot
+}
+
+static uint32_t hashString(const String& s) {
+    return fnv1a(s.c_str(), s.length());
+}
+
+static SubjectSlot* findSlot(uint32_t subjectHash, bool create) {
+    uint32_t mask = FACT_CACHE_SLOTS - 1;
+    for (uint32_t i = 0; i < FACT_CACHE_SLOTS; ++i) {
+        SubjectSlot* s = &slots[(subjectHash + i) & mask];
+        if (s->subjectHash == subjectHash) return s;
+        if (s->subjectHash == 0) {
+            if (!create) return nullptr;
+            s->subjectHash = subjectHash;
+            return s;
+        }
+    }
+    return nullptr; // table full
+}
+
+static FactEntry* findEntry(SubjectSlot* s, uint32_t factHash) {
+    for (int i = 0; i < FACT_CACHE_PER_SUBJECT; ++i) {
+        if (s->entries[i].used && s->entries[i].hash == factHash) return &s->entries[i];
+    }
+    return nullptr;
+}
+
+// Returns false if the fact was already indexed (only the served flag is merged).
+static bool indexFact(uint32_t subjectHash, uint32_t factHash, uint32_t offset, uint16_t len, bool served) {
+    SubjectSlot* s = findSlot(subjectHash, true);
+    if (!s) return false;
+    FactEntry* e = findEntry(s, factHash);
+    if (e) {
+        if (served) e->served = 1;
+        return false;
+    }
+    e = &s->entries[s->next];
+    e->offset = offset;
+    e->hash = factHash;
+    e->len = len;
+    e->served = served ? 1 : 0;
+    e->used = 1;
+    s->next = (s->next + 1) % FACT_CACHE_PER_SUBJECT;
+    return true;
+}
+
+static bool ensureSD() {
+    if (!isSDMounted()) initSDCard();
+    return isSDMounted();
+}
+
+static bool readFactText(File& f, const FactEntry& e, String& out) {
+    char buf[FACT_CACHE_MAX_FACT + 1];
+    uint16_t len = e.len > FACT_CACHE_MAX_FACT ? FACT_CACHE_MAX_FACT : e.len;
+    if (!f.seek(e.offset)) return false;
+    if (f.read((uint8_t*)buf, len) != len) return false;
+    buf[len] = '\0';
+    if (fnv1a(buf, len) != e.hash) return false; // stale offset or torn write
+    out = buf;
+    return true;
+}
+
+static bool loadEntry(const FactEntry& e, String& out) {
+    if (!ensureSD()) return false;
+    File f = SD_MMC.open(FACT_CACHE_PATH, FILE_READ);
+    if (!f) return false;
+    bool ok = readFactText(f, e, out);
+    f.close();
+    return ok;
+}
+
+static bool appendRecord(const FactRecord& rec, const char* text) {
+    if (!ensureSD()) return false;
+    File f = SD_MMC.open(FACT_CACHE_PATH, FILE_APPEND);
+    if (!f) {
+        Serial.println("FactCache: failed to open log for append");
+        return false;
+    }
+    size_t want = sizeof(rec) + rec.len;
+    size_t wrote = f.write((const uint8_t*)&rec, sizeof(rec));
+    if (rec.len) wrote += f.write((const uint8_t*)text, rec.len);
+    f.close();
+    if (wrote != want) {
+        Serial.println("FactCache: short write to log");
+        return false;
+    }
+    log_size += want;
+    return true;
+}
+
+#define FACT_CACHE_TMP_PATH FACT_CACHE_PATH ".tmp"
+#define FACT_CACHE_BAK_PATH FACT_CACHE_PATH ".bak"
+
+// Rewrite the log keeping only indexed facts. New offsets are staged and only
+// applied to the index once the new file has replaced the old one, so any
+// failure leaves both the log and the index as they were. The swap goes
+// live -> .bak, .tmp -> live, then drops .bak; recoverLog() finishes or
+// undoes a swap that was interrupted by a reset.
+static bool compactLog() {
+    const uint32_t total = FACT_CACHE_SLOTS * FACT_CACHE_PER_SUBJECT;
+    uint32_t* staged = (uint32_t*)heap_caps_calloc(total, sizeof(uint32_t), MALLOC_CAP_SPIRAM);
+    if (!staged) {
+        Serial.println("FactCache: no memory to compact log");
+        return false;
+    }
+    File in = SD_MMC.open(FACT_CACHE_PATH, FILE_READ);
+    File out = SD_MMC.open(FACT_CACHE_TMP_PATH, FILE_WRITE);
+    if (!out) {
+        if (in) in.close();
+        free(staged);
+        return false;
+    }
+    uint32_t pos = 0;
+    bool ok = true;
+    for (uint32_t i = 0; i < FACT_CACHE_SLOTS && ok; ++i) {
+        SubjectSlot& s = slots[i];
+        if (!s.subjectHash) continue;
+        for (int j = 0; j < FACT_CACHE_PER_SUBJECT; ++j) {
+            FactEntry& e = s.entries[j];
+            if (!e.used) continue;
+            String text;
+            if (!in || !readFactText(in, e, text)) continue; // staged offset 0: drop it
+            FactRecord rec = {FACT_RECORD_MAGIC, FACT_RECORD_FACT,
+                              (uint8_t)(e.served ? FACT_FLAG_SERVED : 0),
+                              (uint16_t)text.length(), s.subjectHash, e.hash};
+            size_t wrote = out.write((const uint8_t*)&rec, sizeof(rec));
+            wrote += out.write((const uint8_t*)text.c_str(), rec.len);
+            if (wrote != sizeof(rec) + rec.len) {
+                ok = false;
+                break;
+            }
+            staged[i * FACT_CACHE_PER_SUBJECT + j] = pos + sizeof(rec);
+            pos += sizeof(rec) + rec.len;
+        }
+    }
+    if (in) in.close();
+    out.close();
+
+    if (!ok) {
+        Serial.println("FactCache: short write during compaction");
+    } else if (SD_MMC.exists(FACT_CACHE_PATH) && !SD_MMC.rename(FACT_CACHE_PATH, FACT_CACHE_BAK_PATH)) {
+        Serial.println("FactCache: could not move log aside for compaction");
+        ok = false;
+    } else if (!SD_MMC.rename(FACT_CACHE_TMP_PATH, FACT_CACHE_PATH)) {
+        Serial.println("FactCache: rename after compaction failed");
+        SD_MMC.rename(FACT_CACHE_BAK_PATH, FACT_CACHE_PATH);
+        ok = false;
+    }
+    if (!ok) {
+        SD_MMC.remove(FACT_CACHE_TMP_PATH);
+        free(staged);
+        return false;
+    }
+    SD_MMC.remove(FACT_CACHE_BAK_PATH);
+
+    for (uint32_t i = 0; i < FACT_CACHE_SLOTS; ++i) {
+        SubjectSlot& s = slots[i];
+        if (!s.subjectHash) continue;
+        for (int j = 0; j < FACT_CACHE_PER_SUBJECT; ++j) {
+            FactEntry& e = s.entries[j];
+            if (!e.used) continue;
+            uint32_t offset = staged[i * FACT_CACHE_PER_SUBJECT + j];
+            if (offset) e.offset = offset;
+            else e.used = 0;
+        }
+    }
+    free(staged);
+    log_size = pos;
+    Serial.printf("FactCache: compacted log to %u bytes\n", (unsigned)pos);
+    return true;
+}
+
+// Clean up after a compaction cut short by a reset. With no live log the
+// swap stopped between its two renames, so the old log is put back; with a
+// live log any .bak is the superseded copy. A .tmp is never complete enough
+// to trust.
+static void recoverLog() {
+    if (SD_MMC.exists(FACT_CACHE_BAK_PATH)) {
+        if (SD_MMC.exists(FACT_CACHE_PATH)) {
+            SD_MMC.remove(FACT_CACHE_BAK_PATH);
+        } else if (SD_MMC.rename(FACT_CACHE_BAK_PATH, FACT_CACHE_PATH)) {
+            Serial.println("FactCache: restored log from interrupted compaction");
+        }
+    }
+    if (SD_MMC.exists(FACT_CACHE_TMP_PATH)) SD_MMC.remove(FACT_CACHE_TMP_PATH);
+}
+
+// Replay the log into the index. Returns false if a torn or corrupt tail was
+// found (the valid prefix is still indexed).
+static bool replayLog() {
+    File f = SD_MMC.open(FACT_CACHE_PATH, FILE_READ);
+    if (!f) {
+        log_size = 0;
+        return true; // no log yet
+    }
+    uint32_t size = f.size();
+    uint32_t pos = 0;
+    bool clean = true;
+    int facts = 0;
+    while (pos + sizeof(FactRecord) <= size) {
+        FactRecord rec;
+        if (f.read((uint8_t*)&rec, sizeof(rec)) != sizeof(rec) || rec.magic != FACT_RECORD_MAGIC) {
+            clean = false;
+            break;
+        }
+        uint32_t textPos = pos + sizeof(rec);
+        if (rec.type == FACT_RECORD_FACT) {
+            if (rec.len > FACT_CACHE_MAX_FACT || textPos + rec.len > size) {
+                clean = false;
+                break;
+            }
+            if (indexFact(rec.subjectHash, rec.factHash, textPos, rec.len, rec.flags & FACT_FLAG_SERVED)) ++facts;
+            f.seek(textPos + rec.len);
+        } else if (rec.type == FACT_RECORD_SERVED) {
+            SubjectSlot* s = findSlot(rec.subjectHash, false);
+            FactEntry* e = s ? findEntry(s, rec.factHash) : nullptr;
+            if (e) e->served = 1;
+        } else {
+            clean = false;
+            break;
+        }
+        pos = textPos + (rec.type == FACT_RECORD_FACT ? rec.len : 0);
+    }
+    if (pos != size) clean = false;
+    f.close();
+    log_size = pos;
+    Serial.printf("FactCache: indexed %d facts from %u bytes\n", facts, (unsigned)pos);
+    return clean;
+}
+
+bool initFactCache() {
+    if (cache_mutex == NULL) cache_mutex = xSemaphoreCreateMutex();
+    if (slots == nullptr) {
+        slots = (SubjectSlot*)heap_caps_calloc(FACT_CACHE_SLOTS, sizeof(SubjectSlot), MALLOC_CAP_SPIRAM);
+        if (!slots) {
+            Serial.println("FactCache: failed to alloc PSRAM index");
+            return false;
+        }
+    }
+    xSemaphoreTake(cache_mutex, portMAX_DELAY);
+    cache_ready = false;
+    memset(slots, 0, FACT_CACHE_SLOTS * sizeof(SubjectSlot));
+    bool ok = ensureSD();
+    if (ok) {
+        recoverLog();
+        // A torn tail would make later appends unreadable; compact it away.
+        if (!replayLog() || log_size > FACT_CACHE_MAX_BYTES) compactLog();
+        cache_ready = true;
+    } else {
+        Serial.println("FactCache: SD not mounted");
+    }
+    xSemaphoreGive(cache_mutex);
+    return ok;
+}
+
+bool isFactCacheReady() { return cache_ready; }
+
+static bool takeLocked(const String& subject, bool freshOnly, String& factOut) {
+    SubjectSlot* s = findSlot(hashString(subject), false);
+    if (!s) return false;
+    // Walk the ring newest-first
+    for (int k = 1; k <= FACT_CACHE_PER_SUBJECT; ++k) {
+        FactEntry& e = s->entries[(s->next + FACT_CACHE_PER_SUBJECT - k) % FACT_CACHE_PER_SUBJECT];
+        if (!e.used || (freshOnly && e.served)) continue;
+        if (!loadEntry(e, factOut)) {
+            e.used = 0; // unreadable; drop from index
+            continue;
+        }
+        if (!e.served) {
+            e.served = 1;
+            FactRecord rec = {FACT_RECORD_MAGIC, FACT_RECORD_SERVED, 0, 0, s->subjectHash, e.hash};
+            appendRecord(rec, nullptr);
+        }
+        return true;
+    }
+    return false;
+}
+
+bool factCacheTakeFresh(const String& subject, String& factOut) {
+    if (!cache_ready) return false;
+    xSemaphoreTake(cache_mutex, portMAX_DELAY);
+    bool ok = takeLocked(subject, true, factOut);
+    xSemaphoreGive(cache_mutex);
+    return ok;
+}
+
+bool factCacheTakeAny(const String& subject, String& factOut) {
+    if (!cache_ready) return false;
+    xSemaphoreTake(cache_mutex, portMAX_DELAY);
+    bool ok = takeLocked(subject, true, factOut) || takeLocked(subject, false, factOut);
+    xSemaphoreGive(cache_mutex);
+    return ok;
+}
+
+bool factCacheStore(const String& subject, const String& fact, bool served) {
+#if MOCK_DEEPSEEK
+    // Never persist canned mock responses; they would be served as real
+    // facts once mocking is turned off.
+    (void)subject; (void)fact; (void)served;
+    return false;
+#else
+    if (!cache_ready) return false;
+    if (fact.length() == 0 || fact.length() > FACT_CACHE_MAX_FACT) return false;
+    uint32_t subjectHash = hashString(subject);
+    uint32_t factHash = hashString(fact);
+    xSemaphoreTake(cache_mutex, portMAX_DELAY);
+    bool stored = false;
+    SubjectSlot* s = findSlot(subjectHash, true);
+    if (s && !findEntry(s, factHash)) {
+        uint32_t offset = log_size + sizeof(FactRecord);
+        FactRecord rec = {FACT_RECORD_MAGIC, FACT_RECORD_FACT,
+                          (uint8_t)(served ? FACT_FLAG_SERVED : 0),
+                          (uint16_t)fact.length(), subjectHash, factHash};
+        if (appendRecord(rec, fact.c_str())) {
+            indexFact(subjectHash, factHash, offset, rec.len, served);
+            stored = true;
+            if (log_size > FACT_CACHE_MAX_BYTES) compactLog();
+        }
+    }
+    xSemaphoreGive(cache_mutex);
+    return stored;
+#endif
+}
+
+int factCacheFreshCount(const String& subject) {
+    if (!cache_ready) return 0;
+    xSemaphoreTake(cache_mutex, portMAX_DELAY);
+    int n = 0;
+    SubjectSlot* s = findSlot(hashString(subject), false);
+    if (s) {
+        for (int i = 0; i < FACT_CACHE_PER_SUBJECT; ++i) {
+            if (s->entries[i].used && !s->entries[i].served) ++n;
+        }
+    }
+    xSemaphoreGive(cache_mutex);
+    return n;
+}
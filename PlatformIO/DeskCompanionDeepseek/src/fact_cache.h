@@ -0,0 +1,36 @@
+#ifndef FACT_CACHE_H
+#define FACT_CACHE_H
+
+#include <Arduino.h>
+#include "config.h"
+
+// Persistent fact cache on the SD card.
+//
+// Facts are appended to FACT_CACHE_PATH as fixed-header records; nothing is
+// ever rewritten in place. A small in-RAM (PSRAM) hash table keyed by the
+// subject name remembers the last FACT_CACHE_PER_SUBJECT facts per subject
+// (file offset + fact hash + served flag) so lookups never scan the file.
+// The log is replayed once at mount time to rebuild the index, and compacted
+// when it grows past FACT_CACHE_MAX_BYTES.
+
+// Rebuild the RAM index from the log. Safe to call again after a remount.
+bool initFactCache();
+
+// Pop the newest not-yet-served fact for `subject`. Marks it served
+// (persisted) so it is not repeated after a reboot.
+bool factCacheTakeFresh(const String& subject, String& factOut);
+
+// Return any cached fact for `subject` (served or not). Used as a fallback
+// when WiFi or the API is down.
+bool factCacheTakeAny(const String& subject, String& factOut);
+
+// Append a fact for `subject`. Returns false if it is already cached (repeat)
+// or the SD card is unavailable. `served` marks it as already shown.
+bool factCacheStore(const String& subject, const String& fact, bool served);
+
+// Number of cached facts for `subject` that have not been shown yet.
+int factCacheFreshCount(const String& subject);
+
+bool isFactCacheReady();
+
+#endif // FACT_CACHE_H
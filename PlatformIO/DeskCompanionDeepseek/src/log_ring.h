@@ -0,0 +1,124 @@
+// Lock-free multi-producer/single-consumer ring of variable-length records,
+// used by the async logger (one ring per core).
+//
+// Producers claim space with a compare-and-swap on the head counter, fill
+// the record and then publish it by storing its header word; they never
+// block or take a lock. The single consumer takes records in claim order
+// and stops at the first one not yet published. Freed space is zeroed so a
+// half-written header can never look published. Records that would straddle
+// the end of the buffer are preceded by a padding record.
+//
+// The head counter must live in internal RAM (compare-and-swap does not
+// work on PSRAM); the record buffer itself may be in PSRAM.
+// Plain C++ so it can be exercised by the host tests.
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+
+class LogRing {
+public:
+  static const size_t HEADER = 8;  // header word + timestamp
+  static const size_t ALIGN = 8;   // record sizes are multiples of this
+
+  LogRing() : buf_(nullptr), mask_(0), head_(0), tail_(0) {}
+
+  // `buf` must hold `capacity` bytes; capacity must be a power of two.
+  bool init(uint8_t* buf, size_t capacity) {
+    // Record sizes are 16-bit, so one ring holds at most 64 KB
+    if (!buf || capacity < 64 || capacity > 65536 || (capacity & (capacity - 1)) != 0) return false;
+    memset(buf, 0, capacity);
+    buf_ = buf;
+    mask_ = capacity - 1;
+    head_.store(0, std::memory_order_relaxed);
+    tail_.store(0, std::memory_order_relaxed);
+    return true;
+  }
+
+  bool ready() const { return buf_ != nullptr; }
+  size_t capacity() const { return buf_ ? mask_ + 1 : 0; }
+  // Largest payload reserve() accepts; longer text must be split
+  size_t maxPayload() const { return buf_ ? capacity() / 2 - HEADER : 0; }
+  size_t used() const {
+    return head_.load(std::memory_order_acquire) - tail_.load(std::memory_order_acquire);
+  }
+
+  // Producer: claim room for `len` payload bytes. Returns the payload
+  // pointer, or nullptr if the ring is full or `len` exceeds maxPayload()
+  // (the caller counts the drop).
+  uint8_t* reserve(size_t len) {
+    size_t need = recordSize(len);
+    if (!buf_ || need > capacity() / 2) return nullptr;
+    size_t head = head_.load(std::memory_order_relaxed);
+    size_t pad, off;
+    do {
+      off = head & mask_;
+      size_t contiguous = capacity() - off;
+      pad = need > contiguous ? contiguous : 0;
+      size_t tail = tail_.load(std::memory_order_acquire);
+      if (head + pad + need - tail > capacity()) return nullptr;
+    } while (!head_.compare_exchange_weak(head, head + pad + need,
+                                          std::memory_order_acq_rel,
+                                          std::memory_order_relaxed));
+    if (pad) {
+      publish(off, pad, 0, 0, PAD, 0);
+      off = 0;
+    }
+    return buf_ + off + HEADER;
+  }
+
+  // Producer: publish a record returned by reserve() with the same `len`.
+  // `tag` is free for the caller (level, record kind).
+  void commit(uint8_t* payload, size_t len, uint8_t tag, uint32_t stamp) {
+    size_t size = recordSize(len);
+    publish((size_t)(payload - HEADER - buf_), size, tag, stamp, 0, (uint32_t)(size - HEADER - len));
+  }
+
+  // Consumer: oldest published record, or false if none is ready.
+  bool peek(const uint8_t** payload, size_t* len, uint8_t* tag, uint32_t* stamp) {
+    for (;;) {
+      size_t tail = tail_.load(std::memory_order_relaxed);
+      if (tail == head_.load(std::memory_order_acquire)) return false;
+      uint8_t* rec = buf_ + (tail & mask_);
+      uint32_t word = __atomic_load_n((uint32_t*)rec, __ATOMIC_ACQUIRE);
+      if (!(word & PUBLISHED)) return false;
+      if (word & PAD) { pop(); continue; }
+      if (payload) *payload = rec + HEADER;
+      if (len) *len = (word & 0xFFFF) - HEADER - ((word >> 24) & 0x07);
+      if (tag) *tag = (uint8_t)(word >> 16);
+      if (stamp) memcpy(stamp, rec + 4, 4);
+      return true;
+    }
+  }
+
+  // Consumer: drop the record returned by peek().
+  void pop() {
+    size_t tail = tail_.load(std::memory_order_relaxed);
+    uint8_t* rec = buf_ + (tail & mask_);
+    size_t size = __atomic_load_n((uint32_t*)rec, __ATOMIC_ACQUIRE) & 0xFFFF;
+    memset(rec, 0, size);
+    tail_.store(tail + size, std::memory_order_release);
+  }
+
+private:
+  // Header word: bits 0-15 record size, 16-23 tag, 24-26 payload slack,
+  // 30 padding record, 31 published.
+  static const uint32_t PUBLISHED = 0x80000000u;
+  static const uint32_t PAD = 0x40000000u;
+
+  static size_t recordSize(size_t len) { return (HEADER + len + ALIGN - 1) & ~(ALIGN - 1); }
+
+  void publish(size_t off, size_t size, uint8_t tag, uint32_t stamp, uint32_t flags, uint32_t slack) {
+    uint8_t* rec = buf_ + off;
+    memcpy(rec + 4, &stamp, 4);
+    uint32_t word = (uint32_t)size | ((uint32_t)tag << 16) | (slack << 24) | flags | PUBLISHED;
+    __atomic_store_n((uint32_t*)rec, word, __ATOMIC_RELEASE);
+  }
+
+  uint8_t* buf_;
+  size_t mask_;
+  std::atomic<size_t> head_; // bytes claimed by producers
+  std::atomic<size_t> tail_; // bytes released by the consumer
+};
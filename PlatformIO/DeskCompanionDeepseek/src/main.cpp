@@ -6,17 +6,25 @@
 #include "bluetooth_audio.h" // kept for reference; bluetooth/audio startup disabled below
 #include "oled_display.h"
 #include "touch_input.h"
+#include "memory_budget.h"
+#include "async_log.h"
 #include "freertos/task.h"
 
 // Task prototypes implemented in tasks/*.cpp
 void taskConversation(void* arg);
 void taskBTAudio(void* arg);
+void taskFactCache(void* arg);
 
 void setup() {
   Serial.begin(115200);
   delay(200);
+  // Serial output from here on is queued and written by a background task
+  initAsyncLog();
   Serial.println("DeskMate: starting task-based launcher");
 
+  // Reserve internal RAM for TLS before BT/SD fragment the heap
+  initMemoryBudget();
+
   // Initialize display and touch before starting tasks so UI calls are safe
   initDisplay();
   displaySplashScreen();
@@ -28,6 +36,9 @@ void setup() {
   // Start Bluetooth+SD starter task (creates BT manager + audio worker)
   xTaskCreatePinnedToCore(taskBTAudio, "btaudio", 4096, nullptr, 1, nullptr, 1);
 
+  // Idle-time prefetch into the SD fact cache
+  xTaskCreatePinnedToCore(taskFactCache, "factcache", 8192, nullptr, 1, nullptr, 1);
+
   Serial.println("Tasks created");
 }
 
@@ -0,0 +1,99 @@
+#include "memory_budget.h"
+#include "async_log.h"
+#include "config.h"
+#include "esp_heap_caps.h"
+#include "multi_heap.h"
+
+#if __has_include("mbedtls/platform.h")
+#include "mbedtls/platform.h"
+#endif
+// mbedtls_platform_set_calloc_free() only exists when the allocator is
+// runtime-configurable (ESP-IDF's default mbedTLS config).
+#if defined(MBEDTLS_PLATFORM_MEMORY) && !defined(MBEDTLS_PLATFORM_CALLOC_MACRO)
+#define HAVE_MBEDTLS_ALLOC_HOOK 1
+#else
+#define HAVE_MBEDTLS_ALLOC_HOOK 0
+#endif
+
+static uint8_t* tls_pool = nullptr;
+static multi_heap_handle_t tls_heap = NULL;
+static portMUX_TYPE tls_heap_mux = portMUX_INITIALIZER_UNLOCKED;
+static volatile bool tls_pool_active = false;
+static volatile uint32_t tls_fallbacks = 0;
+
+static bool inPool(void* p) {
+    return tls_pool && (uint8_t*)p >= tls_pool && (uint8_t*)p < tls_pool + TLS_POOL_SIZE;
+}
+
+#if HAVE_MBEDTLS_ALLOC_HOOK
+static void* tls_calloc(size_t n, size_t size) {
+    size_t total = n * size;
+    if (size && total / size != n) return nullptr;
+    void* p = nullptr;
+    if (tls_heap) {
+        portENTER_CRITICAL(&tls_heap_mux);
+        p = multi_heap_malloc(tls_heap, total);
+        portEXIT_CRITICAL(&tls_heap_mux);
+    }
+    if (p) {
+        memset(p, 0, total);
+        return p;
+    }
+    // Pool exhausted or block too large: same order as the IDF default
+    tls_fallbacks++;
+    p = heap_caps_calloc(n, size, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    if (!p) p = heap_caps_calloc(n, size, MALLOC_CAP_SPIRAM);
+    return p;
+}
+
+static void tls_free(void* p) {
+    if (!p) return;
+    if (inPool(p)) {
+        portENTER_CRITICAL(&tls_heap_mux);
+        multi_heap_free(tls_heap, p);
+        portEXIT_CRITICAL(&tls_heap_mux);
+    } else {
+        heap_caps_free(p);
+    }
+}
+#endif
+
+bool initMemoryBudget() {
+    if (tls_pool_active) return true;
+#if HAVE_MBEDTLS_ALLOC_HOOK
+    tls_pool = (uint8_t*)heap_caps_malloc(TLS_POOL_SIZE, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    if (!tls_pool) {
+        Serial.println("MemBudget: could not reserve TLS pool; using teardown path");
+        return false;
+    }
+    tls_heap = multi_heap_register(tls_pool, TLS_POOL_SIZE);
+    if (!tls_heap) {
+        heap_caps_free(tls_pool);
+        tls_pool = nullptr;
+        Serial.println("MemBudget: multi_heap_register failed");
+        return false;
+    }
+    mbedtls_platform_set_calloc_free(tls_calloc, tls_free);
+    tls_pool_active = true;
+    logMemoryBudget("boot");
+    return true;
+#else
+    Serial.println("MemBudget: mbedTLS allocator not configurable; using teardown path");
+    return false;
+#endif
+}
+
+bool isTLSPoolReserved() { return tls_pool_active; }
+
+void logMemoryBudget(const char* tag) {
+    size_t poolFree = 0, poolMin = 0;
+    if (tls_heap) {
+        poolFree = multi_heap_free_size(tls_heap);
+        poolMin = multi_heap_minimum_free_size(tls_heap);
+    }
+    LOG_INFO("MemBudget[%s]: tls pool free=%u min=%u fallbacks=%u | internal free=%u largest=%u | psram free=%u\n",
+             tag, (unsigned)poolFree, (unsigned)poolMin, (unsigned)tls_fallbacks,
+             (unsigned)heap_caps_get_free_size(MALLOC_CAP_INTERNAL),
+             (unsigned)heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL),
+             (unsigned)heap_caps_get_free_size(MALLOC_CAP_SPIRAM));
+}
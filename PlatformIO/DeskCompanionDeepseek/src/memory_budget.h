@@ -0,0 +1,25 @@
+#ifndef MEMORY_BUDGET_H
+#define MEMORY_BUDGET_H
+
+#include <Arduino.h>
+#include "config.h"
+
+// Internal-RAM budget for TLS.
+//
+// At boot, before Bluetooth and SD fragment the internal heap, a contiguous
+// TLS_POOL_SIZE block is reserved and handed to mbedTLS as its allocator.
+// Handshakes then no longer depend on how much internal heap A2DP and SD
+// happen to leave free, so audio and the SD card can stay up during requests.
+// Allocations that don't fit the pool fall back to internal heap, then PSRAM.
+
+// Reserve the pool and install the mbedTLS allocator. Call once from
+// setup() before any task starts.
+bool initMemoryBudget();
+
+// True when the pool is reserved and mbedTLS allocates from it.
+bool isTLSPoolReserved();
+
+// Print pool usage (free / low-water mark / fallbacks) and heap totals.
+void logMemoryBudget(const char* tag);
+
+#endif // MEMORY_BUDGET_H
@@ -1,17 +1,98 @@
 #include "oled_display.h"
 #include "config.h"
 #include "bluetooth_audio.h"
+#include "text_layout.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
 
 TwoWire customWire = TwoWire(1);
 Adafruit_SSD1306 display(SCREEN_WIDTH, SCREEN_HEIGHT, &customWire, -1);
 
 static volatile bool oled_enabled = false;
 
-void initDisplay() {
-    enableOLED();
+// Last frame sent to the panel. flushDisplay() diffs the Adafruit buffer
+// against it and only sends the changed column range of each changed page.
+static const int OLED_PAGES = SCREEN_HEIGHT / 8;
+static uint8_t shadow[SCREEN_WIDTH * OLED_PAGES];
+static bool shadow_valid = false;
+static uint32_t i2c_bytes_sent = 0;
+
+// Display task: callers post messages and return immediately; the task
+// renders and flushes. The mutex serializes panel access with enable/disable,
+// which the SD mount path calls from the audio task.
+enum DisplayMsgKind : uint8_t { DISPLAY_MSG_TEXT, DISPLAY_MSG_WRAPPED, DISPLAY_MSG_SCROLL };
+struct DisplayMsg {
+    DisplayMsgKind kind;
+    int8_t line;
+    char text[DISPLAY_MSG_MAX];
+};
+static QueueHandle_t display_q = NULL;
+static TaskHandle_t display_task_handle = NULL;
+static SemaphoreHandle_t display_mutex = NULL;
+
+// Layouts of recently shown facts, so showing one of them again skips the
+// word-wrap pass; wrapped_layout is the one currently on screen.
+static TextLayoutCache layout_cache;
+static const TextLayout* wrapped_layout = nullptr;
+static TextScroller wrapped_scroller;
+
+static void lockDisplay() {
+    if (display_mutex) xSemaphoreTake(display_mutex, portMAX_DELAY);
 }
 
-void enableOLED() {
+static void unlockDisplay() {
+    if (display_mutex) xSemaphoreGive(display_mutex);
+}
+
+// Send columns [c0, c1] of one page using SSD1306 page/column addressing.
+static void sendPageRange(uint8_t page, uint8_t c0, uint8_t c1, const uint8_t* data) {
+    display.ssd1306_command(SSD1306_PAGEADDR);
+    display.ssd1306_command(page);
+    display.ssd1306_command(page);
+    display.ssd1306_command(SSD1306_COLUMNADDR);
+    display.ssd1306_command(c0);
+    display.ssd1306_command(c1);
+    size_t n = (size_t)(c1 - c0) + 1;
+    for (size_t i = 0; i < n; i += OLED_I2C_CHUNK) {
+        size_t len = n - i < OLED_I2C_CHUNK ? n - i : OLED_I2C_CHUNK;
+        customWire.beginTransmission(OLED_ADDR);
+        customWire.write((uint8_t)0x40); // Co=0, D/C#=1: data stream
+        customWire.write(data + i, len);
+        customWire.endTransmission();
+    }
+    i2c_bytes_sent += n;
+}
+
+void flushDisplay() {
+    if (!oled_enabled) return;
+    const uint8_t* buf = display.getBuffer();
+    for (int page = 0; page < OLED_PAGES; ++page) {
+        const uint8_t* row = buf + page * SCREEN_WIDTH;
+        uint8_t* old = shadow + page * SCREEN_WIDTH;
+        if (shadow_valid && memcmp(row, old, SCREEN_WIDTH) == 0) continue;
+        int c0 = 0, c1 = SCREEN_WIDTH - 1;
+        if (shadow_valid) {
+            while (row[c0] == old[c0]) ++c0;
+            while (row[c1] == old[c1]) --c1;
+        }
+        sendPageRange(page, c0, c1, row + c0);
+        memcpy(old + c0, row + c0, c1 - c0 + 1);
+    }
+    shadow_valid = true;
+}
+
+// Full-frame push (used right after display.begin(), when the panel
+// contents are unknown); leaves the shadow in sync.
+static void pushFull() {
+    display.display();
+    memcpy(shadow, display.getBuffer(), sizeof(shadow));
+    shadow_valid = true;
+    i2c_bytes_sent += sizeof(shadow);
+}
+
+uint32_t displayBytesSent() { return i2c_bytes_sent; }
+
+static void enableOLEDLocked() {
     if (oled_enabled) return;
     Serial.println("Enabling OLED (probing I2C pins)");
     // Try configured pins first, then a small list of fallback SDA/SCL pairs
@@ -55,25 +136,120 @@ void enableOLED() {
     display.setTextColor(SSD1306_WHITE);
     display.setCursor(0, 0);
     display.println("Hello ESP32-CAM!");
-    display.display();
+    pushFull();
 
     oled_enabled = true;
     Serial.println("OLED initialized successfully");
 }
 
-void disableOLED() {
+static void disableOLEDLocked() {
     if (!oled_enabled) return;
     Serial.println("Disabling OLED to free pins for SD use");
     display.clearDisplay();
-    display.display();
+    flushDisplay();
     delay(50);
     // End the custom Wire to release SDA/SCL GPIOs
     customWire.end();
     oled_enabled = false;
+    // Panel state is unknown until the next begin()
+    shadow_valid = false;
     // small pause so hardware settles
     delay(150);
 }
 
+// Redraw the wrapped text at the scroller's offset and push the diff
+static void renderWrapped() {
+    if (wrapped_layout) wrapped_layout->render(display.getBuffer(), SCREEN_WIDTH, SCREEN_HEIGHT, wrapped_scroller.offset());
+    flushDisplay();
+}
+
+static void renderMessage(const DisplayMsg& msg) {
+    if (msg.kind == DISPLAY_MSG_WRAPPED) {
+        wrapped_layout = &layout_cache.layout(msg.text, SCREEN_WIDTH);
+        wrapped_scroller.start(*wrapped_layout, SCREEN_HEIGHT, millis());
+        renderWrapped();
+        return;
+    }
+    wrapped_scroller.stop();
+    clearDisplay();
+    // Ensure consistent text styling
+    display.setTextSize(1);
+    display.setTextColor(SSD1306_WHITE);
+    if (msg.kind == DISPLAY_MSG_SCROLL) display.setCursor(0, msg.line * 8);
+    display.println(msg.text);
+    flushDisplay();
+}
+
+static void display_task(void* pv) {
+    (void)pv;
+    DisplayMsg msg;
+    for (;;) {
+        // While wrapped text is scrolling, wake up for its next step
+        TickType_t wait = portMAX_DELAY;
+        if (wrapped_scroller.active()) {
+            wait = pdMS_TO_TICKS(wrapped_scroller.msUntilNext(millis()));
+            if (wait == 0) wait = 1;
+        }
+        if (xQueueReceive(display_q, &msg, wait) != pdTRUE) {
+            lockDisplay();
+            if (oled_enabled && wrapped_scroller.tick(millis())) renderWrapped();
+            unlockDisplay();
+            continue;
+        }
+        lockDisplay();
+        if (msg.kind != DISPLAY_MSG_SCROLL) enableOLEDLocked();
+        if (oled_enabled) renderMessage(msg);
+        unlockDisplay();
+    }
+}
+
+// Queue a message for the display task; if the queue is full the oldest
+// pending message is dropped so the newest text always gets shown.
+static void postDisplay(DisplayMsgKind kind, const String& text, int line) {
+    DisplayMsg msg;
+    msg.kind = kind;
+    msg.line = (int8_t)line;
+    strncpy(msg.text, text.c_str(), sizeof(msg.text) - 1);
+    msg.text[sizeof(msg.text) - 1] = '\0';
+
+    if (display_q == NULL) {
+        // Task not running (yet): render synchronously
+        lockDisplay();
+        if (kind != DISPLAY_MSG_SCROLL) enableOLEDLocked();
+        if (oled_enabled) renderMessage(msg);
+        unlockDisplay();
+        return;
+    }
+    if (xQueueSend(display_q, &msg, 0) != pdTRUE) {
+        DisplayMsg dropped;
+        xQueueReceive(display_q, &dropped, 0);
+        xQueueSend(display_q, &msg, 0);
+    }
+}
+
+void initDisplay() {
+    if (display_mutex == NULL) display_mutex = xSemaphoreCreateMutex();
+    enableOLED();
+    if (display_q == NULL) {
+        display_q = xQueueCreate(DISPLAY_QUEUE_LEN, sizeof(DisplayMsg));
+    }
+    if (display_task_handle == NULL) {
+        xTaskCreatePinnedToCore(display_task, "display", 3072, NULL, 1, &display_task_handle, 1);
+    }
+}
+
+void enableOLED() {
+    lockDisplay();
+    enableOLEDLocked();
+    unlockDisplay();
+}
+
+void disableOLED() {
+    lockDisplay();
+    disableOLEDLocked();
+    unlockDisplay();
+}
+
 bool isOLEDEnabled() { return oled_enabled; }
 
 void clearDisplay() {
@@ -83,35 +259,25 @@ void clearDisplay() {
 }
 
 void displayText(const String& text) {
-    // Enable OLED and unmount SD if needed
-    enableOLED();
-    clearDisplay();
-    // Ensure consistent text styling
-    display.setTextSize(1);
-    display.setTextColor(SSD1306_WHITE);
-    display.println(text);
-    display.display();
     Serial.println("Display: " + text);
-    // Keep text visible briefly, then return pins to SD
-    delay(1000);
+    // Enables the OLED if needed; returns without waiting for the panel
+    postDisplay(DISPLAY_MSG_TEXT, text, 0);
 }
 
 void displayWrappedText(const String& text) {
-    // Simplified: just display the text plainly
-    displayText(text);
+    Serial.println("Display: " + text);
+    // Word-wrapped; scrolls a page at a time if it doesn't fit
+    postDisplay(DISPLAY_MSG_WRAPPED, text, 0);
 }
 
 void scrollText(const String& text, int line) {
-    // Scrolling not needed; simply display the text on the requested line
-    if (!isOLEDEnabled()) return;
-    clearDisplay();
-    display.setCursor(0, line * 8);
-    display.println(text);
-    display.display();
+    // Single line at a fixed position; see displayWrappedText for scrolling
+    postDisplay(DISPLAY_MSG_SCROLL, text, line);
 }
 
 void displaySplashScreen() {
     if (!isOLEDEnabled()) return;
+    lockDisplay();
     clearDisplay();
     display.setTextSize(2);
     display.setTextColor(SSD1306_WHITE);
@@ -124,9 +290,10 @@ void displaySplashScreen() {
     display.setCursor(20, 45);
     display.println("ESP32-CAM");
     
-    display.display();
+    flushDisplay();
+    unlockDisplay();
     delay(2000);
     
     // Reset text size
     display.setTextSize(1);
-}
\ No newline at end of file
+}
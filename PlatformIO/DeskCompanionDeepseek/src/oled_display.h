@@ -11,8 +11,13 @@
 extern TwoWire customWire;
 extern Adafruit_SSD1306 display;
 
+// Starts the display task; displayText/scrollText only queue a message
 void initDisplay();
 void clearDisplay();
+// Send only the changed parts of the frame buffer to the panel
+void flushDisplay();
+// Total bytes of pixel data pushed over I2C (diagnostics)
+uint32_t displayBytesSent();
 void displayText(const String& text);
 void displayWrappedText(const String& text);
 void scrollText(const String& text, int line = 0);
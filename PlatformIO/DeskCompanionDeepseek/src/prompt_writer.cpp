@@ -0,0 +1,102 @@
+#include "prompt_writer.h"
+#include <string.h>
+#include <stdio.h>
+
+void FactHistory::push(const char* fact) {
+  if (!fact) fact = "";
+  char* dst = items_[head_];
+  size_t n = strlen(fact);
+  if (n >= FACT_MAX) {
+    n = FACT_MAX - 1;
+    // Don't split a UTF-8 sequence: back up over continuation bytes
+    while (n > 0 && ((unsigned char)fact[n] & 0xC0) == 0x80) --n;
+  }
+  memcpy(dst, fact, n);
+  dst[n] = '\0';
+  head_ = (head_ + 1) % CAPACITY;
+  if (count_ < CAPACITY) ++count_;
+}
+
+const char* FactHistory::at(size_t i) const {
+  if (i >= count_) return "";
+  size_t oldest = (head_ + CAPACITY - count_) % CAPACITY;
+  return items_[(oldest + i) % CAPACITY];
+}
+
+void PromptWriter::reset(char* buf, size_t cap) {
+  buf_ = buf;
+  cap_ = cap;
+  len_ = 0;
+  overflow_ = (buf == nullptr || cap == 0);
+  if (!overflow_) buf_[0] = '\0';
+}
+
+void PromptWriter::put(char c) {
+  if (overflow_) return;
+  // Always keep room for the terminating NUL
+  if (len_ + 1 >= cap_) {
+    overflow_ = true;
+    return;
+  }
+  buf_[len_++] = c;
+  buf_[len_] = '\0';
+}
+
+void PromptWriter::raw(const char* s) {
+  while (*s && !overflow_) put(*s++);
+}
+
+PromptWriter& PromptWriter::text(const char* s) {
+  return text(s, s ? strlen(s) : 0);
+}
+
+PromptWriter& PromptWriter::text(const char* s, size_t n) {
+  static const char HEX[] = "0123456789abcdef";
+  for (size_t i = 0; i < n && !overflow_; ++i) {
+    unsigned char c = (unsigned char)s[i];
+    switch (c) {
+      case '"':  raw("\\\""); break;
+      case '\\': raw("\\\\"); break;
+      case '\n': raw("\\n"); break;
+      case '\r': raw("\\r"); break;
+      case '\t': raw("\\t"); break;
+      case '\b': raw("\\b"); break;
+      case '\f': raw("\\f"); break;
+      default:
+        if (c < 0x20) {
+          char esc[7] = {'\\', 'u', '0', '0', HEX[c >> 4], HEX[c & 0xF], '\0'};
+          raw(esc);
+        } else {
+          put((char)c); // UTF-8 passes through unchanged
+        }
+    }
+  }
+  return *this;
+}
+
+PromptWriter& PromptWriter::number(unsigned long v) {
+  char tmp[24];
+  snprintf(tmp, sizeof(tmp), "%lu", v);
+  raw(tmp);
+  return *this;
+}
+
+void PromptWriter::beginRequest(const char* model, int maxTokens, double temperature, const char* systemPrompt) {
+  char tmp[24];
+  raw("{\"model\":\"");
+  text(model);
+  raw("\",\"max_tokens\":");
+  snprintf(tmp, sizeof(tmp), "%d", maxTokens);
+  raw(tmp);
+  raw(",\"temperature\":");
+  snprintf(tmp, sizeof(tmp), "%g", temperature);
+  raw(tmp);
+  raw(",\"messages\":[{\"role\":\"system\",\"content\":\"");
+  text(systemPrompt);
+  raw("\"},{\"role\":\"user\",\"content\":\"");
+}
+
+const char* PromptWriter::endRequest() {
+  raw("\"}]}");
+  return overflow_ ? nullptr : buf_;
+}
@@ -0,0 +1,59 @@
+// Allocation-free helpers for building DeepSeek requests. Plain C++ so they
+// can be exercised by the host tests.
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Fixed-capacity ring of the most recent facts. Storage is inline, so
+// pushing a fact never touches the heap; the oldest entry is overwritten
+// once the ring is full.
+class FactHistory {
+public:
+  static const size_t CAPACITY = 5;
+  static const size_t FACT_MAX = 160; // bytes per fact including NUL
+
+  FactHistory() : head_(0), count_(0) {}
+
+  void push(const char* fact);
+  void clear() { head_ = 0; count_ = 0; }
+  size_t size() const { return count_; }
+  // 0 = oldest, size()-1 = newest
+  const char* at(size_t i) const;
+
+private:
+  char items_[CAPACITY][FACT_MAX];
+  size_t head_;  // next slot to write
+  size_t count_;
+};
+
+// Writes a chat-completions request body into a caller-supplied buffer in a
+// single pass. beginRequest() emits everything up to the opening quote of
+// the user message; text()/number() append escaped content to it, and
+// endRequest() closes the document. Overflow is sticky: once the buffer is
+// full nothing more is written and endRequest() returns nullptr.
+class PromptWriter {
+public:
+  PromptWriter() : buf_(nullptr), cap_(0), len_(0), overflow_(false) {}
+  PromptWriter(char* buf, size_t cap) { reset(buf, cap); }
+
+  void reset(char* buf, size_t cap);
+  void beginRequest(const char* model, int maxTokens, double temperature, const char* systemPrompt);
+  PromptWriter& text(const char* s);
+  PromptWriter& text(const char* s, size_t n);
+  PromptWriter& number(unsigned long v);
+  const char* endRequest();
+
+  size_t length() const { return len_; }
+  bool overflowed() const { return overflow_; }
+  const char* data() const { return buf_; }
+
+private:
+  void raw(const char* s);
+  void put(char c);
+
+  char* buf_;
+  size_t cap_;
+  size_t len_;
+  bool overflow_;
+};
@@ -1,5 +1,6 @@
 #include "safe_serial.h"
 #include "config.h"
+#include "async_log.h"
 #ifdef Serial
 #undef Serial
 #endif
@@ -32,53 +33,50 @@ bool SafeSerial::isEnabled() const {
     return enabled_;
 }
 
-size_t SafeSerial::write(uint8_t c) {
-    if (!enabled_) return 0;
-    if (!hw) return 0;
-    return hw->write(c);
-}
-
-size_t SafeSerial::write(const uint8_t *buffer, size_t size) {
-    if (!enabled_) return 0;
-    if (!hw) return 0;
-    return hw->write(buffer, size);
+// Output is handed to the async logger (synchronous until it is running)
+void SafeSerial::emit(const char* s, size_t n, bool newline) {
+    if (!enabled_ || !hw) return;
+    logText(LOG_LEVEL_INFO, s, n, newline);
 }
 
-void SafeSerial::print(const String &s) {
-    if (!enabled_) return;
-    if (!hw) return;
-    hw->print(s);
+size_t SafeSerial::write(uint8_t c) {
+    if (!enabled_ || !hw) return 0;
+    emit((const char*)&c, 1, false);
+    return 1;
 }
 
-void SafeSerial::print(const char *s) {
-    if (!enabled_) return;
-    if (!hw) return;
-    hw->print(s);
+size_t SafeSerial::write(const uint8_t *buffer, size_t size) {
+    if (!enabled_ || !hw) return 0;
+    emit((const char*)buffer, size, false);
+    return size;
 }
 
-void SafeSerial::print(char c) { if (!enabled_ || !hw) return; hw->print(c); }
-void SafeSerial::print(int n) { if (!enabled_ || !hw) return; hw->print(n); }
-void SafeSerial::print(unsigned int n) { if (!enabled_ || !hw) return; hw->print(n); }
-void SafeSerial::print(long n) { if (!enabled_ || !hw) return; hw->print(n); }
-void SafeSerial::print(unsigned long n) { if (!enabled_ || !hw) return; hw->print(n); }
+void SafeSerial::print(const String &s) { emit(s.c_str(), s.length(), false); }
+void SafeSerial::print(const char *s) { if (s) emit(s, strlen(s), false); }
+void SafeSerial::print(char c) { emit(&c, 1, false); }
+void SafeSerial::print(int n) { print((long)n); }
+void SafeSerial::print(unsigned int n) { print((unsigned long)n); }
+void SafeSerial::print(long n) { char b[12]; emit(b, snprintf(b, sizeof(b), "%ld", n), false); }
+void SafeSerial::print(unsigned long n) { char b[12]; emit(b, snprintf(b, sizeof(b), "%lu", n), false); }
 
-void SafeSerial::println() { if (!enabled_ || !hw) return; hw->println(); }
-void SafeSerial::println(const String &s) { if (!enabled_ || !hw) return; hw->println(s); }
-void SafeSerial::println(const char *s) { if (!enabled_ || !hw) return; hw->println(s); }
-void SafeSerial::println(char c) { if (!enabled_ || !hw) return; hw->println(c); }
-void SafeSerial::println(int n) { if (!enabled_ || !hw) return; hw->println(n); }
-void SafeSerial::println(unsigned int n) { if (!enabled_ || !hw) return; hw->println(n); }
-void SafeSerial::println(long n) { if (!enabled_ || !hw) return; hw->println(n); }
-void SafeSerial::println(unsigned long n) { if (!enabled_ || !hw) return; hw->println(n); }
+void SafeSerial::println() { emit("", 0, true); }
+void SafeSerial::println(const String &s) { emit(s.c_str(), s.length(), true); }
+void SafeSerial::println(const char *s) { if (s) emit(s, strlen(s), true); }
+void SafeSerial::println(char c) { emit(&c, 1, true); }
+void SafeSerial::println(int n) { println((long)n); }
+void SafeSerial::println(unsigned int n) { println((unsigned long)n); }
+void SafeSerial::println(long n) { char b[12]; emit(b, snprintf(b, sizeof(b), "%ld", n), true); }
+void SafeSerial::println(unsigned long n) { char b[12]; emit(b, snprintf(b, sizeof(b), "%lu", n), true); }
 
 void SafeSerial::printf(const char *fmt, ...) {
     if (!enabled_ || !hw) return;
     char buf[256];
     va_list ap;
     va_start(ap, fmt);
-    vsnprintf(buf, sizeof(buf), fmt, ap);
+    int n = vsnprintf(buf, sizeof(buf), fmt, ap);
     va_end(ap);
-    hw->print(buf);
+    if (n < 0) return;
+    emit(buf, (size_t)n < sizeof(buf) ? (size_t)n : sizeof(buf) - 1, false);
 }
 
 int SafeSerial::available() {
@@ -35,6 +35,8 @@ public:
     int read();
 
 private:
+    void emit(const char* s, size_t n, bool newline);
+
     HardwareSerial *hw;
     bool enabled_;
 };
@@ -0,0 +1,258 @@
+#include "sound_catalog.h"
+#include "config.h"
+#include <SD_MMC.h>
+#include "esp_heap_caps.h"
+
+struct CatalogHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t count;
+    uint32_t signature; // hash of folder listings (name + size)
+    uint32_t bankSize;
+};
+
+struct CatalogEntry {
+    uint32_t offset;
+    uint32_t length;
+    uint8_t folder;
+    uint8_t weight;
+    uint16_t reserved;
+};
+
+static const uint32_t CATALOG_MAGIC = 0x43534D44; // "DMSC"
+static const uint16_t CATALOG_VERSION = 1;
+static const uint32_t BANK_ALIGN = 512;           // clips start on sector boundaries
+
+static const char* const SOUND_FOLDERS[] = { "/beeps", "/serenity" };
+static const int FOLDER_COUNT = sizeof(SOUND_FOLDERS) / sizeof(SOUND_FOLDERS[0]);
+
+static CatalogEntry entries[SOUND_CATALOG_MAX];
+static int entry_count = 0;
+static bool catalog_ready = false;
+
+// Per-folder weighted shuffle bag of entry indices
+struct ShuffleBag {
+    uint8_t items[SOUND_BAG_MAX];
+    uint16_t size;
+    uint16_t pos;
+    int16_t last;
+};
+static ShuffleBag bags[FOLDER_COUNT];
+
+static uint32_t fnv1a(uint32_t h, const void* data, size_t n) {
+    const uint8_t* p = (const uint8_t*)data;
+    for (size_t i = 0; i < n; ++i) {
+        h ^= p[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+// "chirp@3.raw" -> 3; anything else -> 1
+static uint8_t weightFromName(const char* name) {
+    const char* at = strrchr(name, '@');
+    if (at && at[1] >= '1' && at[1] <= '9') return (uint8_t)(at[1] - '0');
+    return 1;
+}
+
+static const char* baseName(const char* path) {
+    const char* slash = strrchr(path, '/');
+    return slash ? slash + 1 : path;
+}
+
+// Walk both folders once, hashing name+size. Cheap compared to packing, and
+// tells us whether the existing bank is still valid.
+static uint32_t folderSignature() {
+    uint32_t h = 2166136261u;
+    for (int f = 0; f < FOLDER_COUNT; ++f) {
+        File dir = SD_MMC.open(SOUND_FOLDERS[f]);
+        if (!dir) continue;
+        File entry;
+        while ((entry = dir.openNextFile())) {
+            if (!entry.isDirectory()) {
+                const char* name = baseName(entry.name());
+                uint32_t size = entry.size();
+                h = fnv1a(h, &f, sizeof(f));
+                h = fnv1a(h, name, strlen(name));
+                h = fnv1a(h, &size, sizeof(size));
+            }
+            entry.close();
+        }
+        dir.close();
+    }
+    return h;
+}
+
+static bool readIndex(uint32_t signature) {
+    File idx = SD_MMC.open(SOUND_INDEX_PATH, FILE_READ);
+    if (!idx) return false;
+    CatalogHeader hdr;
+    bool ok = idx.read((uint8_t*)&hdr, sizeof(hdr)) == sizeof(hdr)
+              && hdr.magic == CATALOG_MAGIC && hdr.version == CATALOG_VERSION
+              && hdr.signature == signature && hdr.count <= SOUND_CATALOG_MAX;
+    if (ok) {
+        size_t bytes = hdr.count * sizeof(CatalogEntry);
+        ok = idx.read((uint8_t*)entries, bytes) == (int)bytes;
+        entry_count = ok ? hdr.count : 0;
+    }
+    idx.close();
+    if (ok) {
+        // The bank may have been deleted or replaced independently of the index
+        File bank = SD_MMC.open(SOUND_BANK_PATH, FILE_READ);
+        ok = bank && bank.size() == hdr.bankSize;
+        if (bank) bank.close();
+    }
+    return ok;
+}
+
+#define SOUND_BANK_TMP_PATH SOUND_BANK_PATH ".tmp"
+#define SOUND_INDEX_TMP_PATH SOUND_INDEX_PATH ".tmp"
+
+// Copy every clip into a fresh bank file and write the matching index, both
+// as .tmp files. Any short write abandons the pack before the live bank and
+// index are touched. The live index goes first and the new one is renamed in
+// last, so a reset part way through the swap leaves no index and the bank is
+// simply repacked from the folders on the next boot.
+static bool packBank(uint32_t signature) {
+    const size_t COPY_CHUNK = 4096;
+    uint8_t* buf = (uint8_t*)heap_caps_malloc(COPY_CHUNK, MALLOC_CAP_SPIRAM);
+    if (!buf) buf = (uint8_t*)malloc(COPY_CHUNK);
+    if (!buf) return false;
+
+    File bank = SD_MMC.open(SOUND_BANK_TMP_PATH, FILE_WRITE);
+    if (!bank) {
+        free(buf);
+        return false;
+    }
+
+    entry_count = 0;
+    uint32_t pos = 0;
+    bool ok = true;
+    for (int f = 0; f < FOLDER_COUNT && ok; ++f) {
+        File dir = SD_MMC.open(SOUND_FOLDERS[f]);
+        if (!dir) continue;
+        File clip;
+        while (ok && (clip = dir.openNextFile())) {
+            if (clip.isDirectory() || entry_count >= SOUND_CATALOG_MAX) {
+                clip.close();
+                continue;
+            }
+            // Pad to the next sector so each clip starts aligned
+            memset(buf, 0, BANK_ALIGN);
+            uint32_t pad = (BANK_ALIGN - (pos % BANK_ALIGN)) % BANK_ALIGN;
+            if (pad && bank.write(buf, pad) != pad) ok = false;
+            pos += pad;
+
+            CatalogEntry& e = entries[entry_count];
+            e.offset = pos;
+            e.length = 0;
+            e.folder = (uint8_t)f;
+            e.weight = weightFromName(clip.name());
+            e.reserved = 0;
+            int n;
+            while (ok && (n = clip.read(buf, COPY_CHUNK)) > 0) {
+                if (bank.write(buf, n) != (size_t)n) ok = false;
+                e.length += n;
+            }
+            pos += e.length;
+            clip.close();
+            if (e.length > 0) entry_count++;
+        }
+        dir.close();
+    }
+    bank.close();
+    free(buf);
+
+    if (ok) {
+        File idx = SD_MMC.open(SOUND_INDEX_TMP_PATH, FILE_WRITE);
+        if (!idx) {
+            ok = false;
+        } else {
+            CatalogHeader hdr = { CATALOG_MAGIC, CATALOG_VERSION, (uint16_t)entry_count, signature, pos };
+            size_t bytes = entry_count * sizeof(CatalogEntry);
+            ok = idx.write((const uint8_t*)&hdr, sizeof(hdr)) == sizeof(hdr)
+                 && idx.write((const uint8_t*)entries, bytes) == bytes;
+            idx.close();
+        }
+    }
+    if (!ok) {
+        Serial.println("Sound catalog: short write while packing; keeping the old bank");
+        SD_MMC.remove(SOUND_BANK_TMP_PATH);
+        SD_MMC.remove(SOUND_INDEX_TMP_PATH);
+        return false;
+    }
+
+    SD_MMC.remove(SOUND_INDEX_PATH);
+    SD_MMC.remove(SOUND_BANK_PATH);
+    if (!SD_MMC.rename(SOUND_BANK_TMP_PATH, SOUND_BANK_PATH)
+        || !SD_MMC.rename(SOUND_INDEX_TMP_PATH, SOUND_INDEX_PATH)) {
+        Serial.println("Sound catalog: rename after packing failed");
+        return false;
+    }
+    Serial.printf("Sound catalog: packed %d clips, %u bytes\n", entry_count, (unsigned)pos);
+    return true;
+}
+
+static void refillBag(int folder) {
+    ShuffleBag& b = bags[folder];
+    b.size = 0;
+    for (int i = 0; i < entry_count; ++i) {
+        if (entries[i].folder != folder) continue;
+        for (int w = 0; w < entries[i].weight && b.size < SOUND_BAG_MAX; ++w) {
+            b.items[b.size++] = (uint8_t)i;
+        }
+    }
+    // Fisher-Yates
+    for (int i = b.size - 1; i > 0; --i) {
+        int j = random(0, i + 1);
+        uint8_t t = b.items[i]; b.items[i] = b.items[j]; b.items[j] = t;
+    }
+    // Don't start the new round with the clip that ended the previous one
+    if (b.size > 1 && b.items[0] == b.last) {
+        int j = random(1, b.size);
+        uint8_t t = b.items[0]; b.items[0] = b.items[j]; b.items[j] = t;
+    }
+    b.pos = 0;
+}
+
+bool loadSoundCatalog() {
+    catalog_ready = false;
+    uint32_t signature = folderSignature();
+    if (!readIndex(signature)) {
+        Serial.println("Sound catalog: index missing or stale; repacking bank");
+        if (!packBank(signature)) {
+            Serial.println("Sound catalog: packing failed");
+            entry_count = 0;
+            return false;
+        }
+    }
+    for (int f = 0; f < FOLDER_COUNT; ++f) {
+        bags[f].last = -1;
+        refillBag(f);
+    }
+    catalog_ready = entry_count > 0;
+    Serial.printf("Sound catalog: %d clips\n", entry_count);
+    return catalog_ready;
+}
+
+bool isSoundCatalogReady() { return catalog_ready; }
+
+int soundCatalogSize() { return entry_count; }
+
+bool pickCatalogClip(SoundClipRef& out) {
+    if (!catalog_ready) return false;
+    // Choose which folder to play from: 50/50, skipping empty folders
+    int start = random(0, FOLDER_COUNT);
+    for (int k = 0; k < FOLDER_COUNT; ++k) {
+        int f = (start + k) % FOLDER_COUNT;
+        ShuffleBag& b = bags[f];
+        if (b.pos >= b.size) refillBag(f);
+        if (b.size == 0) continue;
+        uint8_t i = b.items[b.pos++];
+        b.last = i;
+        out.offset = entries[i].offset;
+        out.length = entries[i].length;
+        return true;
+    }
+    return false;
+}
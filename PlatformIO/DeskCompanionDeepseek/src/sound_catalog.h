@@ -0,0 +1,33 @@
+#ifndef SOUND_CATALOG_H
+#define SOUND_CATALOG_H
+
+#include <Arduino.h>
+#include "config.h"
+
+// Notification sound catalog.
+//
+// At mount time the clips in /beeps and /serenity are packed back to back
+// (512-byte aligned) into SOUND_BANK_PATH, and a compact index of
+// offset/length/folder/weight is written to SOUND_INDEX_PATH. Later mounts
+// only stat the folders; if nothing changed the index is loaded as-is.
+// Starting a notification is then a single seek into the open bank file.
+//
+// A file named e.g. "chirp@3.raw" gets weight 3 (1-9, default 1). Each
+// folder draws from a weighted shuffle bag, so a clip is not repeated until
+// its folder's bag is exhausted.
+
+struct SoundClipRef {
+    uint32_t offset; // byte offset in SOUND_BANK_PATH
+    uint32_t length; // bytes of raw PCM
+};
+
+// Build or load the catalog. Requires SD to be mounted.
+bool loadSoundCatalog();
+bool isSoundCatalogReady();
+int soundCatalogSize();
+
+// Pick the next clip: folder 50/50 (among non-empty folders), then the next
+// entry from that folder's shuffle bag.
+bool pickCatalogClip(SoundClipRef& out);
+
+#endif // SOUND_CATALOG_H
@@ -0,0 +1,84 @@
+// Lock-free single-producer/single-consumer byte ring.
+//
+// One task writes (the SD reader), one context reads (the A2DP data
+// callback); neither ever blocks or takes a lock. Head and tail are
+// free-running byte counters, so capacity must be a power of two.
+// Plain C++ so it can be exercised by the host tests.
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+
+class SpscRing {
+public:
+  SpscRing() : buf_(nullptr), mask_(0), head_(0), tail_(0) {}
+
+  // `buf` must hold `capacity` bytes; capacity must be a power of two.
+  bool init(uint8_t* buf, size_t capacity) {
+    if (!buf || capacity == 0 || (capacity & (capacity - 1)) != 0) return false;
+    buf_ = buf;
+    mask_ = capacity - 1;
+    head_.store(0, std::memory_order_relaxed);
+    tail_.store(0, std::memory_order_relaxed);
+    return true;
+  }
+
+  size_t capacity() const { return buf_ ? mask_ + 1 : 0; }
+
+  // Bytes readable by the consumer
+  size_t available() const {
+    return head_.load(std::memory_order_acquire) - tail_.load(std::memory_order_acquire);
+  }
+
+  // Bytes writable by the producer
+  size_t space() const { return capacity() - available(); }
+
+  // Producer side. Returns bytes written (may be less than n if full).
+  size_t write(const uint8_t* src, size_t n) {
+    size_t head = head_.load(std::memory_order_relaxed);
+    size_t tail = tail_.load(std::memory_order_acquire);
+    size_t free = capacity() - (head - tail);
+    if (n > free) n = free;
+    copyIn(head & mask_, src, n);
+    head_.store(head + n, std::memory_order_release);
+    return n;
+  }
+
+  // Consumer side. Returns bytes read (may be less than n if empty).
+  size_t read(uint8_t* dst, size_t n) {
+    size_t tail = tail_.load(std::memory_order_relaxed);
+    size_t head = head_.load(std::memory_order_acquire);
+    size_t used = head - tail;
+    if (n > used) n = used;
+    copyOut(tail & mask_, dst, n);
+    tail_.store(tail + n, std::memory_order_release);
+    return n;
+  }
+
+  // Consumer side: drop everything currently buffered.
+  void discard() {
+    tail_.store(head_.load(std::memory_order_acquire), std::memory_order_release);
+  }
+
+private:
+  void copyIn(size_t pos, const uint8_t* src, size_t n) {
+    size_t first = capacity() - pos;
+    if (first > n) first = n;
+    memcpy(buf_ + pos, src, first);
+    memcpy(buf_, src + first, n - first);
+  }
+
+  void copyOut(size_t pos, uint8_t* dst, size_t n) {
+    size_t first = capacity() - pos;
+    if (first > n) first = n;
+    memcpy(dst, buf_ + pos, first);
+    memcpy(dst + first, buf_, n - first);
+  }
+
+  uint8_t* buf_;
+  size_t mask_;
+  std::atomic<size_t> head_; // total bytes written (producer-owned)
+  std::atomic<size_t> tail_; // total bytes read (consumer-owned)
+};
@@ -4,13 +4,16 @@
 #include "deepseek_client.h"
 #include "bluetooth_audio.h"
 #include "touch_input.h"
+#include "fact_cache.h"
+#include "async_log.h"
 
 void taskConversation(void* /*arg*/) {
   Serial.println("taskConversation starting");
   initConversationManager();
 
-  // Wait for WiFi and start first subject
-  while (!connectToWiFi()) {
+  // Try WiFi for a while, then carry on offline; facts come from the SD
+  // cache until the connection comes back (WiFi auto-reconnects).
+  for (int attempt = 0; attempt < 3 && !connectToWiFi(); ++attempt) {
     Serial.println("Waiting for WiFi...");
     vTaskDelay(pdMS_TO_TICKS(1000));
   }
@@ -21,6 +24,8 @@ void taskConversation(void* /*arg*/) {
   if (!ready) {
     Serial.println("Warning: BT/audio did not fully start before timeout");
   }
+  // SD is mounted by the audio task; index the fact cache before first use.
+  initFactCache();
   // Block until headset connects so the first LLM request has audio output.
   Serial.println("Waiting for headset connection (up to 30s)...");
   bool headset = waitForHeadsetConnection(30000);
@@ -43,19 +48,27 @@ void taskConversation(void* /*arg*/) {
   };
 
   for (;;) {
+    // Block on the touch sensor; wake periodically for Serial commands
+    switch (waitForTouchGesture(SERIAL_POLL_MS)) {
+      case GESTURE_TAP:        onUserInput("more"); break;
+      case GESTURE_DOUBLE_TAP: onUserInput("other"); break;
+      case GESTURE_LONG_PRESS: onUserInput("repeat"); break;
+      case GESTURE_HOLD:       onUserInput("volume"); break;
+      default: break;
+    }
     if (Serial.available()) {
       String line = readLine();
       line.trim();
       if (line.length()) {
         line.toLowerCase();
-        onUserInput(line);
+        LogLevel level;
+        if (line.startsWith("log ") && parseLogLevel(line.c_str() + 4, &level)) {
+          setLogLevel(level);
+          Serial.printf("Log level: %s (dropped %u)\n", line.c_str() + 4, (unsigned)logDropped());
+        } else {
+          onUserInput(line);
+        }
       }
     }
-    // Poll touch sensor and treat a press as the "more" command
-    handleTouchInput();
-    if (touchJustPressed()) {
-      onUserInput("more");
-    }
-    vTaskDelay(pdMS_TO_TICKS(50));
   }
 }
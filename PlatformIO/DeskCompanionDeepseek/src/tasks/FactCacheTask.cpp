@@ -0,0 +1,36 @@
+#include "tasks/FactCacheTask.h"
+#include <Arduino.h>
+#include <WiFi.h>
+#include "config.h"
+#include "conversation_manager.h"
+#include "deepseek_client.h"
+#include "fact_cache.h"
+#include "subjects.h"
+
+// Background prefetch: while the user is idle and the link is good, top up
+// the SD fact cache so later subjects can be served without a round trip.
+void taskFactCache(void* /*arg*/) {
+  Serial.println("taskFactCache starting");
+#if MOCK_DEEPSEEK
+  // Mock responses are never cached; nothing to prefetch.
+  vTaskDelete(NULL);
+#endif
+  for (;;) {
+    vTaskDelay(pdMS_TO_TICKS(FACT_CACHE_PREFETCH_INTERVAL_MS));
+
+    if (!isFactCacheReady()) continue;
+    if (WiFi.status() != WL_CONNECTED || WiFi.RSSI() < FACT_CACHE_MIN_RSSI) continue;
+    if (millis() - lastConversationActivity() < FACT_CACHE_IDLE_MS) continue;
+
+    String subj = pickRandomSubject();
+    if (factCacheFreshCount(subj) >= FACT_CACHE_PREFETCH_TARGET) continue;
+
+    Serial.println("Prefetching fact for: " + subj);
+    writeSubjectPrompt(beginDeepSeekRequest(), subj);
+    String resp = finishDeepSeekRequest();
+    String fact;
+    if (!isDeepSeekError(resp) && extractFactFromResponse(resp, fact)) {
+      if (!factCacheStore(subj, fact, false)) Serial.println("Prefetch: duplicate or not stored");
+    }
+  }
+}
@@ -0,0 +1,337 @@
+#include "text_layout.h"
+#include <string.h>
+
+namespace {
+
+// Column bitmaps for ' '..'~', left aligned (blank leading columns removed)
+const uint8_t kGlyphs[95][5] = {
+  { 0x00, 0x00, 0x00, 0x00, 0x00 }, // space
+  { 0x5F, 0x00, 0x00, 0x00, 0x00 }, // !
+  { 0x07, 0x00, 0x07, 0x00, 0x00 }, // "
+  { 0x14, 0x7F, 0x14, 0x7F, 0x14 }, // #
+  { 0x24, 0x2A, 0x7F, 0x2A, 0x12 }, // $
+  { 0x23, 0x13, 0x08, 0x64, 0x62 }, // %
+  { 0x36, 0x49, 0x56, 0x20, 0x50 }, // &
+  { 0x05, 0x03, 0x00, 0x00, 0x00 }, // '
+  { 0x1C, 0x22, 0x41, 0x00, 0x00 }, // (
+  { 0x41, 0x22, 0x1C, 0x00, 0x00 }, // )
+  { 0x2A, 0x1C, 0x7F, 0x1C, 0x2A }, // *
+  { 0x08, 0x08, 0x3E, 0x08, 0x08 }, // +
+  { 0xA0, 0x60, 0x00, 0x00, 0x00 }, // ,
+  { 0x08, 0x08, 0x08, 0x08, 0x08 }, // -
+  { 0x60, 0x60, 0x00, 0x00, 0x00 }, // .
+  { 0x20, 0x10, 0x08, 0x04, 0x02 }, // /
+  { 0x3E, 0x51, 0x49, 0x45, 0x3E }, // 0
+  { 0x42, 0x7F, 0x40, 0x00, 0x00 }, // 1
+  { 0x42, 0x61, 0x51, 0x49, 0x46 }, // 2
+  { 0x21, 0x41, 0x45, 0x4B, 0x31 }, // 3
+  { 0x18, 0x14, 0x12, 0x7F, 0x10 }, // 4
+  { 0x27, 0x45, 0x45, 0x45, 0x39 }, // 5
+  { 0x3C, 0x4A, 0x49, 0x49, 0x30 }, // 6
+  { 0x01, 0x71, 0x09, 0x05, 0x03 }, // 7
+  { 0x36, 0x49, 0x49, 0x49, 0x36 }, // 8
+  { 0x06, 0x49, 0x49, 0x29, 0x1E }, // 9
+  { 0x36, 0x36, 0x00, 0x00, 0x00 }, // :
+  { 0x56, 0x36, 0x00, 0x00, 0x00 }, // ;
+  { 0x08, 0x14, 0x22, 0x41, 0x00 }, // <
+  { 0x14, 0x14, 0x14, 0x14, 0x14 }, // =
+  { 0x41, 0x22, 0x14, 0x08, 0x00 }, // >
+  { 0x02, 0x01, 0x51, 0x09, 0x06 }, // ?
+  { 0x3E, 0x41, 0x5D, 0x55, 0x1E }, // @
+  { 0x7C, 0x12, 0x11, 0x12, 0x7C }, // A
+  { 0x7F, 0x49, 0x49, 0x49, 0x36 }, // B
+  { 0x3E, 0x41, 0x41, 0x41, 0x22 }, // C
+  { 0x7F, 0x41, 0x41, 0x22, 0x1C }, // D
+  { 0x7F, 0x49, 0x49, 0x49, 0x41 }, // E
+  { 0x7F, 0x09, 0x09, 0x09, 0x01 }, // F
+  { 0x3E, 0x41, 0x49, 0x49, 0x7A }, // G
+  { 0x7F, 0x08, 0x08, 0x08, 0x7F }, // H
+  { 0x41, 0x7F, 0x41, 0x00, 0x00 }, // I
+  { 0x20, 0x40, 0x41, 0x3F, 0x01 }, // J
+  { 0x7F, 0x08, 0x14, 0x22, 0x41 }, // K
+  { 0x7F, 0x40, 0x40, 0x40, 0x40 }, // L
+  { 0x7F, 0x02, 0x0C, 0x02, 0x7F }, // M
+  { 0x7F, 0x04, 0x08, 0x10, 0x7F }, // N
+  { 0x3E, 0x41, 0x41, 0x41, 0x3E }, // O
+  { 0x7F, 0x09, 0x09, 0x09, 0x06 }, // P
+  { 0x3E, 0x41, 0x51, 0x21, 0x5E }, // Q
+  { 0x7F, 0x09, 0x19, 0x29, 0x46 }, // R
+  { 0x46, 0x49, 0x49, 0x49, 0x31 }, // S
+  { 0x01, 0x01, 0x7F, 0x01, 0x01 }, // T
+  { 0x3F, 0x40, 0x40, 0x40, 0x3F }, // U
+  { 0x1F, 0x20, 0x40, 0x20, 0x1F }, // V
+  { 0x3F, 0x40, 0x38, 0x40, 0x3F }, // W
+  { 0x63, 0x14, 0x08, 0x14, 0x63 }, // X
+  { 0x07, 0x08, 0x70, 0x08, 0x07 }, // Y
+  { 0x61, 0x51, 0x49, 0x45, 0x43 }, // Z
+  { 0x7F, 0x41, 0x41, 0x00, 0x00 }, // [
+  { 0x02, 0x04, 0x08, 0x10, 0x20 }, // backslash
+  { 0x41, 0x41, 0x7F, 0x00, 0x00 }, // ]
+  { 0x04, 0x02, 0x01, 0x02, 0x04 }, // ^
+  { 0x40, 0x40, 0x40, 0x40, 0x40 }, // _
+  { 0x01, 0x02, 0x04, 0x00, 0x00 }, // `
+  { 0x20, 0x54, 0x54, 0x54, 0x78 }, // a
+  { 0x7F, 0x48, 0x44, 0x44, 0x38 }, // b
+  { 0x38, 0x44, 0x44, 0x44, 0x20 }, // c
+  { 0x38, 0x44, 0x44, 0x48, 0x7F }, // d
+  { 0x38, 0x54, 0x54, 0x54, 0x18 }, // e
+  { 0x08, 0x7E, 0x09, 0x01, 0x02 }, // f
+  { 0x18, 0xA4, 0xA4, 0xA4, 0x7C }, // g
+  { 0x7F, 0x08, 0x04, 0x04, 0x78 }, // h
+  { 0x44, 0x7D, 0x40, 0x00, 0x00 }, // i
+  { 0x40, 0x80, 0x84, 0x7D, 0x00 }, // j
+  { 0x7F, 0x10, 0x28, 0x44, 0x00 }, // k
+  { 0x41, 0x7F, 0x40, 0x00, 0x00 }, // l
+  { 0x7C, 0x04, 0x18, 0x04, 0x78 }, // m
+  { 0x7C, 0x08, 0x04, 0x04, 0x78 }, // n
+  { 0x38, 0x44, 0x44, 0x44, 0x38 }, // o
+  { 0xFC, 0x24, 0x24, 0x24, 0x18 }, // p
+  { 0x18, 0x24, 0x24, 0x24, 0xFC }, // q
+  { 0x7C, 0x08, 0x04, 0x04, 0x08 }, // r
+  { 0x48, 0x54, 0x54, 0x54, 0x20 }, // s
+  { 0x04, 0x3F, 0x44, 0x40, 0x20 }, // t
+  { 0x3C, 0x40, 0x40, 0x20, 0x7C }, // u
+  { 0x1C, 0x20, 0x40, 0x20, 0x1C }, // v
+  { 0x3C, 0x40, 0x30, 0x40, 0x3C }, // w
+  { 0x44, 0x28, 0x10, 0x28, 0x44 }, // x
+  { 0x1C, 0xA0, 0xA0, 0xA0, 0x7C }, // y
+  { 0x44, 0x64, 0x54, 0x4C, 0x44 }, // z
+  { 0x08, 0x36, 0x41, 0x00, 0x00 }, // {
+  { 0x7F, 0x00, 0x00, 0x00, 0x00 }, // |
+  { 0x41, 0x36, 0x08, 0x00, 0x00 }, // }
+  { 0x08, 0x04, 0x08, 0x10, 0x08 }, // ~
+};
+
+// Ink width of each glyph above, precomputed so measuring a line never
+// scans bitmaps
+const uint8_t kGlyphWidth[95] = {
+  2, 1, 3, 5, 5, 5, 5, 2, 3, 3, 5, 5, 2, 5, 2, 5,
+  5, 3, 5, 5, 5, 5, 5, 5, 5, 5, 2, 2, 4, 5, 4, 5,
+  5, 5, 5, 5, 5, 5, 5, 5, 5, 3, 5, 5, 5, 5, 5, 5,
+  5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 3, 5, 3, 5, 5,
+  3, 5, 5, 5, 5, 5, 5, 5, 5, 3, 4, 4, 3, 5, 5, 5,
+  5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 3, 1, 3, 5,
+};
+
+int glyphIndex(char c) {
+  unsigned char u = (unsigned char)c;
+  if (u < 32 || u > 126) return '?' - 32;
+  return u - 32;
+}
+
+// UTF-8 continuation bytes are skipped; the lead byte stands for the glyph
+bool isContinuation(char c) { return ((unsigned char)c & 0xC0) == 0x80; }
+
+uint32_t hashText(const char* s, size_t n, int width) {
+  uint32_t h = 2166136261u ^ (uint32_t)width;
+  for (size_t i = 0; i < n; ++i) { h ^= (unsigned char)s[i]; h *= 16777619u; }
+  return h;
+}
+
+// Bytes of text a layout keeps: truncated to TEXT_MAX - 1 on a glyph boundary
+size_t keptLength(const char* text) {
+  size_t n = strlen(text);
+  if (n >= TextLayout::TEXT_MAX) {
+    n = TextLayout::TEXT_MAX - 1;
+    while (n > 0 && isContinuation(text[n])) --n;
+  }
+  return n;
+}
+
+} // namespace
+
+int TextFont::advance(char c) {
+  if (isContinuation(c)) return 0;
+  return kGlyphWidth[glyphIndex(c)] + SPACING;
+}
+
+void TextLayout::clear() {
+  len_ = 0;
+  text_[0] = '\0';
+  lineCount_ = 0;
+  width_ = 0;
+  hash_ = 0;
+}
+
+void TextLayout::addLine(size_t start, size_t end, int width) {
+  if (lineCount_ >= MAX_LINES) return;
+  // Trailing spaces don't count toward the line
+  while (end > start && text_[end - 1] == ' ') { --end; width -= TextFont::advance(' '); }
+  lines_[lineCount_].start = (uint16_t)start;
+  lines_[lineCount_].len = (uint16_t)(end - start);
+  lines_[lineCount_].width = (uint8_t)(width > 0 ? width : 0);
+  ++lineCount_;
+}
+
+bool TextLayout::holds(const char* text, int width) const {
+  if (!text) text = "";
+  size_t n = keptLength(text);
+  return hashText(text, n, width) == hash_ && n == len_ && width == width_ && memcmp(text, text_, n) == 0;
+}
+
+bool TextLayout::layout(const char* text, int width) {
+  if (!text) text = "";
+  if (holds(text, width)) return false;
+  size_t n = keptLength(text);
+  uint32_t h = hashText(text, n, width);
+
+  memcpy(text_, text, n);
+  text_[n] = '\0';
+  len_ = n;
+  width_ = width;
+  hash_ = h;
+  lineCount_ = 0;
+
+  // Greedy wrap. A line breaks at the last space that fits; a word wider
+  // than the whole line is split between characters.
+  size_t lineStart = 0;
+  int lineW = 0;
+  size_t lastSpace = 0;   // index of the space after the last fitting word
+  int widthAtSpace = 0;
+  bool haveSpace = false;
+  size_t i = 0;
+  while (i < n && lineCount_ < MAX_LINES) {
+    char c = text_[i];
+    if (c == '\n') {
+      addLine(lineStart, i, lineW);
+      lineStart = ++i;
+      lineW = 0;
+      haveSpace = false;
+      continue;
+    }
+    // Spaces at the start of a wrapped line are dropped
+    if (c == ' ' && i == lineStart && lineCount_ > 0 && text_[i - 1] != '\n') {
+      lineStart = ++i;
+      continue;
+    }
+    int adv = TextFont::advance(c);
+    // The last glyph of a line doesn't need its spacing column
+    if (lineW + adv - TextFont::SPACING > width && i > lineStart) {
+      if (c == ' ') {
+        addLine(lineStart, i, lineW);
+        lineStart = ++i;
+      } else if (haveSpace) {
+        addLine(lineStart, lastSpace, widthAtSpace);
+        lineStart = lastSpace + 1;
+        i = lineStart;
+      } else {
+        addLine(lineStart, i, lineW);
+        lineStart = i;
+      }
+      lineW = 0;
+      haveSpace = false;
+      continue;
+    }
+    if (c == ' ') { lastSpace = i; widthAtSpace = lineW; haveSpace = true; }
+    lineW += adv;
+    ++i;
+  }
+  if (lineStart < n && lineCount_ < MAX_LINES) addLine(lineStart, n, lineW);
+  return true;
+}
+
+void TextLayout::lineText(int i, char* out, size_t cap) const {
+  if (!out || cap == 0) return;
+  out[0] = '\0';
+  if (i < 0 || i >= lineCount_) return;
+  size_t n = lines_[i].len < cap - 1 ? lines_[i].len : cap - 1;
+  memcpy(out, text_ + lines_[i].start, n);
+  out[n] = '\0';
+}
+
+int TextLayout::pageCount(int viewHeight) const {
+  int per = linesPerPage(viewHeight);
+  return lineCount_ == 0 ? 1 : (lineCount_ + per - 1) / per;
+}
+
+int TextLayout::maxScroll(int viewHeight) const {
+  int extra = contentHeight() - viewHeight;
+  return extra > 0 ? extra : 0;
+}
+
+void TextLayout::render(uint8_t* fb, int fbWidth, int fbHeight, int scrollY,
+                        int rowStart, int rowEnd) const {
+  if (rowEnd < 0 || rowEnd > fbHeight) rowEnd = fbHeight;
+  if (rowStart < 0) rowStart = 0;
+  if (rowStart >= rowEnd) return;
+
+  // Clear just the requested rows
+  for (int y = rowStart; y < rowEnd; ++y) {
+    uint8_t* p = fb + (y >> 3) * fbWidth;
+    uint8_t keep = (uint8_t)~(1u << (y & 7));
+    for (int x = 0; x < fbWidth; ++x) p[x] &= keep;
+  }
+
+  // Only lines overlapping the requested rows are drawn
+  int first = (scrollY + rowStart) / LINE_HEIGHT;
+  int last = (scrollY + rowEnd - 1) / LINE_HEIGHT;
+  if (first < 0) first = 0;
+  if (last >= lineCount_) last = lineCount_ - 1;
+  for (int li = first; li <= last; ++li) {
+    int top = li * LINE_HEIGHT - scrollY;
+    const Line& ln = lines_[li];
+    int x = 0;
+    for (size_t k = ln.start; k < (size_t)ln.start + ln.len && x < fbWidth; ++k) {
+      char c = text_[k];
+      if (isContinuation(c)) continue;
+      int g = glyphIndex(c);
+      for (int col = 0; col < kGlyphWidth[g] && x + col < fbWidth; ++col) {
+        uint8_t bits = kGlyphs[g][col];
+        while (bits) {
+          int bit = __builtin_ctz(bits);
+          bits &= (uint8_t)(bits - 1);
+          int y = top + bit;
+          if (y < rowStart || y >= rowEnd) continue;
+          fb[(y >> 3) * fbWidth + x + col] |= (uint8_t)(1u << (y & 7));
+        }
+      }
+      x += kGlyphWidth[g] + TextFont::SPACING;
+    }
+  }
+}
+
+const TextLayout& TextLayoutCache::layout(const char* text, int width, bool* cached) {
+  int victim = 0;
+  for (int i = 0; i < ENTRIES; ++i) {
+    if (used_[i] && entries_[i].holds(text, width)) {
+      used_[i] = ++clock_;
+      if (cached) *cached = true;
+      return entries_[i];
+    }
+    if (used_[i] < used_[victim]) victim = i;
+  }
+  entries_[victim].layout(text, width);
+  used_[victim] = ++clock_;
+  if (cached) *cached = false;
+  return entries_[victim];
+}
+
+void TextScroller::start(const TextLayout& layout, int viewHeight, uint32_t nowMs) {
+  maxScroll_ = layout.maxScroll(viewHeight);
+  pageStep_ = TextLayout::linesPerPage(viewHeight) * TextLayout::LINE_HEIGHT;
+  offset_ = 0;
+  target_ = 0;
+  nextMs_ = nowMs + HOLD_MS;
+}
+
+bool TextScroller::tick(uint32_t nowMs) {
+  if (!active() || (int32_t)(nowMs - nextMs_) < 0) return false;
+  if (offset_ == target_) {
+    // Held long enough on this page: pick the next one or wrap to the top
+    if (offset_ >= maxScroll_) {
+      offset_ = target_ = 0;
+      nextMs_ = nowMs + HOLD_MS;
+      return true;
+    }
+    target_ = offset_ + pageStep_;
+    if (target_ > maxScroll_) target_ = maxScroll_;
+  }
+  ++offset_;
+  nextMs_ = nowMs + (offset_ == target_ ? HOLD_MS : STEP_MS);
+  return true;
+}
+
+uint32_t TextScroller::msUntilNext(uint32_t nowMs) const {
+  int32_t d = (int32_t)(nextMs_ - nowMs);
+  return d > 0 ? (uint32_t)d : 0;
+}
@@ -0,0 +1,114 @@
+// Word-wrap, paging and vertical scroll for the 128x64 OLED. Plain C++ so
+// the layout and the rendered pixels can be checked by the host tests;
+// renders straight into an SSD1306 page-ordered buffer (the same layout as
+// Adafruit_SSD1306::getBuffer()), one bit per pixel, LSB = top row.
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Built-in proportional 5x8 font, printable ASCII only. Anything else
+// (including whole UTF-8 sequences) is drawn as '?'.
+namespace TextFont {
+  const int HEIGHT = 8;    // glyph rows, including descenders
+  const int SPACING = 1;   // blank column after each glyph
+  // Advance in pixels for one glyph (ink width + SPACING)
+  int advance(char c);
+}
+
+// Result of laying out one piece of text for a given width. Lines index
+// into a private copy of the text, so the caller's string may go away.
+// layout() is a no-op when called again with the same text and width,
+// which makes re-showing the current fact free; TextLayoutCache below
+// extends that to the last few facts.
+class TextLayout {
+public:
+  static const size_t TEXT_MAX = 384;  // bytes, longer text is truncated
+  static const int MAX_LINES = 48;
+  static const int LINE_HEIGHT = TextFont::HEIGHT + 1;
+
+  TextLayout() : len_(0), width_(0), lineCount_(0), hash_(0) { text_[0] = '\0'; }
+
+  // Returns true if the layout was recomputed, false if it was cached
+  bool layout(const char* text, int width);
+  void clear();
+  // True if layout(text, width) would be a no-op
+  bool holds(const char* text, int width) const;
+
+  int lineCount() const { return lineCount_; }
+  int width() const { return width_; }
+  int contentHeight() const { return lineCount_ * LINE_HEIGHT; }
+  // Copy of line i (no trailing spaces) into out, NUL terminated
+  void lineText(int i, char* out, size_t cap) const;
+  int lineWidth(int i) const { return (i >= 0 && i < lineCount_) ? lines_[i].width : 0; }
+
+  // Paging helpers for a viewport of viewHeight pixels
+  static int linesPerPage(int viewHeight) { return viewHeight >= LINE_HEIGHT ? viewHeight / LINE_HEIGHT : 1; }
+  int pageCount(int viewHeight) const;
+  int maxScroll(int viewHeight) const;
+
+  // Draw the lines visible at scroll offset scrollY into fb (fbWidth x
+  // fbHeight, page-ordered). Only the pixel rows [rowStart, rowEnd) are
+  // touched, so a caller can redraw part of the screen.
+  void render(uint8_t* fb, int fbWidth, int fbHeight, int scrollY,
+              int rowStart = 0, int rowEnd = -1) const;
+
+private:
+  struct Line { uint16_t start; uint16_t len; uint8_t width; };
+
+  void addLine(size_t start, size_t end, int width);
+
+  char text_[TEXT_MAX];
+  size_t len_;
+  int width_;
+  Line lines_[MAX_LINES];
+  int lineCount_;
+  uint32_t hash_;
+};
+
+// The layouts of the last ENTRIES texts shown, keyed by text and width
+// (a fact's text is its identity on the display side). Switching between
+// recent facts, e.g. "repeat" after "more", skips the wrap pass; the least
+// recently shown layout is the one recomputed.
+class TextLayoutCache {
+public:
+  static const int ENTRIES = 4;
+
+  TextLayoutCache() : clock_(0) { for (int i = 0; i < ENTRIES; ++i) used_[i] = 0; }
+
+  // Layout for text at width. *cached (optional) says whether it was reused.
+  // The reference stays valid until ENTRIES other texts have been laid out.
+  const TextLayout& layout(const char* text, int width, bool* cached = nullptr);
+
+private:
+  TextLayout entries_[ENTRIES];
+  uint32_t used_[ENTRIES];  // clock_ at last use, 0 = never
+  uint32_t clock_;
+};
+
+// Timer-driven smooth scroll: holds on each page, then moves one pixel per
+// step until the next page is showing. At the end it holds and jumps back
+// to the top. tick() returns true only when the offset changed, so the
+// display is redrawn only on real movement.
+class TextScroller {
+public:
+  TextScroller() : maxScroll_(0), pageStep_(0), offset_(0), target_(0), nextMs_(0) {}
+
+  void start(const TextLayout& layout, int viewHeight, uint32_t nowMs);
+  void stop() { maxScroll_ = 0; }
+  bool active() const { return maxScroll_ > 0; }
+  bool tick(uint32_t nowMs);
+  int offset() const { return offset_; }
+  // Milliseconds until the next tick() can change anything
+  uint32_t msUntilNext(uint32_t nowMs) const;
+
+  static const uint32_t HOLD_MS = 2500;
+  static const uint32_t STEP_MS = 40;
+
+private:
+  int maxScroll_;
+  int pageStep_;
+  int offset_;
+  int target_;
+  uint32_t nextMs_;
+};
@@ -0,0 +1,112 @@
+#include "touch_gesture.h"
+
+const char* touchGestureName(TouchGesture g) {
+  switch (g) {
+    case GESTURE_TAP: return "tap";
+    case GESTURE_DOUBLE_TAP: return "double-tap";
+    case GESTURE_LONG_PRESS: return "long-press";
+    case GESTURE_HOLD: return "hold";
+    default: return "none";
+  }
+}
+
+// Wrap-safe "a is at or after b"
+static bool reached(uint32_t a, uint32_t b) { return (int32_t)(a - b) >= 0; }
+
+void TouchGestureDecoder::reset() {
+  state_ = IDLE;
+  level_ = false;
+  downMs_ = upMs_ = deadline_ = 0;
+}
+
+TouchGesture TouchGestureDecoder::onEdge(bool pressed, uint32_t tMs) {
+  // A timeout that expired before this edge happened comes first. At most
+  // one gesture results: a fired timeout always leaves a state in which the
+  // edge itself is silent.
+  TouchGesture g = poll(tMs);
+  if (pressed == level_) return g;
+  level_ = pressed;
+
+  switch (state_) {
+    case IDLE:
+      if (pressed) { state_ = DOWN; downMs_ = tMs; deadline_ = tMs + LONG_PRESS_MS; }
+      break;
+    case DOWN:
+    case DOWN_SECOND:
+      if (!pressed) {
+        if (tMs - downMs_ < GLITCH_MS) {
+          // Bounce: forget this press
+          state_ = (state_ == DOWN_SECOND) ? UP_WAIT : IDLE;
+          deadline_ = upMs_ + DOUBLE_TAP_MS;
+        } else if (state_ == DOWN_SECOND) {
+          state_ = IDLE;
+          g = GESTURE_DOUBLE_TAP;
+        } else {
+          state_ = UP_WAIT;
+          upMs_ = tMs;
+          deadline_ = tMs + DOUBLE_TAP_MS;
+        }
+      }
+      break;
+    case UP_WAIT:
+      if (pressed) {
+        if (tMs - upMs_ < GLITCH_MS) {
+          // Bounce on release: the first press is still going
+          state_ = DOWN;
+          deadline_ = downMs_ + LONG_PRESS_MS;
+        } else {
+          state_ = DOWN_SECOND;
+          downMs_ = tMs;
+          deadline_ = tMs + LONG_PRESS_MS;
+        }
+      }
+      break;
+    case LONG_DOWN:
+      // Released before becoming a hold: only now is it a long press
+      if (!pressed) { state_ = IDLE; g = GESTURE_LONG_PRESS; }
+      break;
+    case HOLDING:
+      if (!pressed) state_ = IDLE;
+      break;
+  }
+  return g;
+}
+
+TouchGesture TouchGestureDecoder::poll(uint32_t nowMs) {
+  switch (state_) {
+    case UP_WAIT:
+      if (reached(nowMs, deadline_)) { state_ = IDLE; return GESTURE_TAP; }
+      break;
+    case DOWN:
+    case DOWN_SECOND:
+      // A long second press counts as a long press too. Nothing is reported
+      // yet: the release decides between long press and hold.
+      if (reached(nowMs, deadline_)) {
+        state_ = LONG_DOWN;
+        deadline_ = downMs_ + HOLD_MS;
+      }
+      break;
+    case LONG_DOWN:
+      if (reached(nowMs, deadline_)) {
+        state_ = HOLDING;
+        deadline_ += HOLD_REPEAT_MS;
+        return GESTURE_HOLD;
+      }
+      break;
+    case HOLDING:
+      if (reached(nowMs, deadline_)) {
+        deadline_ += HOLD_REPEAT_MS;
+        return GESTURE_HOLD;
+      }
+      break;
+    default:
+      break;
+  }
+  return GESTURE_NONE;
+}
+
+bool TouchGestureDecoder::nextDeadline(uint32_t* deadlineMs) const {
+  if (state_ == IDLE) return false;
+  if (deadlineMs) *deadlineMs = deadline_;
+  return true;
+}
@@ -0,0 +1,44 @@
+// Gesture decoder for the touch sensor. Fed with timestamped press/release
+// edges (from the GPIO interrupt) and decoded in the consumer's context, so
+// it is plain C++ and covered by the host tests.
+#pragma once
+
+#include <stdint.h>
+
+enum TouchGesture : uint8_t {
+  GESTURE_NONE = 0,
+  GESTURE_TAP,          // single short press, reported once the double-tap window closes
+  GESTURE_DOUBLE_TAP,   // two short presses within DOUBLE_TAP_MS
+  GESTURE_LONG_PRESS,   // released after LONG_PRESS_MS but before HOLD_MS
+  GESTURE_HOLD,         // held for HOLD_MS; repeats every HOLD_REPEAT_MS until release
+};
+
+const char* touchGestureName(TouchGesture g);
+
+class TouchGestureDecoder {
+public:
+  static const uint32_t GLITCH_MS = 15;       // presses/gaps shorter than this are bounce
+  static const uint32_t DOUBLE_TAP_MS = 300;  // max release->press gap for a double tap
+  static const uint32_t LONG_PRESS_MS = 700;
+  static const uint32_t HOLD_MS = 1100;       // a long press still held here becomes a hold instead
+  static const uint32_t HOLD_REPEAT_MS = 400;
+
+  TouchGestureDecoder() { reset(); }
+  void reset();
+
+  // Feed one edge. Timestamps are milliseconds and may wrap.
+  TouchGesture onEdge(bool pressed, uint32_t tMs);
+  // Fire any timeout that has expired by nowMs (tap window, long press, hold)
+  TouchGesture poll(uint32_t nowMs);
+  // True if poll() has a pending deadline; *deadlineMs is when
+  bool nextDeadline(uint32_t* deadlineMs) const;
+
+private:
+  enum State : uint8_t { IDLE, DOWN, UP_WAIT, DOWN_SECOND, LONG_DOWN, HOLDING };
+
+  State state_;
+  bool level_;          // last accepted level (true = pressed)
+  uint32_t downMs_;     // when the current press started
+  uint32_t upMs_;       // when the last short press was released
+  uint32_t deadline_;
+};
@@ -1,55 +1,88 @@
 #include "touch_input.h"
+#include "async_log.h"
 #include "config.h"
+#include "esp_timer.h"
 
-TouchState currentTouchState = TOUCH_IDLE;
-unsigned long lastTouchTime = 0;
-bool touchDetectedFlag = false;
+// Edge ring written by the ISR and read by the waiting task. The head is
+// only advanced by the ISR and the tail only by the reader.
+struct TouchEdge {
+    uint32_t t_ms;
+    bool pressed;
+};
+static TouchEdge edge_ring[TOUCH_EDGE_RING];
+static volatile uint32_t edge_head = 0;
+static volatile uint32_t edge_tail = 0;
+static volatile uint32_t edges_dropped = 0;
+static volatile TaskHandle_t touch_waiter = NULL;
+
+static TouchGestureDecoder decoder;
+
+// Millisecond clock that wraps at 2^32 like the decoder expects
+static inline uint32_t IRAM_ATTR touchNowMs() {
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+static void IRAM_ATTR touch_isr() {
+    bool pressed = !digitalRead(TOUCH_SENSOR_PIN); // Active low typically
+    uint32_t head = edge_head;
+    if (head - edge_tail >= TOUCH_EDGE_RING) {
+        edges_dropped++;
+    } else {
+        edge_ring[head & (TOUCH_EDGE_RING - 1)] = { touchNowMs(), pressed };
+        edge_head = head + 1;
+    }
+    TaskHandle_t waiter = touch_waiter;
+    if (waiter) {
+        BaseType_t woken = pdFALSE;
+        vTaskNotifyGiveFromISR(waiter, &woken);
+        if (woken) portYIELD_FROM_ISR();
+    }
+}
 
 void initTouchSensor() {
     pinMode(TOUCH_SENSOR_PIN, INPUT_PULLUP);
+    decoder.reset();
+    attachInterrupt(digitalPinToInterrupt(TOUCH_SENSOR_PIN), touch_isr, CHANGE);
     Serial.println("Touch sensor initialized on GPIO " + String(TOUCH_SENSOR_PIN));
 }
 
-bool isTouchDetected() {
-    bool currentState = !digitalRead(TOUCH_SENSOR_PIN); // Active low typically
-    
-    switch (currentTouchState) {
-        case TOUCH_IDLE:
-            if (currentState) {
-                currentTouchState = TOUCH_PRESSED;
-                lastTouchTime = millis();
-                touchDetectedFlag = true;
-                Serial.println("Touch detected!");
-                return true;
-            }
-            break;
-            
-        case TOUCH_PRESSED:
-            if (!currentState) {
-                currentTouchState = TOUCH_IDLE;
-                touchDetectedFlag = false;
-            } else if (millis() - lastTouchTime > TOUCH_DEBOUNCE_TIME) {
-                // Still pressed after debounce - wait for release
-            }
-            break;
+// Feed queued edges to the decoder until one produces a gesture; any edges
+// after it stay queued for the next call.
+static TouchGesture drainEdges() {
+    while (edge_tail != edge_head) {
+        TouchEdge e = edge_ring[edge_tail & (TOUCH_EDGE_RING - 1)];
+        edge_tail = edge_tail + 1;
+        TouchGesture g = decoder.onEdge(e.pressed, e.t_ms);
+        if (g != GESTURE_NONE) return g;
     }
-    
-    return false;
+    return GESTURE_NONE;
 }
 
-void handleTouchInput() {
-    isTouchDetected(); // Update state
-}
+TouchGesture waitForTouchGesture(uint32_t timeout_ms) {
+    uint32_t start = millis();
+    touch_waiter = xTaskGetCurrentTaskHandle();
+    TouchGesture g = GESTURE_NONE;
+    for (;;) {
+        g = drainEdges();
+        if (g == GESTURE_NONE) g = decoder.poll(touchNowMs());
+        if (g != GESTURE_NONE) break;
 
-String getTouchResponse() {
-    // Currently hardcoded to "Yes"
-    return "Yes";
+        uint32_t elapsed = millis() - start;
+        if (elapsed >= timeout_ms) break;
+        uint32_t wait = timeout_ms - elapsed;
+        // Wake for the decoder's next timeout (tap window, long press, hold)
+        uint32_t deadline;
+        if (decoder.nextDeadline(&deadline)) {
+            int32_t until = (int32_t)(deadline - touchNowMs());
+            if (until < 1) until = 1;
+            if ((uint32_t)until < wait) wait = until;
+        }
+        TickType_t ticks = pdMS_TO_TICKS(wait);
+        ulTaskNotifyTake(pdTRUE, ticks ? ticks : 1);
+    }
+    touch_waiter = NULL;
+    if (g != GESTURE_NONE) LOG_INFO("Touch: %s\n", touchGestureName(g));
+    return g;
 }
 
-bool touchJustPressed() {
-    if (touchDetectedFlag) {
-        touchDetectedFlag = false; // Reset flag
-        return true;
-    }
-    return false;
-}
\ No newline at end of file
+uint32_t touchEdgesDropped() { return edges_dropped; }
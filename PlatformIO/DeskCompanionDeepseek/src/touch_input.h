@@ -3,24 +3,18 @@
 
 #include <Arduino.h>
 #include "config.h"
+#include "touch_gesture.h"
 
-// Touch sensor states
-enum TouchState {
-    TOUCH_IDLE,
-    TOUCH_PRESSED,
-    TOUCH_DEBOUNCING
-};
-
-// Function declarations
+// Interrupt-driven touch sensor. The GPIO ISR timestamps every edge into a
+// small ring; gestures are decoded from those timestamps by whichever task
+// calls waitForTouchGesture(), so late processing does not skew timing.
 void initTouchSensor();
-bool isTouchDetected();
-void handleTouchInput();
-String getTouchResponse(); // Currently hardcoded to "Yes"
-bool touchJustPressed();
 
-// Global variables
-extern TouchState currentTouchState;
-extern unsigned long lastTouchTime;
-extern bool touchDetectedFlag;
+// Block until a gesture is decoded or timeout_ms passes (GESTURE_NONE).
+// Only one task may wait at a time.
+TouchGesture waitForTouchGesture(uint32_t timeout_ms);
+
+// Edges dropped because the ring was full (diagnostics)
+uint32_t touchEdgesDropped();
 
-#endif // TOUCH_INPUT_H
\ No newline at end of file
+#endif // TOUCH_INPUT_H
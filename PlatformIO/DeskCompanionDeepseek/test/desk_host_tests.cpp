@@ -0,0 +1,395 @@
+#include <iostream>
+#include <string>
+#include <string.h>
+#include "../src/prompt_writer.h"
+#include "../src/spsc_ring.h"
+#include "../src/text_layout.h"
+#include "../src/touch_gesture.h"
+#include "../src/log_ring.h"
+#include "../src/droid_voice.h"
+#include <vector>
+#include <stdlib.h>
+
+int run_fact_history_tests() {
+  int failures = 0;
+  FactHistory h;
+  if (h.size() != 0) { std::cerr << "FactHistory should start empty\n"; ++failures; }
+
+  for (int i = 0; i < 7; ++i) h.push(std::to_string(i).c_str());
+  if (h.size() != FactHistory::CAPACITY) { std::cerr << "FactHistory size not capped\n"; ++failures; }
+  // Oldest two (0, 1) were overwritten
+  if (std::string(h.at(0)) != "2") { std::cerr << "FactHistory oldest wrong\n"; ++failures; }
+  if (std::string(h.at(4)) != "6") { std::cerr << "FactHistory newest wrong\n"; ++failures; }
+
+  // Truncation must not split a UTF-8 sequence
+  std::string longFact(FactHistory::FACT_MAX - 2, 'a');
+  longFact += "\xC3\xA9"; // e-acute straddles the limit
+  h.push(longFact.c_str());
+  if (strlen(h.at(h.size() - 1)) != FactHistory::FACT_MAX - 2) { std::cerr << "FactHistory UTF-8 truncation\n"; ++failures; }
+
+  h.clear();
+  if (h.size() != 0) { std::cerr << "FactHistory clear failed\n"; ++failures; }
+  return failures;
+}
+
+int run_prompt_writer_tests() {
+  int failures = 0;
+  char buf[512];
+  PromptWriter w(buf, sizeof(buf));
+  w.beginRequest("deepseek-chat", 100, 0.9, "sys");
+  w.text("say \"hi\"\\\n\t").text("\x01").number(42);
+  const char* out = w.endRequest();
+  std::string expect =
+    "{\"model\":\"deepseek-chat\",\"max_tokens\":100,\"temperature\":0.9,"
+    "\"messages\":[{\"role\":\"system\",\"content\":\"sys\"},"
+    "{\"role\":\"user\",\"content\":\"say \\\"hi\\\"\\\\\\n\\t\\u000142\"}]}";
+  if (!out || expect != out) { std::cerr << "PromptWriter output mismatch: " << (out ? out : "(null)") << "\n"; ++failures; }
+  if (w.length() != expect.size()) { std::cerr << "PromptWriter length mismatch\n"; ++failures; }
+
+  // Overflow is sticky and reported by endRequest()
+  char small[16];
+  PromptWriter s(small, sizeof(small));
+  s.beginRequest("deepseek-chat", 100, 0.9, "sys");
+  if (!s.overflowed() || s.endRequest() != nullptr) { std::cerr << "PromptWriter overflow not reported\n"; ++failures; }
+  if (strlen(small) >= sizeof(small)) { std::cerr << "PromptWriter wrote past buffer\n"; ++failures; }
+  return failures;
+}
+
+int run_spsc_ring_tests() {
+  int failures = 0;
+  uint8_t storage[16];
+  SpscRing r;
+  if (r.init(storage, 12)) { std::cerr << "SpscRing accepted non power-of-two\n"; ++failures; }
+  if (!r.init(storage, sizeof(storage))) { std::cerr << "SpscRing init failed\n"; ++failures; }
+
+  uint8_t in[32], out[32];
+  for (int i = 0; i < 32; ++i) in[i] = (uint8_t)i;
+
+  // Fill past capacity: write is clipped
+  if (r.write(in, 20) != 16) { std::cerr << "SpscRing write not clipped\n"; ++failures; }
+  if (r.space() != 0) { std::cerr << "SpscRing space after fill\n"; ++failures; }
+
+  // Drain part, then write across the wrap point
+  if (r.read(out, 10) != 10 || out[9] != 9) { std::cerr << "SpscRing read\n"; ++failures; }
+  if (r.write(in + 16, 10) != 10) { std::cerr << "SpscRing wrap write\n"; ++failures; }
+  size_t n = r.read(out, sizeof(out));
+  if (n != 16) { std::cerr << "SpscRing wrap read count\n"; ++failures; }
+  for (size_t i = 0; i < n; ++i) {
+    if (out[i] != (uint8_t)(10 + i)) { std::cerr << "SpscRing data order\n"; ++failures; break; }
+  }
+  if (r.read(out, 4) != 0) { std::cerr << "SpscRing read from empty\n"; ++failures; }
+
+  r.write(in, 5);
+  r.discard();
+  if (r.available() != 0) { std::cerr << "SpscRing discard\n"; ++failures; }
+  return failures;
+}
+
+// Render a layout into a small page-ordered buffer and return it as rows of
+// '#'/'.' for comparison with a golden image.
+static std::string renderAscii(const TextLayout& l, int w, int h, int scrollY) {
+  uint8_t fb[256];
+  memset(fb, 0xFF, sizeof(fb)); // render() must clear what it draws over
+  l.render(fb, w, h, scrollY);
+  std::string out;
+  for (int y = 0; y < h; ++y) {
+    for (int x = 0; x < w; ++x) out += (fb[(y >> 3) * w + x] >> (y & 7)) & 1 ? '#' : '.';
+    out += '\n';
+  }
+  return out;
+}
+
+int run_text_layout_tests() {
+  int failures = 0;
+  char line[200];
+
+  TextLayout l;
+  if (!l.layout("The quick brown fox jumps over the lazy dog. Cats nap on warm keyboards all day long.", 128)) {
+    std::cerr << "TextLayout first layout reported cached\n"; ++failures;
+  }
+  const char* expect[] = { "The quick brown fox", "jumps over the lazy dog.", "Cats nap on warm", "keyboards all day long." };
+  if (l.lineCount() != 4) { std::cerr << "TextLayout line count " << l.lineCount() << "\n"; ++failures; }
+  for (int i = 0; i < l.lineCount() && i < 4; ++i) {
+    l.lineText(i, line, sizeof(line));
+    if (std::string(line) != expect[i]) { std::cerr << "TextLayout line " << i << ": [" << line << "]\n"; ++failures; }
+    if (l.lineWidth(i) > 128) { std::cerr << "TextLayout line " << i << " too wide\n"; ++failures; }
+  }
+  if (l.layout("The quick brown fox jumps over the lazy dog. Cats nap on warm keyboards all day long.", 128)) {
+    std::cerr << "TextLayout same fact not cached\n"; ++failures;
+  }
+
+  // The cache keeps the last ENTRIES facts; the least recently shown goes first
+  TextLayoutCache cache;
+  const char* facts[TextLayoutCache::ENTRIES + 1] = { "fact zero", "fact one", "fact two", "fact three", "fact four" };
+  bool hit = true;
+  for (int i = 0; i < TextLayoutCache::ENTRIES; ++i) {
+    cache.layout(facts[i], 128, &hit);
+    if (hit) { std::cerr << "TextLayoutCache new fact " << i << " reported cached\n"; ++failures; }
+  }
+  const TextLayout& again = cache.layout(facts[0], 128, &hit);
+  again.lineText(0, line, sizeof(line));
+  if (!hit || std::string(line) != "fact zero") { std::cerr << "TextLayoutCache recent fact not cached\n"; ++failures; }
+  cache.layout(facts[1], 64, &hit);
+  if (hit) { std::cerr << "TextLayoutCache ignored width\n"; ++failures; }
+  cache.layout(facts[TextLayoutCache::ENTRIES], 128, &hit);  // evicts facts[2], the oldest now
+  cache.layout(facts[0], 128, &hit);
+  if (!hit) { std::cerr << "TextLayoutCache evicted a recent fact\n"; ++failures; }
+  cache.layout(facts[2], 128, &hit);
+  if (hit) { std::cerr << "TextLayoutCache kept the oldest fact\n"; ++failures; }
+
+  // Explicit newlines, and a word wider than the line is split
+  l.layout("ab\nWWWWWWWWWW", 30);
+  l.lineText(0, line, sizeof(line));
+  if (l.lineCount() != 3 || std::string(line) != "ab") { std::cerr << "TextLayout newline/split wrong\n"; ++failures; }
+  l.lineText(1, line, sizeof(line));
+  if (std::string(line) != "WWWWW") { std::cerr << "TextLayout split line: [" << line << "]\n"; ++failures; }
+
+  // Paging: 7 lines per 64px page
+  l.layout("a b c d e f g h i j", 4);
+  if (l.lineCount() != 10 || l.pageCount(64) != 2 || l.maxScroll(64) != 10 * TextLayout::LINE_HEIGHT - 64) {
+    std::cerr << "TextLayout paging wrong\n"; ++failures;
+  }
+
+  // Golden images
+  l.layout("Hi, go!", 32);
+  std::string golden =
+    "#...#..#....................#...\n"
+    "#...#.......................#...\n"
+    "#...#.##.........####..###..#...\n"
+    "#####..#........#...#.#...#.#...\n"
+    "#...#..#........#...#.#...#.#...\n"
+    "#...#..#..##.....####.#...#.....\n"
+    "#...#.###..#........#..###..#...\n"
+    "..........#......###............\n";
+  if (renderAscii(l, 32, 8, 0) != golden) { std::cerr << "TextLayout golden 'Hi, go!' mismatch:\n" << renderAscii(l, 32, 8, 0); ++failures; }
+
+  // Wrapped and scrolled by 4px: bottom of line 0, gap, top of line 1
+  l.layout("Bee hum", 20);
+  golden =
+    "#...#.#####.#####...\n"
+    "#...#.#.....#.......\n"
+    "####...###...###....\n"
+    "....................\n"
+    "....................\n"
+    "#...................\n"
+    "#...................\n"
+    "#.##..#...#.##.#....\n"
+    "##..#.#...#.#.#.#...\n"
+    "#...#.#...#.#.#.#...\n"
+    "#...#.#..##.#...#...\n"
+    "#...#..##.#.#...#...\n"
+    "....................\n"
+    "....................\n"
+    "....................\n"
+    "....................\n";
+  if (renderAscii(l, 20, 16, 4) != golden) { std::cerr << "TextLayout golden scroll mismatch:\n" << renderAscii(l, 20, 16, 4); ++failures; }
+
+  // Partial render leaves rows outside the range alone
+  uint8_t fb[20 * 2];
+  memset(fb, 0xFF, sizeof(fb));
+  l.render(fb, 20, 16, 0, 8, 16);
+  if (fb[0] != 0xFF) { std::cerr << "TextLayout partial render touched other rows\n"; ++failures; }
+  return failures;
+}
+
+int run_text_scroller_tests() {
+  int failures = 0;
+  TextLayout l;
+  l.layout("a b c d e f g h i j", 4); // 10 lines, 26px of overflow
+  TextScroller s;
+  s.start(l, 64, 0);
+  if (!s.active() || s.tick(100)) { std::cerr << "TextScroller moved during hold\n"; ++failures; }
+
+  uint32_t t = TextScroller::HOLD_MS;
+  int moves = 0;
+  while (s.tick(t)) { ++moves; t += TextScroller::STEP_MS; }
+  if (s.offset() != l.maxScroll(64) || moves != l.maxScroll(64)) { std::cerr << "TextScroller stopped at " << s.offset() << "\n"; ++failures; }
+  // Holds at the end, then wraps to the top
+  t += TextScroller::HOLD_MS;
+  if (!s.tick(t) || s.offset() != 0) { std::cerr << "TextScroller did not wrap\n"; ++failures; }
+
+  l.layout("short", 128);
+  s.start(l, 64, 0);
+  if (s.active() || s.tick(100000)) { std::cerr << "TextScroller active for text that fits\n"; ++failures; }
+  return failures;
+}
+
+int run_touch_gesture_tests() {
+  int failures = 0;
+  typedef TouchGestureDecoder D;
+  D d;
+
+  // Single tap is only reported once the double-tap window closes
+  if (d.onEdge(true, 1000) != GESTURE_NONE || d.onEdge(false, 1080) != GESTURE_NONE) { std::cerr << "Touch tap fired early\n"; ++failures; }
+  uint32_t deadline = 0;
+  if (!d.nextDeadline(&deadline) || deadline != 1080 + D::DOUBLE_TAP_MS) { std::cerr << "Touch tap deadline wrong\n"; ++failures; }
+  if (d.poll(deadline - 1) != GESTURE_NONE || d.poll(deadline) != GESTURE_TAP) { std::cerr << "Touch tap not decoded\n"; ++failures; }
+  if (d.nextDeadline(&deadline)) { std::cerr << "Touch idle has a deadline\n"; ++failures; }
+
+  // Double tap, with contact bounce on the first release
+  d.onEdge(true, 2000);
+  d.onEdge(false, 2060);
+  d.onEdge(true, 2065);   // bounce, press continues
+  d.onEdge(false, 2100);
+  d.onEdge(true, 2250);
+  if (d.onEdge(false, 2320) != GESTURE_DOUBLE_TAP) { std::cerr << "Touch double tap not decoded\n"; ++failures; }
+  if (d.poll(5000) != GESTURE_NONE) { std::cerr << "Touch extra gesture after double tap\n"; ++failures; }
+
+  // A press shorter than the glitch threshold is ignored
+  d.onEdge(true, 6000);
+  d.onEdge(false, 6005);
+  if (d.poll(7000) != GESTURE_NONE) { std::cerr << "Touch glitch decoded\n"; ++failures; }
+
+  // Long press is reported on release, and only if it never became a hold
+  d.onEdge(true, 8000);
+  if (d.poll(8000 + D::LONG_PRESS_MS) != GESTURE_NONE) { std::cerr << "Touch long press fired while held\n"; ++failures; }
+  if (d.onEdge(false, 8000 + D::HOLD_MS - 1) != GESTURE_LONG_PRESS) { std::cerr << "Touch long press not decoded\n"; ++failures; }
+  if (d.poll(20000) != GESTURE_NONE) { std::cerr << "Touch extra gesture after long press\n"; ++failures; }
+
+  // Hold repeats until release, with no long press before or after it
+  d.onEdge(true, 21000);
+  if (d.poll(21000 + D::LONG_PRESS_MS) != GESTURE_NONE) { std::cerr << "Touch long press before hold\n"; ++failures; }
+  if (d.poll(21000 + D::HOLD_MS) != GESTURE_HOLD) { std::cerr << "Touch hold not decoded\n"; ++failures; }
+  if (d.poll(21000 + D::HOLD_MS + D::HOLD_REPEAT_MS) != GESTURE_HOLD) { std::cerr << "Touch hold did not repeat\n"; ++failures; }
+  if (d.onEdge(false, 22700) != GESTURE_NONE || d.poll(25000) != GESTURE_NONE) { std::cerr << "Touch release after hold\n"; ++failures; }
+
+  // Edges processed late: the tap timeout is decided from edge timestamps
+  d.onEdge(true, 30000);
+  d.onEdge(false, 30100);
+  if (d.onEdge(true, 32000) != GESTURE_TAP) { std::cerr << "Touch late tap not decoded\n"; ++failures; }
+  d.onEdge(false, 32100);
+  if (d.poll(40000) != GESTURE_TAP) { std::cerr << "Touch second late tap lost\n"; ++failures; }
+
+  // Millisecond clock wrap
+  d.onEdge(true, 0xFFFFFF00u);
+  d.onEdge(false, 0xFFFFFF50u);
+  if (d.poll(0x00000010u) != GESTURE_NONE || d.poll(0xFFFFFF50u + D::DOUBLE_TAP_MS) != GESTURE_TAP) { std::cerr << "Touch wrap handling\n"; ++failures; }
+  return failures;
+}
+
+int run_log_ring_tests() {
+  int failures = 0;
+  uint8_t storage[128];
+  LogRing r;
+  if (r.init(storage, 100)) { std::cerr << "LogRing accepted non power-of-two\n"; ++failures; }
+  if (!r.init(storage, sizeof(storage))) { std::cerr << "LogRing init failed\n"; ++failures; }
+
+  const uint8_t* p;
+  size_t len;
+  uint8_t tag;
+  uint32_t stamp;
+  if (r.peek(&p, &len, &tag, &stamp)) { std::cerr << "LogRing empty peek\n"; ++failures; }
+
+  // Claimed but unpublished records hold back the ones after them
+  uint8_t* a = r.reserve(5);
+  uint8_t* b = r.reserve(3);
+  memcpy(b, "bbb", 3);
+  r.commit(b, 3, 2, 200);
+  if (r.peek(&p, &len, &tag, &stamp)) { std::cerr << "LogRing read past unpublished record\n"; ++failures; }
+  memcpy(a, "hello", 5);
+  r.commit(a, 5, 7, 100);
+  if (!r.peek(&p, &len, &tag, &stamp) || len != 5 || memcmp(p, "hello", 5) != 0 || tag != 7 || stamp != 100) {
+    std::cerr << "LogRing first record wrong\n"; ++failures;
+  }
+  r.pop();
+  if (!r.peek(&p, &len, &tag, &stamp) || len != 3 || memcmp(p, "bbb", 3) != 0 || tag != 2) { std::cerr << "LogRing second record wrong\n"; ++failures; }
+  r.pop();
+  if (r.used() != 0) { std::cerr << "LogRing not empty after pops\n"; ++failures; }
+
+  // Records never straddle the end: a padding record is skipped silently
+  for (int round = 0; round < 10; ++round) {
+    uint8_t* x = r.reserve(28);
+    if (!x) { std::cerr << "LogRing reserve failed on round " << round << "\n"; ++failures; break; }
+    memset(x, 'a' + round, 28);
+    r.commit(x, 28, 1, round);
+    if (!r.peek(&p, &len, &tag, &stamp) || len != 28 || p[27] != 'a' + round || stamp != (uint32_t)round) {
+      std::cerr << "LogRing wrapped record wrong on round " << round << "\n"; ++failures;
+    }
+    r.pop();
+  }
+
+  // Full ring refuses instead of overwriting
+  int accepted = 0;
+  while (uint8_t* x = r.reserve(8)) { r.commit(x, 8, 0, 0); ++accepted; }
+  if (accepted == 0 || accepted > (int)(sizeof(storage) / 16)) { std::cerr << "LogRing accepted " << accepted << " records\n"; ++failures; }
+  if (r.reserve(100)) { std::cerr << "LogRing accepted oversize record\n"; ++failures; }
+
+  // maxPayload() is exactly the largest record an empty ring accepts
+  LogRing e;
+  e.init(storage, sizeof(storage));
+  if (!e.reserve(e.maxPayload())) { std::cerr << "LogRing refused maxPayload\n"; ++failures; }
+  e.init(storage, sizeof(storage));
+  if (e.reserve(e.maxPayload() + 1)) { std::cerr << "LogRing accepted maxPayload + 1\n"; ++failures; }
+  return failures;
+}
+
+int run_droid_voice_tests() {
+  int failures = 0;
+  const char* fact = "Octopuses have three hearts, and two stop when they swim!";
+  DroidVoice v;
+  v.begin(fact);
+  uint32_t total = v.totalFrames();
+  if (total < DroidVoice::SAMPLE_RATE || total > 10 * DroidVoice::SAMPLE_RATE) { std::cerr << "DroidVoice length " << total << "\n"; ++failures; }
+
+  // Rendering in odd-sized pieces matches one big render and stops exactly
+  std::vector<int16_t> whole(2 * (total + 100)), pieces(2 * (total + 100));
+  size_t n = v.render(whole.data(), total + 100);
+  if (n != total || !v.done()) { std::cerr << "DroidVoice rendered " << n << " of " << total << "\n"; ++failures; }
+  v.begin(fact);
+  size_t got = 0, step;
+  while ((step = v.render(pieces.data() + 2 * got, 777)) > 0) got += step;
+  if (got != total || whole != pieces) { std::cerr << "DroidVoice chunked render differs\n"; ++failures; }
+
+  // Audible, not clipped, stereo channels identical, crushed to 10 bits
+  int peak = 0;
+  bool crushed = true, mono = true;
+  for (size_t i = 0; i < n; ++i) {
+    int s = whole[2 * i];
+    if (abs(s) > peak) peak = abs(s);
+    if (s & ((1 << (16 - DroidVoice::BITS)) - 1)) crushed = false;
+    if (whole[2 * i + 1] != s) mono = false;
+  }
+  if (peak < 8000 || peak >= 32767) { std::cerr << "DroidVoice peak " << peak << "\n"; ++failures; }
+  if (!crushed || !mono) { std::cerr << "DroidVoice bitcrush/stereo wrong\n"; ++failures; }
+
+  // Negative samples round onto the same grid and saturate without leaving it
+  const int q = 1 << (16 - DroidVoice::BITS);
+  const int32_t crushIn[] = {-1, -q / 2, -q / 2 - 1, -q - 1, -1000, -32768, -40000, 1000, 32767, 40000};
+  const int16_t crushOut[] = {0, 0, (int16_t)-q, (int16_t)-q, (int16_t)(-16 * q), -32768, -32768, (int16_t)(16 * q), (int16_t)(32768 - q), (int16_t)(32768 - q)};
+  for (size_t i = 0; i < sizeof(crushIn) / sizeof(crushIn[0]); ++i) {
+    int16_t c = DroidVoice::crush(crushIn[i]);
+    if (c != crushOut[i]) { std::cerr << "DroidVoice crush(" << crushIn[i] << ") = " << c << "\n"; ++failures; }
+  }
+  int trough = 0;
+  for (size_t i = 0; i < n; ++i) if (whole[2 * i] < trough) trough = whole[2 * i];
+  if (trough > -8000) { std::cerr << "DroidVoice trough " << trough << "\n"; ++failures; }
+
+  // Cadence: punctuation adds pause time; the tail decays to near silence
+  DroidVoice a, b;
+  a.begin("one two");
+  b.begin("one. two");
+  if (b.totalFrames() <= a.totalFrames()) { std::cerr << "DroidVoice pause not longer\n"; ++failures; }
+  int tailPeak = 0;
+  for (size_t i = n - 1000; i < n; ++i) if (abs(whole[2 * i]) > tailPeak) tailPeak = abs(whole[2 * i]);
+  if (tailPeak > peak / 4) { std::cerr << "DroidVoice tail not released: " << tailPeak << "\n"; ++failures; }
+
+  // Empty text still produces just the tail and then stops
+  v.begin("");
+  if (v.render(whole.data(), total) != v.totalFrames() || !v.done()) { std::cerr << "DroidVoice empty text\n"; ++failures; }
+  return failures;
+}
+
+int main() {
+  int fails = 0;
+  fails += run_fact_history_tests();
+  fails += run_prompt_writer_tests();
+  fails += run_spsc_ring_tests();
+  fails += run_text_layout_tests();
+  fails += run_text_scroller_tests();
+  fails += run_touch_gesture_tests();
+  fails += run_log_ring_tests();
+  fails += run_droid_voice_tests();
+  if (fails == 0) std::cout << "ALL TESTS PASSED\n";
+  else std::cout << fails << " TESTS FAILED\n";
+  return fails;
+}
@@ -1,19 +1,26 @@
 #include <Arduino.h>
 #include <FS.h>
 
-#include "AudioFileSourceSPIFFS.h"
-#include "AudioGeneratorMP3.h"
 #include "AudioOutputI2S.h"
+#include "playlist_player.h"
 
 static const int LED_PIN = 2; // D4 built-in LED on many ESP8266 boards (active LOW)
 
-AudioGeneratorMP3 *mp3;
-AudioFileSourceSPIFFS *file;
+// Played in order and looped; each track starts as the previous one ends
+static const char *PLAYLIST[] = {
+  "/S0_loud2.mp3",
+  "/S0.mp3",
+};
+
 AudioOutputI2S *out;
+PlaylistPlayer *player;
 
 unsigned long lastBlink = 0;
 bool ledOn = false;
 
+static const unsigned long STATS_MS = 5000;
+unsigned long lastStats = 0;
+
 void listFS() {
   Serial.println("SPIFFS files:");
   Dir dir = SPIFFS.openDir("/");
@@ -22,19 +29,6 @@ void listFS() {
   }
 }
 
-void openAndPlay() {
-  if (file) { delete file; file = nullptr; }
-  file = new AudioFileSourceSPIFFS("/S0_loud2.mp3");
-
-  if (!file->isOpen()) {
-    Serial.println("MP3 file NOT open! (Check /data upload + filename)");
-    return;
-  }
-
-  Serial.println("MP3 file opened. Starting playback...");
-  mp3->begin(file, out);
-}
-
 void setup() {
   Serial.begin(115200);
   delay(200);
@@ -59,9 +53,15 @@ void setup() {
   // );
   out->SetGain(0.7);
 
-  mp3 = new AudioGeneratorMP3();
+  player = new PlaylistPlayer(out);
+  for (const char *path : PLAYLIST) player->add(path);
+  player->setLoop(true);
 
-  openAndPlay();
+  if (player->begin()) {
+    Serial.println("Playlist started");
+  } else {
+    Serial.println("Playlist could not start (Check /data upload + filenames)");
+  }
 }
 
 
@@ -74,19 +74,19 @@ void loop() {
     digitalWrite(LED_PIN, ledOn ? LOW : HIGH);
   }
 
-  if (mp3->isRunning()) {
-    if (!mp3->loop()) {
-      Serial.println("mp3->loop() failed -> stopping + restarting");
-      mp3->stop();
-      delay(200);
-      openAndPlay();   // reopen and try again
-    }
-  } else {
-    static unsigned long lastTry = 0;
-    if (millis() - lastTry > 1000) {
-      lastTry = millis();
-      Serial.println("Not running -> retry");
-      openAndPlay();
-    }
+  uint32_t handoffs = player->handoffs();
+  player->loop();
+  if (player->handoffs() != handoffs) {
+    Serial.printf("Now playing %s (handoffs=%u failures=%u)\n", PLAYLIST[player->currentTrack()],
+                  player->handoffs(), player->failures());
+  }
+
+  // Read-ahead health: underruns mean the decoder had to wait on flash
+  if (now - lastStats >= STATS_MS) {
+    lastStats = now;
+    ReadAheadStats s = player->sourceStats();
+    Serial.printf("Source: refills=%u (%u KB) underruns=%u min level=%u B slowest read=%u us\n",
+                  s.refills, s.refillBytes / 1024, s.underruns, s.minLevel, s.maxRefillUs);
+    player->resetSourceStats();
   }
 }
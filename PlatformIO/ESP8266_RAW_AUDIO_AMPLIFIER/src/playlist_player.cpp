@@ -0,0 +1,146 @@
+#include "playlist_player.h"
+
+bool AudioOutputHandoff::SetRate(int hz) {
+  if (started_ && hz == rate_) return true; // reprogramming I2S clocks clicks
+  rate_ = hz;
+  return sink_->SetRate(hz);
+}
+
+bool AudioOutputHandoff::begin() {
+  if (!started_) started_ = sink_->begin();
+  return started_;
+}
+
+void AudioOutputHandoff::shutdown() {
+  if (started_) sink_->stop();
+  started_ = false;
+  rate_ = 0;
+}
+
+PlaylistPlayer::PlaylistPlayer(AudioOutput *sink)
+  : out_(sink), mp3_(nullptr), mp3Space_(nullptr), ringBuf_(nullptr),
+    count_(0), cur_(0), active_(0), nextReady_(false), loop_(true), finished_(false),
+    failStreak_(0), retryAt_(0), handoffs_(0), failures_(0) {
+  src_[0] = nullptr;
+  src_[1] = nullptr;
+}
+
+bool PlaylistPlayer::add(const char *path) {
+  if (count_ >= MAX_TRACKS || !path || strlen(path) >= PATH_MAX_LEN) return false;
+  strcpy(tracks_[count_++], path);
+  return true;
+}
+
+bool PlaylistPlayer::begin() {
+  if (count_ == 0) return false;
+  if (!mp3_) {
+    mp3Space_ = malloc(AudioGeneratorMP3::preAllocSize());
+    ringBuf_ = (uint8_t *)malloc(2 * RING_BYTES);
+    if (!mp3Space_ || !ringBuf_) {
+      Serial.println("Playlist: not enough heap for decoder + buffers");
+      free(mp3Space_);
+      free(ringBuf_);
+      mp3Space_ = nullptr;
+      ringBuf_ = nullptr;
+      return false;
+    }
+    mp3_ = new AudioGeneratorMP3(mp3Space_, AudioGeneratorMP3::preAllocSize());
+    src_[0] = new AudioFileSourceReadAhead(SPIFFS, ringBuf_, RING_BYTES);
+    src_[1] = new AudioFileSourceReadAhead(SPIFFS, ringBuf_ + RING_BYTES, RING_BYTES);
+  }
+
+  stop();
+  finished_ = false;
+  failStreak_ = 0;
+  cur_ = 0;
+  active_ = 0;
+  nextReady_ = false;
+  return startActive();
+}
+
+void PlaylistPlayer::stop() {
+  if (!mp3_) return;
+  if (mp3_->isRunning()) mp3_->stop();
+  src_[0]->close();
+  src_[1]->close();
+  out_.shutdown();
+  finished_ = true;
+}
+
+bool PlaylistPlayer::startActive() {
+  AudioFileSourceReadAhead *src = src_[active_];
+  bool ok = src->isOpen() || src->open(tracks_[cur_]);
+  if (ok) {
+    src->fill(RING_BYTES); // no-op when preloaded
+    ok = src->buffered() > 0 && mp3_->begin(src, &out_);
+  }
+  if (ok) {
+    failStreak_ = 0;
+    return true;
+  }
+  src->close();
+  failures_++;
+  if (++failStreak_ >= count_) retryAt_ = millis() + RETRY_MS;
+  Serial.printf("Playlist: cannot play %s\n", tracks_[cur_]);
+  return false;
+}
+
+// Opens the following track in the idle source while this one plays
+void PlaylistPlayer::preloadNext() {
+  nextReady_ = true; // one attempt per track; startActive() retries the open
+  uint8_t next = nextIndex(cur_);
+  if (next == 0 && !loop_) return;
+  AudioFileSourceReadAhead *src = src_[active_ ^ 1];
+  src->close();
+  if (!src->open(tracks_[next]) || !src->fill(RING_BYTES)) src->close();
+}
+
+bool PlaylistPlayer::advance() {
+  if (mp3_->isRunning()) mp3_->stop(); // also closes the finished source
+  src_[active_]->close();
+
+  uint8_t next = nextIndex(cur_);
+  if (next == 0 && !loop_) {
+    stop();
+    return false;
+  }
+  if (!nextReady_) src_[active_ ^ 1]->close();
+  active_ ^= 1;
+  cur_ = next;
+  nextReady_ = false;
+  handoffs_++;
+  return startActive();
+}
+
+bool PlaylistPlayer::loop() {
+  if (!mp3_ || finished_) return false;
+
+  if (mp3_->isRunning() && mp3_->loop()) {
+    if (!nextReady_) preloadNext();
+    return true;
+  }
+
+  // Track ended or failed: switch in this same pass, no delay
+  if (failStreak_ >= count_ && (long)(millis() - retryAt_) < 0) return true;
+  advance();
+  return !finished_;
+}
+
+ReadAheadStats PlaylistPlayer::sourceStats() const {
+  ReadAheadStats sum;
+  memset(&sum, 0, sizeof(sum));
+  sum.minLevel = RING_BYTES;
+  for (uint8_t i = 0; i < 2 && src_[i]; i++) {
+    const ReadAheadStats &s = src_[i]->stats();
+    sum.refills += s.refills;
+    sum.refillBytes += s.refillBytes;
+    sum.underruns += s.underruns;
+    if (s.minLevel < sum.minLevel) sum.minLevel = s.minLevel;
+    if (s.maxRefillUs > sum.maxRefillUs) sum.maxRefillUs = s.maxRefillUs;
+  }
+  return sum;
+}
+
+void PlaylistPlayer::resetSourceStats() {
+  for (uint8_t i = 0; i < 2 && src_[i]; i++) src_[i]->resetStats();
+}
@@ -0,0 +1,92 @@
+// Gapless MP3 playlist for the ESP8266.
+//
+// Two read-ahead sources take turns: while one feeds the decoder, the other
+// already has the next track open with its ring filled. When a
+// track ends (or fails) the decoder is restarted on the preloaded source in
+// the same loop() pass. The I2S output is wrapped so the decoder's
+// stop()/begin() never reset it, which is what made the old restart path
+// audible. Decoder and ring buffers are allocated once in begin().
+//
+// Two full MP3 decoders do not fit in the ESP8266 heap, so the handoff
+// reuses one preallocated decoder instead of crossfading two.
+#ifndef PLAYLIST_PLAYER_H
+#define PLAYLIST_PLAYER_H
+
+#include <Arduino.h>
+#include "AudioGeneratorMP3.h"
+#include "AudioOutput.h"
+#include "readahead_source.h"
+
+// Forwards samples to the real output but keeps it running across tracks
+class AudioOutputHandoff : public AudioOutput {
+public:
+  explicit AudioOutputHandoff(AudioOutput *sink) : sink_(sink), started_(false), rate_(0) {}
+
+  virtual bool SetRate(int hz) override;
+  virtual bool SetBitsPerSample(int bits) override { return sink_->SetBitsPerSample(bits); }
+  virtual bool SetChannels(int channels) override { return sink_->SetChannels(channels); }
+  virtual bool begin() override;
+  virtual bool ConsumeSample(int16_t sample[2]) override { return sink_->ConsumeSample(sample); }
+  virtual bool loop() override { return sink_->loop(); }
+  virtual bool stop() override { return true; } // track boundary, keep I2S running
+
+  void shutdown();
+
+private:
+  AudioOutput *sink_;
+  bool started_;
+  int rate_;
+};
+
+class PlaylistPlayer {
+public:
+  static const uint8_t MAX_TRACKS = 8;
+  static const uint8_t PATH_MAX_LEN = 32;
+  static const uint32_t RETRY_MS = 1000; // back-off once every track has failed
+  static const uint32_t RING_BYTES = 4096; // per source
+
+  explicit PlaylistPlayer(AudioOutput *sink);
+
+  bool add(const char *path);
+  void setLoop(bool loop) { loop_ = loop; }
+
+  // Allocates the decoder and buffers, starts track 0
+  bool begin();
+  // Call from loop(); returns false once a non-looping playlist is done
+  bool loop();
+  void stop();
+
+  uint8_t currentTrack() const { return cur_; }
+  uint32_t handoffs() const { return handoffs_; }
+  uint32_t failures() const { return failures_; }
+
+  // Read-ahead counters of both sources combined
+  ReadAheadStats sourceStats() const;
+  void resetSourceStats();
+
+private:
+  uint8_t nextIndex(uint8_t i) const { return (uint8_t)((i + 1) % count_); }
+  bool startActive();
+  void preloadNext();
+  bool advance();
+
+  AudioOutputHandoff out_;
+  AudioGeneratorMP3 *mp3_;
+  void *mp3Space_;
+  uint8_t *ringBuf_;
+  AudioFileSourceReadAhead *src_[2];
+
+  char tracks_[MAX_TRACKS][PATH_MAX_LEN];
+  uint8_t count_;
+  uint8_t cur_;       // track playing in src_[active_]
+  uint8_t active_;
+  bool nextReady_;    // preload of nextIndex(cur_) into src_[active_ ^ 1] done
+  bool loop_;
+  bool finished_;
+  uint8_t failStreak_;
+  unsigned long retryAt_;
+  uint32_t handoffs_;
+  uint32_t failures_;
+};
+
+#endif
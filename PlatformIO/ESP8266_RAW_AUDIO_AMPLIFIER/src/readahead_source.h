@@ -0,0 +1,65 @@
+// Read-ahead audio source for SPIFFS/LittleFS on the ESP8266.
+//
+// Decoders ask for a few hundred bytes at a time from inside their decode
+// loop; on a single core that also services WiFi, each of those flash reads
+// can starve the I2S DMA. This source keeps a ring of upcoming file bytes
+// and refills it in REFILL-aligned reads from loop() (the generator calls
+// it after every decode pass), so read() is normally a memcpy. When the
+// ring runs dry read() refills synchronously and counts an underrun.
+//
+// File offset X lives at buf[X & (capacity - 1)], so aligned refills never
+// straddle the wrap. open()/close() never allocate; the object can be
+// reused for the next track.
+#ifndef READAHEAD_SOURCE_H
+#define READAHEAD_SOURCE_H
+
+#include <Arduino.h>
+#include <FS.h>
+#include "AudioFileSource.h"
+
+struct ReadAheadStats {
+  uint32_t refills;       // flash reads issued
+  uint32_t refillBytes;
+  uint32_t underruns;     // read() found the ring short and waited on flash
+  uint32_t minLevel;      // fewest bytes buffered when read() was called
+  uint32_t maxRefillUs;   // slowest single flash read
+};
+
+class AudioFileSourceReadAhead : public AudioFileSource {
+public:
+  static const uint32_t REFILL = 1024;
+
+  // `buf` holds `capacity` bytes: a power of two, at least 2 * REFILL
+  AudioFileSourceReadAhead(fs::FS &fs, uint8_t *buf, uint32_t capacity);
+  virtual ~AudioFileSourceReadAhead() override;
+
+  virtual bool open(const char *filename) override;
+  virtual uint32_t read(void *data, uint32_t len) override;
+  virtual bool seek(int32_t pos, int dir) override;
+  virtual bool close() override;
+  virtual bool isOpen() override;
+  virtual uint32_t getSize() override;
+  virtual uint32_t getPos() override;
+  virtual bool loop() override;
+
+  // Refills up to `maxBytes` (whole REFILL chunks); returns bytes read
+  uint32_t fill(uint32_t maxBytes);
+  uint32_t buffered() const { return end_ - pos_; }
+
+  const ReadAheadStats &stats() const { return stats_; }
+  void resetStats();
+
+private:
+  uint32_t refillOnce();
+
+  fs::FS &fs_;
+  File f_;
+  uint8_t *buf_;
+  uint32_t mask_;
+  uint32_t pos_;   // file offset of the next byte handed to read()
+  uint32_t end_;   // file offset just past the buffered bytes
+  uint32_t size_;
+  ReadAheadStats stats_;
+};
+
+#endif